@@ -0,0 +1,72 @@
+#include "sea.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Decodes a SEA file several times and writes the raw interleaved 16-bit PCM output.
+// Prints the fastest decode time in nanoseconds, used by examples/c_conformance.rs
+
+int main(int argc, char* argv[])
+{
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <input_file> <output_file> <iterations>\n", argv[0]);
+        return 1;
+    }
+
+    int iterations = atoi(argv[3]);
+    if (iterations < 1) {
+        fprintf(stderr, "Iterations must be at least 1\n");
+        return 1;
+    }
+
+    FILE* input_file = fopen(argv[1], "rb");
+    if (!input_file) {
+        perror("Error opening input file");
+        return 1;
+    }
+
+    fseek(input_file, 0, SEEK_END);
+    uint32_t encoded_len = ftell(input_file);
+    rewind(input_file);
+
+    uint8_t* encoded = (uint8_t*)malloc(encoded_len);
+    if (fread(encoded, 1, encoded_len, input_file) != encoded_len) {
+        fprintf(stderr, "Error reading input file\n");
+        return 1;
+    }
+    fclose(input_file);
+
+    uint32_t sample_rate, channels, output_frames;
+    if (sea_decode(encoded, encoded_len, &sample_rate, &channels, NULL, &output_frames) != 0) {
+        return 2;
+    }
+
+    int16_t* output = (int16_t*)malloc((size_t)output_frames * channels * sizeof(int16_t) + 1);
+    double best_ns = -1.0;
+
+    for (int i = 0; i < iterations; i++) {
+        clock_t start = clock();
+        if (sea_decode(encoded, encoded_len, &sample_rate, &channels, output, &output_frames) != 0) {
+            return 2;
+        }
+        double elapsed_ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC;
+        if (best_ns < 0.0 || elapsed_ns < best_ns) {
+            best_ns = elapsed_ns;
+        }
+    }
+    free(encoded);
+
+    FILE* output_file = fopen(argv[2], "wb");
+    if (!output_file) {
+        perror("Error opening output file");
+        return 1;
+    }
+
+    fwrite(output, sizeof(int16_t), (size_t)output_frames * channels, output_file);
+    fclose(output_file);
+    free(output);
+
+    printf("%.0f\n", best_ns);
+    return 0;
+}
@@ -102,6 +102,17 @@ static void sea_alloc_prepare_dqt(uint32_t scale_factor_bits, uint32_t residual_
     }
 
     SEA_DQT_COLUMNS = dqt_len * 2;
+    SEA_DQT_SCALE_FACTOR_BITS = scale_factor_bits;
+    SEA_DQT_RESIDUAL_BITS = residual_bits;
+}
+
+static void sea_free_dqt(void)
+{
+    free(SEA_DQT);
+    SEA_DQT = NULL;
+    SEA_DQT_COLUMNS = 0;
+    SEA_DQT_SCALE_FACTOR_BITS = 0;
+    SEA_DQT_RESIDUAL_BITS = 0;
 }
 
 static inline int32_t sea_lms_predict(const SEA_LMS* lms)
@@ -165,7 +176,9 @@ static int sea_read_chunk(const uint8_t** encoded, uint32_t channels, uint32_t f
 
     for (int scale_factor_offset = 0; scale_factor_offset < scale_factor_items; scale_factor_offset += channels) {
         uint8_t* scale_factor_residuals = &residuals[scale_factor_offset * scale_factor_frames];
-        for (int frame_index = 0; frame_index < scale_factor_frames; frame_index++) {
+        // last scale factor of the file might cover less frames
+        uint32_t subchunk_frames = SEA_MIN(scale_factor_frames, frames_in_this_chunk - (scale_factor_offset / channels) * scale_factor_frames);
+        for (int frame_index = 0; frame_index < subchunk_frames; frame_index++) {
             const uint8_t* subchunk_residuals = &scale_factor_residuals[frame_index * channels];
             for (int channel_index = 0; channel_index < channels; ++channel_index) {
                 uint8_t scale_factor = scale_factors[scale_factor_offset + channel_index];
@@ -204,7 +217,7 @@ int sea_decode(uint8_t* encoded, uint32_t encoded_len, uint32_t* sample_rate, ui
     *sample_rate = SEA_READ_U32_LE(encoded_ptr);
     *total_frames = SEA_READ_U32_LE(encoded_ptr);
     uint32_t metadata_len = SEA_READ_U32_LE(encoded_ptr);
-    encoded_ptr += metadata_len;
+    *encoded_ptr += metadata_len;
 
     if (output == NULL) {
         return 0;
@@ -214,15 +227,19 @@ int sea_decode(uint8_t* encoded, uint32_t encoded_len, uint32_t* sample_rate, ui
     int16_t** output_ptr = (int16_t**)&output;
     while (read_frames < *total_frames) {
         uint32_t frames_in_chunk = SEA_MIN(frames_per_chunk, *total_frames - read_frames);
+        const uint8_t* chunk_start = *encoded_ptr;
         uint32_t written_samples = sea_read_chunk(encoded_ptr, *channels, frames_in_chunk, output_ptr);
         if (written_samples != 0) {
             fprintf(stderr, "Decode error\n");
+            sea_free_dqt();
             return 2;
         }
+        // chunks might be padded with zeroes up to chunk_size
+        *encoded_ptr = chunk_start + chunk_size;
         read_frames += frames_in_chunk;
     }
 
-    free(SEA_DQT);
+    sea_free_dqt();
     return 0;
 }
 
@@ -0,0 +1,345 @@
+/*
+    SEA - Simple Embedded Audio Codec
+    MIT License
+
+    Hardened, reentrant variant of sea.h, built as the standalone web/sea_decoder.wasm.
+    It is freestanding: no libc and no allocation, the only import is powf (Math.pow in JS).
+    All state lives in a SEA_DECODER of sea_decoder_size() bytes that the caller provides,
+    so any number of decoders can run side by side. Every read is bounds checked and
+    malformed input is reported with a negative SEA_ERROR_* code instead of crashing.
+
+    Build (npm run build:c-decoder in web/):
+    clang --target=wasm32 -O3 -ffreestanding -nostdlib -fno-builtin -Wl,--no-entry -Wl,--export=__heap_base \
+        -Wl,--strip-all -o web/sea_decoder.wasm c/sea_decoder.c
+
+    Usage:
+    1. sea_decoder_init() with the first 22 bytes of the file, it returns the length of the whole
+       header. The metadata is not needed by the decoder and can be skipped.
+    2. sea_decoder_decode_chunk() for every chunk_size bytes after the header, the last chunk of
+       a file with total_frames set may be shorter. It returns the number of samples written,
+       0 once total_frames were decoded.
+*/
+
+#include <stdint.h>
+
+#ifdef __wasm__
+#define SEA_EXPORT(name) __attribute__((export_name(name)))
+__attribute__((import_module("env"), import_name("powf"))) float sea_powf(float x, float y);
+#else
+#include <math.h>
+#define SEA_EXPORT(name)
+#define sea_powf powf
+#endif
+
+#define SEA_ERROR_INVALID_FILE -1
+#define SEA_ERROR_INVALID_CHUNK -2
+#define SEA_ERROR_UNSUPPORTED -3
+#define SEA_ERROR_OUTPUT_TOO_SMALL -4
+
+#define SEA_HEADER_SIZE 22
+#define SEA_LMS_LEN 4
+#define SEA_MAX_CHANNELS 255
+// larger scale factors are valid but would need a much larger table, the encoder uses 3 - 5 bits
+#define SEA_MAX_SCALE_FACTOR_BITS 6
+// entries of all residual sizes for one scale factor: 2 + 4 + ... + 256
+#define SEA_DQT_ROW_ITEMS 510
+
+typedef struct {
+    int32_t history[SEA_LMS_LEN];
+    int32_t weights[SEA_LMS_LEN];
+} SEA_LMS;
+
+typedef struct {
+    uint32_t channels;
+    uint32_t chunk_size;
+    uint32_t frames_per_chunk;
+    uint32_t sample_rate;
+    uint32_t total_frames;
+    uint32_t frames_read;
+
+    SEA_LMS lms[SEA_MAX_CHANNELS];
+
+    // dequantization tables of every residual size for dqt_scale_factor_bits,
+    // the table of residual size r starts at dqt_offsets[r] and has 2^r columns
+    uint32_t dqt_scale_factor_bits;
+    uint32_t dqt_offsets[9];
+    int32_t dqt[(1 << SEA_MAX_SCALE_FACTOR_BITS) * SEA_DQT_ROW_ITEMS];
+} SEA_DECODER;
+
+// msb first bit reader, the caller checks that the packed data fits into the input beforehand
+typedef struct {
+    const uint8_t* data;
+    uint32_t acc;
+    uint32_t bits;
+} SEA_BIT_READER;
+
+static inline uint32_t sea_read_bits(SEA_BIT_READER* reader, uint32_t bit_size)
+{
+    while (reader->bits < bit_size) {
+        reader->acc = (reader->acc << 8) | *reader->data++;
+        reader->bits += 8;
+    }
+    reader->bits -= bit_size;
+    return (reader->acc >> reader->bits) & ((1u << bit_size) - 1);
+}
+
+static inline uint32_t sea_read_u16_le(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8);
+}
+
+static inline uint32_t sea_read_u32_le(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static inline int32_t sea_clamp_i16(int32_t value)
+{
+    return value > INT16_MAX ? INT16_MAX : (value < INT16_MIN ? INT16_MIN : value);
+}
+
+// round half away from zero like roundf, the values are never negative
+static inline int32_t sea_round(float value)
+{
+    float truncated = __builtin_truncf(value);
+    return (int32_t)truncated + (value - truncated >= 0.5f);
+}
+
+static void sea_prepare_dqt(SEA_DECODER* decoder, uint32_t scale_factor_bits)
+{
+    static const float IDEAL_POW_FACTOR[8] = { 12.0f, 11.65f, 11.20f, 10.58f, 9.64f, 8.75f, 7.66f, 6.63f };
+
+    if (decoder->dqt_scale_factor_bits == scale_factor_bits) {
+        return;
+    }
+
+    uint32_t scale_factor_items = 1u << scale_factor_bits;
+    uint32_t offset = 0;
+    for (uint32_t residual_bits = 1; residual_bits <= 8; residual_bits++) {
+        uint32_t dqt_len = 1u << (residual_bits - 1);
+
+        float dqt[128];
+        if (residual_bits == 1) {
+            dqt[0] = 2.0f;
+        } else if (residual_bits == 2) {
+            dqt[0] = 1.115f;
+            dqt[1] = 4.0f;
+        } else {
+            dqt[0] = 0.75f;
+            float end = (float)((1 << residual_bits) - 1);
+            float step = __builtin_floorf((end - dqt[0]) / (float)(dqt_len - 1));
+            for (uint32_t i = 1; i < dqt_len - 1; i++) {
+                dqt[i] = 0.5f + (float)i * step;
+            }
+            dqt[dqt_len - 1] = end;
+        }
+
+        float power_factor = IDEAL_POW_FACTOR[residual_bits - 1] / (float)scale_factor_bits;
+        decoder->dqt_offsets[residual_bits] = offset;
+        for (uint32_t s = 0; s < scale_factor_items; s++) {
+            int32_t scale_factor = (int32_t)sea_powf((float)(s + 1), power_factor);
+            for (uint32_t q = 0; q < dqt_len; q++) {
+                int32_t value = sea_round((float)scale_factor * dqt[q]);
+                decoder->dqt[offset++] = value;
+                decoder->dqt[offset++] = -value;
+            }
+        }
+    }
+
+    decoder->dqt_scale_factor_bits = scale_factor_bits;
+}
+
+// the filter wraps around on overflow like the Rust decoder, unsigned math keeps that defined in C
+static inline int32_t sea_lms_predict(const SEA_LMS* lms)
+{
+    uint32_t prediction = 0;
+    for (int i = 0; i < SEA_LMS_LEN; i++) {
+        prediction += (uint32_t)lms->weights[i] * (uint32_t)lms->history[i];
+    }
+    return (int32_t)prediction >> 13;
+}
+
+static inline void sea_lms_update(SEA_LMS* lms, int32_t sample, int32_t residual)
+{
+    uint32_t delta = (uint32_t)(residual >> 4);
+    for (int i = 0; i < SEA_LMS_LEN; i++) {
+        lms->weights[i] = (int32_t)((uint32_t)lms->weights[i] + (lms->history[i] < 0 ? 0u - delta : delta));
+    }
+    for (int i = 1; i < SEA_LMS_LEN; i++) {
+        lms->history[i - 1] = lms->history[i];
+    }
+    lms->history[SEA_LMS_LEN - 1] = sample;
+}
+
+SEA_EXPORT("sea_decoder_size")
+uint32_t sea_decoder_size(void)
+{
+    return sizeof(SEA_DECODER);
+}
+
+SEA_EXPORT("sea_decoder_init")
+int32_t sea_decoder_init(SEA_DECODER* decoder, const uint8_t* data, uint32_t len)
+{
+    if (len < SEA_HEADER_SIZE) {
+        return SEA_ERROR_INVALID_FILE;
+    }
+
+    if (data[0] != 's' || data[1] != 'e' || data[2] != 'a' || data[3] != 'c' || data[4] != 1) {
+        return SEA_ERROR_INVALID_FILE;
+    }
+
+    uint32_t metadata_len = sea_read_u32_le(data + 18);
+    if (metadata_len > INT32_MAX - SEA_HEADER_SIZE) {
+        return SEA_ERROR_UNSUPPORTED;
+    }
+
+    decoder->channels = data[5];
+    decoder->chunk_size = sea_read_u16_le(data + 6);
+    decoder->frames_per_chunk = sea_read_u16_le(data + 8);
+    decoder->sample_rate = sea_read_u32_le(data + 10);
+    decoder->total_frames = sea_read_u32_le(data + 14);
+    decoder->frames_read = 0;
+    decoder->dqt_scale_factor_bits = 0;
+
+    // same limits as SeaFileHeader::validate
+    if (decoder->channels == 0 || decoder->chunk_size < 16 || decoder->frames_per_chunk == 0
+        || decoder->sample_rate == 0) {
+        return SEA_ERROR_INVALID_FILE;
+    }
+
+    return (int32_t)(SEA_HEADER_SIZE + metadata_len);
+}
+
+SEA_EXPORT("sea_decoder_channels")
+uint32_t sea_decoder_channels(const SEA_DECODER* decoder) { return decoder->channels; }
+
+SEA_EXPORT("sea_decoder_sample_rate")
+uint32_t sea_decoder_sample_rate(const SEA_DECODER* decoder) { return decoder->sample_rate; }
+
+SEA_EXPORT("sea_decoder_chunk_size")
+uint32_t sea_decoder_chunk_size(const SEA_DECODER* decoder) { return decoder->chunk_size; }
+
+SEA_EXPORT("sea_decoder_frames_per_chunk")
+uint32_t sea_decoder_frames_per_chunk(const SEA_DECODER* decoder) { return decoder->frames_per_chunk; }
+
+SEA_EXPORT("sea_decoder_total_frames")
+uint32_t sea_decoder_total_frames(const SEA_DECODER* decoder) { return decoder->total_frames; }
+
+SEA_EXPORT("sea_decoder_decode_chunk")
+int32_t sea_decoder_decode_chunk(SEA_DECODER* decoder, const uint8_t* chunk, uint32_t len, int16_t* output,
+    uint32_t output_samples)
+{
+    uint32_t channels = decoder->channels;
+    uint32_t frames = decoder->frames_per_chunk;
+    if (decoder->total_frames > 0) {
+        uint32_t remaining_frames = decoder->total_frames - decoder->frames_read;
+        if (remaining_frames == 0) {
+            return 0;
+        }
+        frames = remaining_frames < frames ? remaining_frames : frames;
+    } else if (len < decoder->chunk_size) {
+        // streams only consist of full chunks
+        return SEA_ERROR_INVALID_CHUNK;
+    }
+
+    if (len > decoder->chunk_size) {
+        len = decoder->chunk_size;
+    }
+    if (len < 4) {
+        return SEA_ERROR_INVALID_CHUNK;
+    }
+
+    // layered chunks (flag 0x10) decode their base layer, the enhancement layer after it is skipped
+    uint32_t type = chunk[0] & ~0x10u;
+    uint32_t scale_factor_bits = chunk[1] >> 4;
+    uint32_t residual_size = chunk[1] & 0xF;
+    uint32_t scale_factor_frames = chunk[2];
+    if ((type != 0x01 && type != 0x02) || residual_size < 1 || residual_size > 8 || scale_factor_bits == 0
+        || scale_factor_frames == 0 || chunk[3] != 0x5A) {
+        return SEA_ERROR_INVALID_CHUNK;
+    }
+    if (scale_factor_bits > SEA_MAX_SCALE_FACTOR_BITS) {
+        return SEA_ERROR_UNSUPPORTED;
+    }
+    if ((uint64_t)frames * channels > output_samples) {
+        return SEA_ERROR_OUTPUT_TOO_SMALL;
+    }
+
+    // sizes of the packed sections, 64 bit so nothing can overflow before the comparison with len
+    uint64_t scale_factor_items = (uint64_t)((frames + scale_factor_frames - 1) / scale_factor_frames) * channels;
+    uint64_t lms_bytes = (uint64_t)channels * SEA_LMS_LEN * 4;
+    uint64_t scale_factor_bytes = (scale_factor_items * scale_factor_bits + 7) / 8;
+    uint64_t vbr_bytes = type == 0x02 ? (scale_factor_items * 2 + 7) / 8 : 0;
+    uint64_t header_bytes = 4 + lms_bytes + scale_factor_bytes + vbr_bytes;
+    if (header_bytes > len) {
+        return SEA_ERROR_INVALID_CHUNK;
+    }
+
+    const uint8_t* lms_data = chunk + 4;
+    SEA_BIT_READER scale_factors = { chunk + 4 + lms_bytes, 0, 0 };
+    SEA_BIT_READER vbr_sizes = { chunk + 4 + lms_bytes + scale_factor_bytes, 0, 0 };
+    SEA_BIT_READER residuals = { chunk + header_bytes, 0, 0 };
+
+    uint64_t residual_bits = 0;
+    if (type == 0x02) {
+        SEA_BIT_READER sizes = vbr_sizes;
+        for (uint32_t subchunk_start = 0; subchunk_start < frames; subchunk_start += scale_factor_frames) {
+            uint32_t subchunk_frames = frames - subchunk_start;
+            subchunk_frames = subchunk_frames < scale_factor_frames ? subchunk_frames : scale_factor_frames;
+            for (uint32_t channel = 0; channel < channels; channel++) {
+                uint32_t size = residual_size - 1 + sea_read_bits(&sizes, 2);
+                if (size == 0 || size > 8) {
+                    return SEA_ERROR_INVALID_CHUNK;
+                }
+                residual_bits += (uint64_t)size * subchunk_frames;
+            }
+        }
+    } else {
+        residual_bits = (uint64_t)frames * channels * residual_size;
+    }
+    if (header_bytes + (residual_bits + 7) / 8 > len) {
+        return SEA_ERROR_INVALID_CHUNK;
+    }
+
+    sea_prepare_dqt(decoder, scale_factor_bits);
+
+    for (uint32_t channel = 0; channel < channels; channel++) {
+        SEA_LMS* lms = &decoder->lms[channel];
+        for (int i = 0; i < SEA_LMS_LEN; i++) {
+            lms->history[i] = (int16_t)sea_read_u16_le(lms_data + i * 2);
+            lms->weights[i] = (int16_t)sea_read_u16_le(lms_data + SEA_LMS_LEN * 2 + i * 2);
+        }
+        lms_data += SEA_LMS_LEN * 4;
+    }
+
+    const int32_t* channel_dqt[SEA_MAX_CHANNELS];
+    uint32_t channel_bits[SEA_MAX_CHANNELS];
+    int16_t* out = output;
+
+    for (uint32_t subchunk_start = 0; subchunk_start < frames; subchunk_start += scale_factor_frames) {
+        // last scale factor of the file might cover less frames
+        uint32_t subchunk_frames = frames - subchunk_start;
+        subchunk_frames = subchunk_frames < scale_factor_frames ? subchunk_frames : scale_factor_frames;
+
+        for (uint32_t channel = 0; channel < channels; channel++) {
+            uint32_t scale_factor = sea_read_bits(&scale_factors, scale_factor_bits);
+            uint32_t size = type == 0x02 ? residual_size - 1 + sea_read_bits(&vbr_sizes, 2) : residual_size;
+            channel_bits[channel] = size;
+            channel_dqt[channel] = &decoder->dqt[decoder->dqt_offsets[size] + (scale_factor << size)];
+        }
+
+        for (uint32_t frame = 0; frame < subchunk_frames; frame++) {
+            for (uint32_t channel = 0; channel < channels; channel++) {
+                SEA_LMS* lms = &decoder->lms[channel];
+                int32_t predicted = sea_lms_predict(lms);
+                int32_t dequantized = channel_dqt[channel][sea_read_bits(&residuals, channel_bits[channel])];
+                int32_t reconstructed = sea_clamp_i16((int32_t)((uint32_t)predicted + (uint32_t)dequantized));
+                *out++ = (int16_t)reconstructed;
+                sea_lms_update(lms, reconstructed, dequantized);
+            }
+        }
+    }
+
+    decoder->frames_read += frames;
+    return (int32_t)(frames * channels);
+}
@@ -0,0 +1,248 @@
+#[path = "../tests/helpers.rs"]
+mod helpers;
+
+use std::{
+    env, fs,
+    path::{Path, PathBuf},
+    process::Command,
+    time::{Duration, Instant},
+};
+
+use bytemuck::cast_slice;
+use helpers::{gen_test_signal, TEST_SAMPLE_RATE};
+use sea_codec::{encoder::EncoderSettings, sea_decode, sea_encode};
+
+const C_SOURCE: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/c/bench.c");
+const ITERATIONS: usize = 5;
+
+struct CorpusItem {
+    name: String,
+    channels: u32,
+    frames: usize,
+    settings: EncoderSettings,
+}
+
+fn corpus() -> Vec<CorpusItem> {
+    let mut items = Vec::new();
+
+    for channels in [1, 2, 6] {
+        for residual_bits in 1..=8 {
+            items.push(CorpusItem {
+                name: format!("ch{}_cbr{}", channels, residual_bits),
+                channels,
+                frames: TEST_SAMPLE_RATE as usize * 2,
+                settings: EncoderSettings {
+                    residual_bits: residual_bits as f32,
+                    ..Default::default()
+                },
+            });
+        }
+    }
+
+    for scale_factor_bits in 3..=5 {
+        for scale_factor_frames in [10, 20, 32] {
+            items.push(CorpusItem {
+                name: format!("ch2_sf{}x{}", scale_factor_bits, scale_factor_frames),
+                channels: 2,
+                frames: TEST_SAMPLE_RATE as usize,
+                settings: EncoderSettings {
+                    scale_factor_bits,
+                    scale_factor_frames,
+                    frames_per_chunk: 160 * scale_factor_frames as u16,
+                    ..Default::default()
+                },
+            });
+        }
+    }
+
+    // lengths not aligned to chunks or scale factors
+    for frames in [1, 19, 5121, 12345] {
+        items.push(CorpusItem {
+            name: format!("ch3_len{}", frames),
+            channels: 3,
+            frames,
+            settings: EncoderSettings::default(),
+        });
+    }
+
+    for residual_bits in [2.5, 3.0, 4.2] {
+        items.push(CorpusItem {
+            name: format!("ch2_vbr{}", residual_bits),
+            channels: 2,
+            frames: TEST_SAMPLE_RATE as usize * 2,
+            settings: EncoderSettings {
+                residual_bits,
+                vbr: true,
+                ..Default::default()
+            },
+        });
+    }
+
+    items
+}
+
+fn compile_c_decoder(out_dir: &Path) -> PathBuf {
+    let compiler = env::var("CC").unwrap_or_else(|_| "cc".to_string());
+    let binary = out_dir.join("sea_bench");
+
+    let status = Command::new(&compiler)
+        .args(["-O2", "-o"])
+        .arg(&binary)
+        .arg(C_SOURCE)
+        .arg("-lm")
+        .status()
+        .unwrap_or_else(|err| {
+            eprintln!("Error: Failed to run C compiler '{}': {}", compiler, err);
+            std::process::exit(1);
+        });
+
+    if !status.success() {
+        eprintln!("Error: Failed to compile {}", C_SOURCE);
+        std::process::exit(1);
+    }
+
+    binary
+}
+
+fn rust_decode(encoded: &[u8]) -> (Vec<i16>, Duration) {
+    let mut best = Duration::MAX;
+    let mut samples = Vec::new();
+
+    for _ in 0..ITERATIONS {
+        let now = Instant::now();
+        let decoded = sea_decode(encoded);
+        best = best.min(now.elapsed());
+        samples = decoded.samples;
+    }
+
+    (samples, best)
+}
+
+fn c_decode(
+    binary: &Path,
+    sea_path: &Path,
+    raw_path: &Path,
+) -> Result<(Vec<u8>, Duration), String> {
+    let output = Command::new(binary)
+        .arg(sea_path)
+        .arg(raw_path)
+        .arg(ITERATIONS.to_string())
+        .output()
+        .map_err(|err| err.to_string())?;
+
+    if !output.status.success() {
+        return Err(String::from_utf8_lossy(&output.stderr).trim().to_string());
+    }
+
+    let nanos = String::from_utf8_lossy(&output.stdout)
+        .trim()
+        .parse::<u64>()
+        .map_err(|err| err.to_string())?;
+    let pcm = fs::read(raw_path).map_err(|err| err.to_string())?;
+
+    Ok((pcm, Duration::from_nanos(nanos)))
+}
+
+fn main() {
+    let out_dir = env::temp_dir().join("sea_c_conformance");
+    fs::create_dir_all(&out_dir).unwrap();
+
+    let binary = compile_c_decoder(&out_dir);
+
+    println!(
+        "{:<16} {:>9} {:>10} {:>10} {:>7}  result",
+        "name", "samples", "rust ms", "c ms", "c/rust"
+    );
+
+    let mut failures = 0;
+    let mut total_rust = Duration::ZERO;
+    let mut total_c = Duration::ZERO;
+
+    for item in corpus() {
+        let input = gen_test_signal(item.channels, item.frames);
+        let input = &input[..item.frames * item.channels as usize];
+        let encoded = sea_encode(
+            input,
+            TEST_SAMPLE_RATE,
+            item.channels,
+            item.settings.clone(),
+        );
+
+        let sea_path = out_dir.join(format!("{}.sea", item.name));
+        let raw_path = out_dir.join(format!("{}.raw", item.name));
+        fs::write(&sea_path, &encoded).unwrap();
+
+        let (rust_samples, rust_time) = rust_decode(&encoded);
+        let rust_ms = rust_time.as_secs_f64() * 1000.0;
+
+        // the C decoder is a minimal implementation without VBR support
+        if item.settings.vbr {
+            println!(
+                "{:<16} {:>9} {:>10.3} {:>10} {:>7}  skipped (VBR not supported in C)",
+                item.name,
+                rust_samples.len(),
+                rust_ms,
+                "-",
+                "-"
+            );
+            continue;
+        }
+
+        match c_decode(&binary, &sea_path, &raw_path) {
+            Ok((c_pcm, c_time)) => {
+                let rust_pcm: &[u8] = cast_slice(&rust_samples);
+                let result = if c_pcm == rust_pcm {
+                    "ok".to_string()
+                } else {
+                    failures += 1;
+                    let c_samples: &[i16] = cast_slice(&c_pcm[..c_pcm.len() & !1]);
+                    match rust_samples.iter().zip(c_samples).position(|(a, b)| a != b) {
+                        Some(index) => format!("MISMATCH at sample {}", index),
+                        None => format!(
+                            "MISMATCH in length: rust {} c {}",
+                            rust_samples.len(),
+                            c_samples.len()
+                        ),
+                    }
+                };
+
+                total_rust += rust_time;
+                total_c += c_time;
+
+                println!(
+                    "{:<16} {:>9} {:>10.3} {:>10.3} {:>7.2}  {}",
+                    item.name,
+                    rust_samples.len(),
+                    rust_ms,
+                    c_time.as_secs_f64() * 1000.0,
+                    c_time.as_secs_f64() / rust_time.as_secs_f64(),
+                    result
+                );
+            }
+            Err(err) => {
+                failures += 1;
+                println!(
+                    "{:<16} {:>9} {:>10.3} {:>10} {:>7}  C DECODER FAILED: {}",
+                    item.name,
+                    rust_samples.len(),
+                    rust_ms,
+                    "-",
+                    "-",
+                    err
+                );
+            }
+        }
+    }
+
+    println!(
+        "total (compared)           {:>10.3} {:>10.3} {:>7.2}",
+        total_rust.as_secs_f64() * 1000.0,
+        total_c.as_secs_f64() * 1000.0,
+        total_c.as_secs_f64() / total_rust.as_secs_f64()
+    );
+
+    if failures > 0 {
+        eprintln!("Error: {} corpus items do not match", failures);
+        std::process::exit(1);
+    }
+}
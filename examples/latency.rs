@@ -0,0 +1,313 @@
+#[path = "../tests/helpers.rs"]
+mod helpers;
+
+use std::{
+    cell::RefCell,
+    collections::VecDeque,
+    io::{self, Read, Write},
+    rc::Rc,
+    thread,
+    time::{Duration, Instant},
+};
+
+use bytemuck::cast_slice;
+use clap::{Arg, Command};
+use helpers::{gen_test_signal, TEST_SAMPLE_RATE};
+use sea_codec::{
+    decoder::SeaDecoder,
+    encoder::{EncoderSettings, SeaEncoder},
+};
+
+// feeds PCM bytes no faster than a live capture device would deliver them
+struct PacedSource {
+    data: Vec<u8>,
+    position: usize,
+    start: Instant,
+    bytes_per_second: f64,
+}
+
+impl PacedSource {
+    fn new(samples: &[i16], channels: u32, speed: f64) -> Self {
+        Self {
+            data: cast_slice(samples).to_vec(),
+            position: 0,
+            start: Instant::now(),
+            bytes_per_second: TEST_SAMPLE_RATE as f64 * channels as f64 * 2.0 * speed,
+        }
+    }
+}
+
+impl Read for PacedSource {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        let amount = buf.len().min(self.data.len() - self.position);
+        if amount == 0 {
+            return Ok(0);
+        }
+
+        // the last requested byte has to be captured before we can hand it out
+        let end = self.position + amount;
+        let available_at = self.start + Duration::from_secs_f64(end as f64 / self.bytes_per_second);
+        let now = Instant::now();
+        if available_at > now {
+            thread::sleep(available_at - now);
+        }
+
+        buf[..amount].copy_from_slice(&self.data[self.position..end]);
+        self.position = end;
+        Ok(amount)
+    }
+}
+
+// in-memory pipe between the encoder and the decoder
+#[derive(Clone, Default)]
+struct Pipe {
+    buffer: Rc<RefCell<VecDeque<u8>>>,
+}
+
+impl Pipe {
+    fn len(&self) -> usize {
+        self.buffer.borrow().len()
+    }
+}
+
+impl Write for Pipe {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.buffer.borrow_mut().extend(buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl Read for Pipe {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        self.buffer.borrow_mut().read(buf)
+    }
+}
+
+struct Profile {
+    name: &'static str,
+    residual_bits: f32,
+    vbr: bool,
+}
+
+const PROFILES: [Profile; 4] = [
+    Profile {
+        name: "cbr-2",
+        residual_bits: 2.0,
+        vbr: false,
+    },
+    Profile {
+        name: "cbr-3",
+        residual_bits: 3.0,
+        vbr: false,
+    },
+    Profile {
+        name: "cbr-5",
+        residual_bits: 5.0,
+        vbr: false,
+    },
+    Profile {
+        name: "vbr-3.5",
+        residual_bits: 3.5,
+        vbr: true,
+    },
+];
+
+struct LatencyReport {
+    chunks: usize,
+    latencies: Vec<Duration>,
+}
+
+impl LatencyReport {
+    fn percentile(&self, q: f64) -> Duration {
+        let index = ((self.latencies.len() as f64 * q).ceil() as usize).max(1) - 1;
+        self.latencies[index.min(self.latencies.len() - 1)]
+    }
+
+    fn max(&self) -> Duration {
+        *self.latencies.last().unwrap()
+    }
+}
+
+fn measure(input: &[i16], channels: u32, settings: EncoderSettings, speed: f64) -> LatencyReport {
+    let frames_per_chunk = settings.frames_per_chunk as usize;
+    let seconds_per_frame = 1.0 / (TEST_SAMPLE_RATE as f64 * speed);
+
+    let mut source = PacedSource::new(input, channels, speed);
+    let start = source.start;
+    let pipe = Pipe::default();
+    let mut encoder_pipe = pipe.clone();
+
+    // streaming mode, like a live capture would use
+    let mut encoder = SeaEncoder::new(
+        channels as u8,
+        TEST_SAMPLE_RATE,
+        None,
+        settings,
+        &mut source,
+        &mut encoder_pipe,
+    )
+    .unwrap();
+
+    let mut decoder: Option<SeaDecoder<Pipe, io::Sink>> = None;
+    let mut latencies = Vec::new();
+
+    loop {
+        let more = encoder.encode_frame().unwrap();
+
+        if pipe.len() > 0 {
+            // the header is only available after the first chunk was encoded
+            let decoder = match decoder.as_mut() {
+                Some(decoder) => decoder,
+                None => decoder.insert(SeaDecoder::new(pipe.clone(), io::sink()).unwrap()),
+            };
+
+            let chunk_index = latencies.len();
+            if decoder.decode_frame().unwrap() {
+                let first_frame = chunk_index * frames_per_chunk;
+                let captured_at =
+                    start + Duration::from_secs_f64(first_frame as f64 * seconds_per_frame);
+                latencies.push(Instant::now() - captured_at);
+            }
+        }
+
+        if !more {
+            break;
+        }
+    }
+
+    latencies.sort_unstable();
+
+    LatencyReport {
+        chunks: latencies.len(),
+        latencies,
+    }
+}
+
+fn parse_list<T: std::str::FromStr>(value: &str, what: &str) -> Vec<T> {
+    value
+        .split(',')
+        .map(|item| {
+            item.trim().parse::<T>().unwrap_or_else(|_| {
+                eprintln!("Error: Failed to parse {}", what);
+                std::process::exit(1);
+            })
+        })
+        .collect()
+}
+
+fn main() {
+    let matches = Command::new("latency")
+        .about("Measures capture-to-playback latency of a live SEA stream")
+        .arg(
+            Arg::new("seconds")
+                .long("seconds")
+                .help("Length of the stream for each measurement in seconds")
+                .default_value("5"),
+        )
+        .arg(
+            Arg::new("speed")
+                .long("speed")
+                .help("Pacing relative to real time (2 means twice as fast as real time)")
+                .default_value("1"),
+        )
+        .arg(
+            Arg::new("channels")
+                .long("channels")
+                .help("Number of channels in the stream")
+                .default_value("2"),
+        )
+        .arg(
+            Arg::new("chunk-sizes")
+                .long("chunk-sizes")
+                .help("Comma separated list of frames per chunk")
+                .default_value("320,640,1280,2560,5120"),
+        )
+        .get_matches();
+
+    let seconds = matches
+        .get_one::<String>("seconds")
+        .unwrap()
+        .parse::<f64>()
+        .unwrap_or_else(|_| {
+            eprintln!("Error: Failed to parse seconds");
+            std::process::exit(1);
+        });
+    let speed = matches
+        .get_one::<String>("speed")
+        .unwrap()
+        .parse::<f64>()
+        .unwrap_or_else(|_| {
+            eprintln!("Error: Failed to parse speed");
+            std::process::exit(1);
+        });
+    let channels = matches
+        .get_one::<String>("channels")
+        .unwrap()
+        .parse::<u32>()
+        .unwrap_or_else(|_| {
+            eprintln!("Error: Failed to parse channels");
+            std::process::exit(1);
+        });
+    let chunk_sizes: Vec<u16> = parse_list(
+        matches.get_one::<String>("chunk-sizes").unwrap(),
+        "chunk sizes",
+    );
+
+    let scale_factor_frames = EncoderSettings::default().scale_factor_frames;
+    if let Some(invalid) = chunk_sizes
+        .iter()
+        .find(|size| **size == 0 || **size % scale_factor_frames as u16 != 0)
+    {
+        eprintln!(
+            "Error: Chunk size {} must be a multiple of {}",
+            invalid, scale_factor_frames
+        );
+        std::process::exit(1);
+    }
+
+    println!(
+        "{:>6} {:>8} {:>7} {:>10} {:>10} {:>10} {:>10} {:>10}",
+        "chunk", "profile", "chunks", "buffer ms", "p50 ms", "p99 ms", "max ms", "proc p99"
+    );
+
+    for frames_per_chunk in chunk_sizes {
+        // whole chunks only, a live stream never ends with a partial one
+        let frames = ((TEST_SAMPLE_RATE as f64 * seconds) as usize)
+            .div_ceil(frames_per_chunk as usize)
+            * frames_per_chunk as usize;
+        let input = gen_test_signal(channels, frames);
+        let input = &input[..frames * channels as usize];
+
+        // time spent waiting for a chunk to fill up, unavoidable with this chunk size
+        let buffer_duration =
+            Duration::from_secs_f64(frames_per_chunk as f64 / (TEST_SAMPLE_RATE as f64 * speed));
+
+        for profile in PROFILES.iter() {
+            let settings = EncoderSettings {
+                frames_per_chunk,
+                residual_bits: profile.residual_bits,
+                vbr: profile.vbr,
+                ..Default::default()
+            };
+
+            let report = measure(input, channels, settings, speed);
+            let p99 = report.percentile(0.99);
+
+            println!(
+                "{:>6} {:>8} {:>7} {:>10.2} {:>10.2} {:>10.2} {:>10.2} {:>10.2}",
+                frames_per_chunk,
+                profile.name,
+                report.chunks,
+                buffer_duration.as_secs_f64() * 1000.0,
+                report.percentile(0.5).as_secs_f64() * 1000.0,
+                p99.as_secs_f64() * 1000.0,
+                report.max().as_secs_f64() * 1000.0,
+                p99.saturating_sub(buffer_duration).as_secs_f64() * 1000.0,
+            );
+        }
+    }
+}
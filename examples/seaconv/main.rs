@@ -0,0 +1,548 @@
+use bytemuck::cast_slice;
+use clap::{Arg, ArgAction, ArgMatches, Command};
+use sea_codec::{
+    decoder::SeaDecoder,
+    encoder::{EncoderSettings, QualityTarget, SeaEncoder},
+    sea_drop_enhancement, sea_encode_quality, sea_extract_channels, sea_rechunk,
+};
+use std::{
+    io::{Cursor, Write},
+    path::Path,
+};
+use wav::{read_wav, write_wav};
+
+#[cfg(unix)]
+mod serve;
+#[path = "../../tests/wav.rs"]
+mod wav;
+
+// same defaults for the command line and for serve requests
+const DEFAULT_CHUNK_SIZE: &str = "5120";
+const DEFAULT_BITRATE: &str = "3";
+const DEFAULT_SCALE_FACTOR_BITS: &str = "4";
+const DEFAULT_SCALE_FACTOR_DISTANCE: &str = "20";
+const DEFAULT_EFFORT: &str = "0";
+
+fn parse_encoder_settings(
+    chunk_size: &str,
+    bitrate: &str,
+    scale_factor_bits: &str,
+    scale_factor_distance: &str,
+    vbr: bool,
+    effort: &str,
+    optimize_lms: bool,
+) -> Result<EncoderSettings, String> {
+    let frames_per_chunk = chunk_size
+        .parse::<u16>()
+        .map_err(|_| "Failed to parse chunk size")?;
+
+    if frames_per_chunk < 200 || frames_per_chunk > 32000 {
+        return Err("Chunk size must be between 200 and 32000".into());
+    }
+
+    let scale_factor_bits = scale_factor_bits
+        .parse::<u8>()
+        .map_err(|_| "Failed to parse scale factor bits")?;
+
+    if scale_factor_bits < 3 || scale_factor_bits > 5 {
+        return Err("Scale factor bits must be between 3 and 5".into());
+    }
+
+    let scale_factor_frames = scale_factor_distance
+        .parse::<u8>()
+        .map_err(|_| "Failed to parse scale factor frames")?;
+
+    if scale_factor_frames < 1 || frames_per_chunk % scale_factor_frames as u16 != 0 {
+        return Err("Scale factor frames must be a divisor of chunk size".into());
+    }
+
+    let residual_bits = bitrate
+        .parse::<f32>()
+        .map_err(|_| "Failed to parse residual bits")?;
+
+    if residual_bits < 1.0 || residual_bits > 8.0 {
+        return Err("Bitrate must be between 1.0 and 8.0".into());
+    }
+
+    if vbr {
+        if !(1.5..=8.0).contains(&residual_bits) {
+            return Err("With VBR, bitrate must be between 1.5 and 8.0".into());
+        }
+    } else {
+        if residual_bits.fract() != 0.0 || !(1..=8).contains(&(residual_bits as i32)) {
+            return Err("Without VBR, bitrate must be an integer between 1 and 8".into());
+        }
+    }
+
+    let effort = effort.parse::<u8>().map_err(|_| "Failed to parse effort")?;
+
+    if effort > 3 {
+        return Err("Effort must be between 0 and 3".into());
+    }
+
+    Ok(EncoderSettings {
+        scale_factor_bits,
+        scale_factor_frames,
+        residual_bits,
+        vbr,
+        frames_per_chunk,
+        effort,
+        optimize_lms,
+        ..Default::default()
+    })
+}
+
+// comma separated residual bits added per channel, e.g. 0,0,0,-2,-1,-1 for 5.1
+fn parse_channel_bit_offsets(offsets: &str) -> Result<Vec<i8>, String> {
+    offsets
+        .split(',')
+        .map(|offset| {
+            offset
+                .trim()
+                .parse::<i8>()
+                .map_err(|_| "Failed to parse channel bit offsets".into())
+        })
+        .collect()
+}
+
+fn parse_enhancement_bits(bits: &str) -> Result<u8, String> {
+    let bits = bits
+        .parse::<u8>()
+        .map_err(|_| "Failed to parse enhancement bits")?;
+
+    if bits > 8 {
+        return Err("Enhancement bits must be between 0 and 8".into());
+    }
+    Ok(bits)
+}
+
+fn get_encoder_settings(matches: &ArgMatches) -> EncoderSettings {
+    parse_encoder_settings(
+        matches.get_one::<String>("chunk-size").unwrap(),
+        matches.get_one::<String>("bitrate").unwrap(),
+        matches.get_one::<String>("scalefactor-bits").unwrap(),
+        matches.get_one::<String>("scalefactor-distance").unwrap(),
+        matches.get_flag("vbr"),
+        matches.get_one::<String>("effort").unwrap(),
+        matches.get_flag("optimize-lms"),
+    )
+    .and_then(|mut settings| {
+        if let Some(offsets) = matches.get_one::<String>("channel-bit-offsets") {
+            settings.channel_bit_offsets = parse_channel_bit_offsets(offsets)?;
+        }
+        if let Some(bits) = matches.get_one::<String>("enhancement-bits") {
+            settings.enhancement_bits = parse_enhancement_bits(bits)?;
+        }
+        Ok(settings)
+    })
+    .unwrap_or_else(|error| {
+        eprintln!("Error: {}", error);
+        std::process::exit(1);
+    })
+}
+
+fn main() {
+    let matches = Command::new("seaconv")
+        .about("Converts between .wav and .sea files")
+        .args_conflicts_with_subcommands(true)
+        .subcommand(
+            Command::new("serve")
+                .about("Runs conversion jobs sent to a Unix domain socket")
+                .arg(
+                    Arg::new("socket")
+                        .help("The path of the socket to listen on")
+                        .required(true)
+                        .index(1),
+                )
+                .arg(
+                    Arg::new("threads")
+                        .long("threads")
+                        .short('t')
+                        .help("Sets the number of worker threads [default: number of CPUs]"),
+                )
+                .arg(
+                    Arg::new("max-input")
+                        .long("max-input")
+                        .help("Sets the largest input in MiB a request may send inline")
+                        .default_value("256"),
+                ),
+        )
+        .subcommand(
+            Command::new("drop-enhancement")
+                .about("Removes the enhancement layer of a .sea file, keeping the base layer")
+                .arg(
+                    Arg::new("input")
+                        .help("The .sea file with an enhancement layer")
+                        .required(true)
+                        .index(1),
+                )
+                .arg(
+                    Arg::new("output")
+                        .help("The .sea file to save the base layer to")
+                        .required(true)
+                        .index(2),
+                ),
+        )
+        .subcommand(
+            Command::new("rechunk")
+                .about("Changes the number of frames per chunk of a .sea file without re-encoding")
+                .arg(
+                    Arg::new("input")
+                        .help("The .sea file to re-chunk")
+                        .required(true)
+                        .index(1),
+                )
+                .arg(
+                    Arg::new("output")
+                        .help("The .sea file to save the result to")
+                        .required(true)
+                        .index(2),
+                )
+                .arg(
+                    Arg::new("chunk-size")
+                        .long("chunk-size")
+                        .short('c')
+                        .required(true)
+                        .help("Sets the number of frames within a chunk, a multiple of the scale factor distance"),
+                ),
+        )
+        .subcommand(
+            Command::new("extract")
+                .about("Copies some channels of a .sea file to a new .sea file without re-encoding")
+                .arg(
+                    Arg::new("input")
+                        .help("The .sea file to take the channels from")
+                        .required(true)
+                        .index(1),
+                )
+                .arg(
+                    Arg::new("output")
+                        .help("The .sea file to save the channels to")
+                        .required(true)
+                        .index(2),
+                )
+                .arg(
+                    Arg::new("channels")
+                        .long("channels")
+                        .required(true)
+                        .help("Sets the channels to keep in their new order, comma separated and counted from 0 (e.g. 0,1)"),
+                ),
+        )
+        .arg(
+            Arg::new("input")
+                .help("The input file in LPCM LE .wav or .sea format")
+                .required(true)
+                .index(1),
+        )
+        .arg(
+            Arg::new("output")
+                .help("The output file to save the conversion result (.sea or .wav)")
+                .required(true)
+                .index(2),
+        )
+        .arg(
+            Arg::new("chunk-size")
+                .long("chunk-size")
+                .short('c')
+                .help("Sets the number of frames within a chunk")
+                .default_value(DEFAULT_CHUNK_SIZE),
+        )
+        .arg(
+            Arg::new("bitrate")
+                .long("bitrate")
+                .short('b')
+                .help("Sets the bitrate for the conversion")
+                .default_value(DEFAULT_BITRATE),
+        )
+        .arg(
+            Arg::new("scalefactor-bits")
+                .long("scalefactor-bits")
+                .short('s')
+                .help("Sets the bitrate for scale factors")
+                .default_value(DEFAULT_SCALE_FACTOR_BITS),
+        )
+        .arg(
+            Arg::new("scalefactor-distance")
+                .long("scalefactor-distance")
+                .short('d')
+                .help("Sets the distance between scale factors in frames")
+                .default_value(DEFAULT_SCALE_FACTOR_DISTANCE),
+        )
+        .arg(
+            Arg::new("vbr")
+                .long("vbr")
+                .short('v')
+                .action(ArgAction::SetTrue)
+                .help("Enables Variable Bit Rate (VBR)"),
+        )
+        .arg(
+            Arg::new("effort")
+                .long("effort")
+                .short('e')
+                .help("Sets the encoder effort from 0 to 3, higher is slower with better quality")
+                .default_value(DEFAULT_EFFORT),
+        )
+        .arg(
+            Arg::new("optimize-lms")
+                .long("optimize-lms")
+                .action(ArgAction::SetTrue)
+                .help("Searches the starting LMS weights of every chunk, slower to encode"),
+        )
+        .arg(
+            Arg::new("channel-bit-offsets")
+                .long("channel-bit-offsets")
+                .allow_negative_numbers(true)
+                .help("Adds bits to or takes bits from each channel, comma separated (e.g. 0,0,0,-2,-1,-1)"),
+        )
+        .arg(
+            Arg::new("enhancement-bits")
+                .long("enhancement-bits")
+                .help("Adds an enhancement layer with this many bits per sample above the base bitrate"),
+        )
+        .arg(
+            Arg::new("target-psnr")
+                .long("target-psnr")
+                .short('q')
+                .allow_negative_numbers(true)
+                .help("Uses the lowest bitrate at which every chunk reaches this PSNR, lower is better (e.g. -30)"),
+        )
+        .get_matches();
+
+    match matches.subcommand() {
+        Some(("serve", matches)) => {
+            serve(matches);
+            return;
+        }
+        Some(("drop-enhancement", matches)) => {
+            drop_enhancement(matches);
+            return;
+        }
+        Some(("rechunk", matches)) => {
+            rechunk(matches);
+            return;
+        }
+        Some(("extract", matches)) => {
+            extract(matches);
+            return;
+        }
+        _ => (),
+    }
+
+    let settings = get_encoder_settings(&matches);
+
+    let input = matches.get_one::<String>("input").unwrap();
+    let output = matches.get_one::<String>("output").unwrap();
+
+    let input_ext = Path::new(input).extension().and_then(|ext| ext.to_str());
+    let output_ext = Path::new(output).extension().and_then(|ext| ext.to_str());
+
+    match (input_ext, output_ext) {
+        (Some("wav"), Some("sea")) => {
+            let input_wave = read_wav(&Path::new(input)).unwrap_or_else(|_| {
+                eprintln!("Error: Failed to decode .wav file");
+                std::process::exit(1);
+            });
+
+            let mut output_file = std::fs::File::create(output).unwrap_or_else(|_| {
+                eprintln!("Error: Failed to create output file");
+                std::process::exit(1);
+            });
+
+            if let Some(target_psnr) = matches.get_one::<String>("target-psnr") {
+                let target_psnr = target_psnr.parse::<f64>().unwrap_or_else(|_| {
+                    eprintln!("Error: Failed to parse target PSNR");
+                    std::process::exit(1);
+                });
+
+                let result = sea_encode_quality(
+                    &input_wave.samples,
+                    input_wave.sample_rate,
+                    input_wave.channels,
+                    settings,
+                    QualityTarget::Psnr(target_psnr),
+                )
+                .unwrap_or_else(|_| {
+                    eprintln!("Error: Failed to encode");
+                    std::process::exit(1);
+                });
+
+                if !result.target_reached {
+                    eprintln!("Warning: No bitrate reaches the target PSNR");
+                }
+                println!("Bitrate: {}", result.settings.residual_bits);
+
+                output_file.write_all(&result.encoded).unwrap_or_else(|_| {
+                    eprintln!("Error: Failed to write output file");
+                    std::process::exit(1);
+                });
+                return;
+            }
+
+            let u8_input_samples: &[u8] = cast_slice(&input_wave.samples);
+            let mut cursor: Cursor<_> = Cursor::new(u8_input_samples);
+
+            let mut sea_encoder = SeaEncoder::new(
+                input_wave.channels as u8,
+                input_wave.sample_rate,
+                Some(input_wave.samples.len() as u32 / input_wave.channels),
+                settings,
+                &mut cursor,
+                &mut output_file,
+            )
+            .unwrap_or_else(|_| {
+                eprintln!("Error: Failed to create encoder");
+                std::process::exit(1);
+            });
+
+            while sea_encoder.encode_frame().unwrap_or_else(|_| {
+                eprintln!("Error: Failed to encode frame");
+                std::process::exit(1);
+            }) {}
+
+            sea_encoder.finalize().unwrap_or_else(|_| {
+                eprintln!("Error: Failed to finalize encoder");
+                std::process::exit(1);
+            });
+        }
+        (Some("sea"), Some("wav")) => {
+            let mut input_file = std::fs::File::open(input).unwrap_or_else(|_| {
+                eprintln!("Error: Failed to open input file");
+                std::process::exit(1);
+            });
+
+            let mut sea_decoded = Vec::<u8>::with_capacity(64 * 1024 * 1024);
+            let mut sea_decoder = SeaDecoder::new(&mut input_file, &mut sea_decoded).unwrap();
+
+            while sea_decoder.decode_frame().unwrap_or_else(|_| {
+                eprintln!("Error: Failed to decode frame");
+                std::process::exit(1);
+            }) {}
+
+            sea_decoder.finalize().unwrap_or_else(|_| {
+                eprintln!("Error: Failed to finalize decoder");
+                std::process::exit(1);
+            });
+
+            let info = sea_decoder.get_header();
+            let i16_decoded: &[i16] = cast_slice(&sea_decoded);
+
+            write_wav(i16_decoded, info.channels as u16, info.sample_rate, output).unwrap_or_else(
+                |_| {
+                    eprintln!("Error: Failed to encode wav file");
+                    std::process::exit(1);
+                },
+            );
+        }
+        _ => {
+            eprintln!("Error: Invalid file extensions. Supported conversions are .wav to .sea and .sea to .wav");
+            std::process::exit(1);
+        }
+    }
+}
+
+fn drop_enhancement(matches: &ArgMatches) {
+    let input = matches.get_one::<String>("input").unwrap();
+    let output = matches.get_one::<String>("output").unwrap();
+
+    let encoded = std::fs::read(input).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to open input file");
+        std::process::exit(1);
+    });
+    let base = sea_drop_enhancement(&encoded).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to parse .sea file");
+        std::process::exit(1);
+    });
+    std::fs::write(output, base).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to write output file");
+        std::process::exit(1);
+    });
+}
+
+fn rechunk(matches: &ArgMatches) {
+    let input = matches.get_one::<String>("input").unwrap();
+    let output = matches.get_one::<String>("output").unwrap();
+    let frames_per_chunk = matches
+        .get_one::<String>("chunk-size")
+        .unwrap()
+        .parse::<u16>()
+        .unwrap_or_else(|_| {
+            eprintln!("Error: Failed to parse chunk size");
+            std::process::exit(1);
+        });
+
+    let encoded = std::fs::read(input).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to open input file");
+        std::process::exit(1);
+    });
+    let rechunked = sea_rechunk(&encoded, frames_per_chunk).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to re-chunk, the chunk size has to be a multiple of the scale factor distance");
+        std::process::exit(1);
+    });
+    std::fs::write(output, rechunked).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to write output file");
+        std::process::exit(1);
+    });
+}
+
+fn extract(matches: &ArgMatches) {
+    let input = matches.get_one::<String>("input").unwrap();
+    let output = matches.get_one::<String>("output").unwrap();
+    let channels = matches
+        .get_one::<String>("channels")
+        .unwrap()
+        .split(',')
+        .map(|channel| channel.trim().parse::<usize>())
+        .collect::<Result<Vec<_>, _>>()
+        .unwrap_or_else(|_| {
+            eprintln!("Error: Failed to parse channels");
+            std::process::exit(1);
+        });
+
+    let encoded = std::fs::read(input).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to open input file");
+        std::process::exit(1);
+    });
+    let extracted = sea_extract_channels(&encoded, &channels).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to extract channels, every channel has to exist in the input");
+        std::process::exit(1);
+    });
+    std::fs::write(output, extracted).unwrap_or_else(|_| {
+        eprintln!("Error: Failed to write output file");
+        std::process::exit(1);
+    });
+}
+
+#[cfg(unix)]
+fn serve(matches: &ArgMatches) {
+    let socket = matches.get_one::<String>("socket").unwrap();
+    let threads = match matches.get_one::<String>("threads") {
+        Some(threads) => threads.parse::<usize>().ok().filter(|threads| *threads > 0),
+        None => std::thread::available_parallelism()
+            .ok()
+            .map(|threads| threads.get()),
+    };
+    let threads = threads.unwrap_or_else(|| {
+        eprintln!("Error: Failed to parse the number of threads");
+        std::process::exit(1);
+    });
+
+    let max_input = matches
+        .get_one::<String>("max-input")
+        .unwrap()
+        .parse::<u64>()
+        .unwrap_or_else(|_| {
+            eprintln!("Error: Failed to parse the largest inline input");
+            std::process::exit(1);
+        });
+
+    serve::run(Path::new(socket), threads, max_input * 1024 * 1024).unwrap_or_else(|error| {
+        eprintln!("Error: {}", error);
+        std::process::exit(1);
+    });
+}
+
+#[cfg(not(unix))]
+fn serve(_matches: &ArgMatches) {
+    eprintln!("Error: serve needs Unix domain sockets");
+    std::process::exit(1);
+}
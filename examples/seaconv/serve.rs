@@ -0,0 +1,591 @@
+// `seaconv serve` runs conversion jobs for other processes on the same host. The workers keep
+// their encoder and decoder between jobs, so the tables are built once per thread and not per job.
+//
+// A request is a line of space separated words, the command followed by key=value options:
+//
+//   encode input=in.wav output=out.sea [bitrate=3 vbr chunk-size=5120 effort=2 ...]
+//   decode input=in.sea output=out.wav
+//   analyze input=in.wav [bitrate=3 vbr ...]
+//   stats
+//
+// Instead of input= a request can send length=N and the N bytes of input after the line, at most
+// --max-input of the server, without output= the output is sent back inline. Inline samples are
+// interleaved i16 LE, inline encode and analyze input needs channels= and sample-rate= as well.
+//
+// The answer is a line "ok key=value ..." followed by length bytes of inline output, or a line
+// "error <message>". A connection can send any number of requests, an id= option is echoed back.
+
+use std::{
+    cell::RefCell,
+    collections::HashMap,
+    fs,
+    io::{self, BufRead, BufReader, BufWriter, Cursor, Read, Write},
+    os::unix::{
+        fs::FileTypeExt,
+        net::{UnixListener, UnixStream},
+    },
+    panic::{self, AssertUnwindSafe},
+    path::Path,
+    rc::Rc,
+    sync::{
+        atomic::{AtomicU64, AtomicUsize, Ordering},
+        mpsc, Arc, Mutex,
+    },
+    thread,
+    time::Instant,
+};
+
+use bytemuck::cast_slice;
+use sea_codec::{
+    decoder::SeaDecoder,
+    encoder::{ChannelQuality, EncoderSettings, SeaEncoder},
+};
+
+use crate::{
+    parse_channel_bit_offsets, parse_encoder_settings, parse_enhancement_bits,
+    wav::{read_wav, write_wav},
+    DEFAULT_BITRATE, DEFAULT_CHUNK_SIZE, DEFAULT_EFFORT, DEFAULT_SCALE_FACTOR_BITS,
+    DEFAULT_SCALE_FACTOR_DISTANCE,
+};
+
+const OPTIONS: [&str; 15] = [
+    "input",
+    "output",
+    "length",
+    "channels",
+    "sample-rate",
+    "chunk-size",
+    "bitrate",
+    "scalefactor-bits",
+    "scalefactor-distance",
+    "vbr",
+    "effort",
+    "optimize-lms",
+    "channel-bit-offsets",
+    "enhancement-bits",
+    "id",
+];
+
+struct Request {
+    command: String,
+    options: HashMap<String, String>,
+    inline_input: Option<Vec<u8>>,
+}
+
+#[derive(Default)]
+struct Response {
+    fields: Vec<(&'static str, String)>,
+    inline_output: Option<Vec<u8>>,
+    bytes_read: usize,
+    bytes_written: usize,
+}
+
+struct Job {
+    request: Request,
+    reply: mpsc::Sender<Result<Response, String>>,
+}
+
+#[derive(Default)]
+struct ServerStats {
+    queued: AtomicUsize,
+    running: AtomicUsize,
+    jobs: AtomicU64,
+    failed: AtomicU64,
+    bytes_in: AtomicU64,
+    bytes_out: AtomicU64,
+    busy_nanos: AtomicU64,
+}
+
+// max_input is the largest inline input in bytes a request may send
+pub fn run(socket: &Path, threads: usize, max_input: u64) -> io::Result<()> {
+    // a socket left behind by a previous run
+    if fs::symlink_metadata(socket).is_ok_and(|metadata| metadata.file_type().is_socket()) {
+        fs::remove_file(socket)?;
+    }
+    let listener = UnixListener::bind(socket)?;
+
+    let stats = Arc::new(ServerStats::default());
+    let (jobs, receiver) = mpsc::channel::<Job>();
+    let receiver = Arc::new(Mutex::new(receiver));
+    for _ in 0..threads {
+        let receiver = receiver.clone();
+        let stats = stats.clone();
+        thread::spawn(move || worker_thread(&receiver, &stats));
+    }
+
+    eprintln!(
+        "Listening on {} with {} worker threads",
+        socket.display(),
+        threads
+    );
+
+    let started = Instant::now();
+    for stream in listener.incoming() {
+        let stream = stream?;
+        let jobs = jobs.clone();
+        let stats = stats.clone();
+        thread::spawn(move || {
+            // the client went away
+            let _ = handle_connection(stream, &jobs, &stats, started, threads, max_input);
+        });
+    }
+    Ok(())
+}
+
+fn handle_connection(
+    stream: UnixStream,
+    jobs: &mpsc::Sender<Job>,
+    stats: &ServerStats,
+    started: Instant,
+    threads: usize,
+    max_input: u64,
+) -> io::Result<()> {
+    let mut reader = BufReader::new(stream.try_clone()?);
+    let mut writer = BufWriter::new(stream);
+
+    loop {
+        let mut line = String::new();
+        if reader.read_line(&mut line)? == 0 {
+            return Ok(());
+        }
+
+        let response = match read_request(&line, &mut reader, max_input)? {
+            Err(error) => Err(error),
+            Ok(request) if request.command == "stats" => Ok(server_stats(stats, started, threads)),
+            Ok(request) => {
+                let (reply, result) = mpsc::channel();
+                stats.queued.fetch_add(1, Ordering::Relaxed);
+                jobs.send(Job { request, reply }).unwrap();
+                result
+                    .recv()
+                    .unwrap_or_else(|_| Err("The job was dropped".to_string()))
+            }
+        };
+
+        match response {
+            Ok(response) => {
+                write!(writer, "ok")?;
+                for (key, value) in &response.fields {
+                    write!(writer, " {}={}", key, value)?;
+                }
+                match &response.inline_output {
+                    Some(output) => {
+                        writeln!(writer, " length={}", output.len())?;
+                        writer.write_all(output)?;
+                    }
+                    None => writeln!(writer)?,
+                }
+            }
+            Err(error) => writeln!(writer, "error {}", error)?,
+        }
+        writer.flush()?;
+    }
+}
+
+// The outer error ends the connection, the inner one is sent back. The inline input is read even
+// for an invalid request, so that the next request starts at its own line. Input over max_input is
+// skipped without being stored.
+fn read_request(
+    line: &str,
+    reader: &mut impl Read,
+    max_input: u64,
+) -> io::Result<Result<Request, String>> {
+    let mut words = line.split_whitespace();
+    let command = words.next().unwrap_or_default().to_string();
+
+    let mut options = HashMap::new();
+    for word in words {
+        // a bare word is a flag like vbr
+        let (key, value) = word.split_once('=').unwrap_or((word, "true"));
+        options.insert(key.to_string(), value.to_string());
+    }
+
+    let mut inline_input = None;
+    if let Some(length) = options.get("length") {
+        let Ok(length) = length.parse::<u32>() else {
+            return Err(io::Error::new(io::ErrorKind::InvalidData, "invalid length"));
+        };
+        if length as u64 > max_input {
+            let skipped = io::copy(&mut reader.take(length as u64), &mut io::sink())?;
+            if skipped < length as u64 {
+                return Err(io::ErrorKind::UnexpectedEof.into());
+            }
+            return Ok(Err(format!(
+                "Input of {} bytes is larger than the limit of {} bytes",
+                length, max_input
+            )));
+        }
+        let mut input = vec![0u8; length as usize];
+        reader.read_exact(&mut input)?;
+        inline_input = Some(input);
+    }
+
+    if let Some(key) = options.keys().find(|key| !OPTIONS.contains(&key.as_str())) {
+        return Ok(Err(format!("Unknown option {}", key)));
+    }
+    if !["encode", "decode", "analyze", "stats"].contains(&command.as_str()) {
+        return Ok(Err(format!("Unknown command {}", command)));
+    }
+
+    Ok(Ok(Request {
+        command,
+        options,
+        inline_input,
+    }))
+}
+
+fn server_stats(stats: &ServerStats, started: Instant, threads: usize) -> Response {
+    let uptime = started.elapsed().as_secs_f64();
+    let jobs = stats.jobs.load(Ordering::Relaxed);
+    let bytes_in = stats.bytes_in.load(Ordering::Relaxed);
+    let busy = stats.busy_nanos.load(Ordering::Relaxed) as f64 / 1e9;
+
+    Response {
+        fields: vec![
+            ("threads", threads.to_string()),
+            ("queued", stats.queued.load(Ordering::Relaxed).to_string()),
+            ("running", stats.running.load(Ordering::Relaxed).to_string()),
+            ("jobs", jobs.to_string()),
+            ("failed", stats.failed.load(Ordering::Relaxed).to_string()),
+            ("bytes-in", bytes_in.to_string()),
+            (
+                "bytes-out",
+                stats.bytes_out.load(Ordering::Relaxed).to_string(),
+            ),
+            ("uptime-s", format!("{:.1}", uptime)),
+            ("jobs-per-s", format!("{:.2}", jobs as f64 / uptime)),
+            (
+                "input-mb-per-s",
+                format!("{:.2}", bytes_in as f64 / 1e6 / uptime),
+            ),
+            // share of the worker time spent on jobs
+            (
+                "utilization",
+                format!("{:.3}", busy / (uptime * threads as f64)),
+            ),
+        ],
+        ..Default::default()
+    }
+}
+
+fn worker_thread(jobs: &Mutex<mpsc::Receiver<Job>>, stats: &ServerStats) {
+    let mut worker = Worker::default();
+
+    loop {
+        let job = jobs.lock().unwrap().recv();
+        let Ok(Job { request, reply }) = job else {
+            return;
+        };
+
+        stats.queued.fetch_sub(1, Ordering::Relaxed);
+        stats.running.fetch_add(1, Ordering::Relaxed);
+        let start = Instant::now();
+
+        let id = request.options.get("id").cloned();
+        // a panic must not take the worker down, its encoder and decoder may be left half way
+        let mut result = panic::catch_unwind(AssertUnwindSafe(|| worker.run(&request)))
+            .unwrap_or_else(|_| {
+                worker = Worker::default();
+                Err("Internal error while running the job".to_string())
+            });
+
+        let busy_nanos = start.elapsed().as_nanos() as u64;
+        stats.busy_nanos.fetch_add(busy_nanos, Ordering::Relaxed);
+        stats.running.fetch_sub(1, Ordering::Relaxed);
+        stats.jobs.fetch_add(1, Ordering::Relaxed);
+        match &mut result {
+            Ok(response) => {
+                stats
+                    .bytes_in
+                    .fetch_add(response.bytes_read as u64, Ordering::Relaxed);
+                stats
+                    .bytes_out
+                    .fetch_add(response.bytes_written as u64, Ordering::Relaxed);
+                // lets clients tag the answers, e.g. for their logs
+                if let Some(id) = id {
+                    response.fields.insert(0, ("id", id));
+                }
+            }
+            Err(_) => {
+                stats.failed.fetch_add(1, Ordering::Relaxed);
+            }
+        }
+
+        // the connection is gone
+        let _ = reply.send(result);
+    }
+}
+
+// output of the reused encoder and decoder, taken after every job
+#[derive(Clone, Default)]
+struct SharedOutput(Rc<RefCell<Vec<u8>>>);
+
+impl SharedOutput {
+    fn take(&self) -> Vec<u8> {
+        self.0.take()
+    }
+}
+
+impl Write for SharedOutput {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.0.borrow_mut().write(buf)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+struct Samples {
+    samples: Vec<i16>,
+    channels: u32,
+    sample_rate: u32,
+    bytes_read: usize,
+}
+
+struct Encoded {
+    encoded: Vec<u8>,
+    frames: usize,
+    sse: u64,
+    worst_chunk_psnr: f64,
+}
+
+#[derive(Default)]
+struct Worker {
+    output: SharedOutput,
+    encoder: Option<SeaEncoder<Cursor<Vec<u8>>, SharedOutput>>,
+    decoder: Option<SeaDecoder<Cursor<Vec<u8>>, SharedOutput>>,
+}
+
+impl Worker {
+    fn run(&mut self, request: &Request) -> Result<Response, String> {
+        match request.command.as_str() {
+            "encode" => {
+                let input = input_samples(request)?;
+                let encoded = self.encode(&input, encoder_settings(request)?)?;
+                let mut response = Response {
+                    fields: vec![("frames", encoded.frames.to_string())],
+                    bytes_read: input.bytes_read,
+                    bytes_written: encoded.encoded.len(),
+                    ..Default::default()
+                };
+                match request.options.get("output") {
+                    Some(output) => {
+                        fs::write(output, &encoded.encoded)
+                            .map_err(|error| format!("Failed to write {}: {}", output, error))?;
+                        response
+                            .fields
+                            .push(("bytes", encoded.encoded.len().to_string()));
+                    }
+                    None => response.inline_output = Some(encoded.encoded),
+                }
+                Ok(response)
+            }
+            "decode" => {
+                let input = input_bytes(request)?;
+                let bytes_read = input.len();
+                let (samples, channels, sample_rate) = self.decode(input)?;
+                let mut response = Response {
+                    fields: vec![
+                        ("channels", channels.to_string()),
+                        ("sample-rate", sample_rate.to_string()),
+                        ("frames", (samples.len() / channels as usize).to_string()),
+                    ],
+                    bytes_read,
+                    bytes_written: samples.len() * 2,
+                    ..Default::default()
+                };
+                match request.options.get("output") {
+                    Some(output) => write_wav(&samples, channels as u16, sample_rate, output)
+                        .map_err(|error| format!("Failed to write {}: {}", output, error))?,
+                    None => response.inline_output = Some(cast_slice(&samples).to_vec()),
+                }
+                Ok(response)
+            }
+            "analyze" => {
+                let input = input_samples(request)?;
+                let encoded = self.encode(&input, encoder_settings(request)?)?;
+                let samples = input.samples.len().max(1);
+                let quality = ChannelQuality::new(encoded.sse, samples);
+                Ok(Response {
+                    fields: vec![
+                        ("frames", encoded.frames.to_string()),
+                        ("bytes", encoded.encoded.len().to_string()),
+                        (
+                            "bits-per-sample",
+                            format!("{:.3}", (encoded.encoded.len() * 8) as f64 / samples as f64),
+                        ),
+                        ("psnr", format!("{:.2}", quality.psnr)),
+                        (
+                            "worst-chunk-psnr",
+                            format!("{:.2}", encoded.worst_chunk_psnr),
+                        ),
+                    ],
+                    bytes_read: input.bytes_read,
+                    ..Default::default()
+                })
+            }
+            _ => unreachable!(),
+        }
+    }
+
+    fn encode(&mut self, input: &Samples, settings: EncoderSettings) -> Result<Encoded, String> {
+        let channels = u8::try_from(input.channels)
+            .ok()
+            .filter(|channels| *channels > 0)
+            .ok_or("Invalid number of channels")?;
+        let total_frames = input.samples.len() / channels as usize;
+        let reader = Cursor::new(cast_slice(&input.samples).to_vec());
+
+        let started = match &mut self.encoder {
+            Some(encoder) => encoder.reset(
+                channels,
+                input.sample_rate,
+                Some(total_frames as u32),
+                settings,
+                reader,
+                self.output.clone(),
+            ),
+            None => SeaEncoder::new(
+                channels,
+                input.sample_rate,
+                Some(total_frames as u32),
+                settings,
+                reader,
+                self.output.clone(),
+            )
+            .map(|encoder| self.encoder = Some(encoder)),
+        };
+        started.map_err(|error| format!("Failed to create encoder: {:?}", error))?;
+        let encoder = self.encoder.as_mut().unwrap();
+
+        let mut frames = 0;
+        let mut sse = 0;
+        let mut worst_chunk_psnr = f64::NEG_INFINITY;
+        let result = loop {
+            let more = match encoder.encode_frame() {
+                Ok(more) => more,
+                Err(error) => break Err(format!("Failed to encode frame: {:?}", error)),
+            };
+            // the last call does not always encode a chunk
+            if let Some(chunk) = encoder.chunk_stats().filter(|_| frames < total_frames) {
+                frames += chunk.frames;
+                for channel in &chunk.channels {
+                    sse += channel.sse;
+                    // lower is better
+                    worst_chunk_psnr = worst_chunk_psnr.max(channel.psnr);
+                }
+            }
+            if !more {
+                break Ok(());
+            }
+        };
+
+        // taken in any case, the next job starts with an empty output
+        let encoded = self.output.take();
+        result?;
+        Ok(Encoded {
+            encoded,
+            frames,
+            sse,
+            worst_chunk_psnr,
+        })
+    }
+
+    fn decode(&mut self, encoded: Vec<u8>) -> Result<(Vec<i16>, u32, u32), String> {
+        let reader = Cursor::new(encoded);
+        let started = match &mut self.decoder {
+            Some(decoder) => decoder.reset(reader),
+            None => SeaDecoder::new(reader, self.output.clone())
+                .map(|decoder| self.decoder = Some(decoder)),
+        };
+        started.map_err(|error| format!("Invalid .sea file: {:?}", error))?;
+        let decoder = self.decoder.as_mut().unwrap();
+
+        let result = loop {
+            match decoder.decode_frame() {
+                Ok(true) => (),
+                Ok(false) => break Ok(()),
+                Err(error) => break Err(format!("Failed to decode frame: {:?}", error)),
+            }
+        };
+
+        let decoded = self.output.take();
+        result?;
+        let header = decoder.get_header();
+        Ok((
+            cast_slice(&decoded).to_vec(),
+            header.channels as u32,
+            header.sample_rate,
+        ))
+    }
+}
+
+fn option<'a>(request: &'a Request, key: &str) -> Option<&'a str> {
+    request.options.get(key).map(String::as_str)
+}
+
+fn encoder_settings(request: &Request) -> Result<EncoderSettings, String> {
+    parse_encoder_settings(
+        option(request, "chunk-size").unwrap_or(DEFAULT_CHUNK_SIZE),
+        option(request, "bitrate").unwrap_or(DEFAULT_BITRATE),
+        option(request, "scalefactor-bits").unwrap_or(DEFAULT_SCALE_FACTOR_BITS),
+        option(request, "scalefactor-distance").unwrap_or(DEFAULT_SCALE_FACTOR_DISTANCE),
+        option(request, "vbr") == Some("true"),
+        option(request, "effort").unwrap_or(DEFAULT_EFFORT),
+        option(request, "optimize-lms") == Some("true"),
+    )
+    .and_then(|mut settings| {
+        if let Some(offsets) = option(request, "channel-bit-offsets") {
+            settings.channel_bit_offsets = parse_channel_bit_offsets(offsets)?;
+        }
+        if let Some(bits) = option(request, "enhancement-bits") {
+            settings.enhancement_bits = parse_enhancement_bits(bits)?;
+        }
+        Ok(settings)
+    })
+}
+
+fn input_bytes(request: &Request) -> Result<Vec<u8>, String> {
+    if let Some(input) = &request.inline_input {
+        return Ok(input.clone());
+    }
+    let path = option(request, "input").ok_or("Missing input or length")?;
+    fs::read(path).map_err(|error| format!("Failed to read {}: {}", path, error))
+}
+
+fn input_samples(request: &Request) -> Result<Samples, String> {
+    let Some(input) = &request.inline_input else {
+        let path = option(request, "input").ok_or("Missing input or length")?;
+        let wave = read_wav(Path::new(path))
+            .map_err(|error| format!("Failed to decode {}: {}", path, error))?;
+        return Ok(Samples {
+            bytes_read: wave.samples.len() * 2,
+            samples: wave.samples,
+            channels: wave.channels,
+            sample_rate: wave.sample_rate,
+        });
+    };
+
+    let parse = |key: &str| {
+        option(request, key)
+            .and_then(|value| value.parse::<u32>().ok())
+            .filter(|value| *value > 0)
+            .ok_or(format!("Inline samples need a valid {}", key))
+    };
+    let channels = parse("channels")?;
+    let sample_rate = parse("sample-rate")?;
+    if input.len() % (2 * channels as usize) != 0 {
+        return Err("Inline samples have to be whole frames of i16 samples".into());
+    }
+
+    Ok(Samples {
+        samples: input
+            .chunks_exact(2)
+            .map(|sample| i16::from_le_bytes([sample[0], sample[1]]))
+            .collect(),
+        channels,
+        sample_rate,
+        bytes_read: input.len(),
+    })
+}
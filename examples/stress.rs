@@ -0,0 +1,363 @@
+use std::{
+    cell::{Cell, RefCell},
+    collections::VecDeque,
+    fs,
+    io::{self, Read, Write},
+    rc::Rc,
+    time::Instant,
+};
+
+use clap::{Arg, Command};
+use sea_codec::{
+    decoder::SeaDecoder,
+    encoder::{EncoderSettings, SeaEncoder},
+};
+
+const SAMPLE_RATE: u32 = 48000;
+const CHANNELS: u8 = 2;
+
+// endless deterministic test signal, generated on the fly so the input does not occupy memory
+struct SyntheticSource {
+    frames_left: u64,
+    sample_index: u64,
+    rng: u32,
+}
+
+impl SyntheticSource {
+    fn new(frames: u64) -> Self {
+        Self {
+            frames_left: frames,
+            sample_index: 0,
+            rng: 0x1234_5678,
+        }
+    }
+
+    fn next_sample(&mut self, channel: usize) -> i16 {
+        // xorshift noise on top of slowly sweeping tones
+        self.rng ^= self.rng << 13;
+        self.rng ^= self.rng >> 17;
+        self.rng ^= self.rng << 5;
+        let noise = (self.rng as i32 >> 20) as f32 / 2048.0;
+
+        let t = self.sample_index as f64 / SAMPLE_RATE as f64;
+        let sweep = 200.0 + 1800.0 * (0.5 + 0.5 * (t * 0.01).sin());
+        let tone = (t * sweep * std::f64::consts::TAU + channel as f64).sin() as f32;
+        let envelope = 0.5 + 0.5 * (t * 0.3).sin() as f32;
+
+        ((tone * envelope * 0.6 + noise * 0.05) * i16::MAX as f32) as i16
+    }
+}
+
+impl Read for SyntheticSource {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        let frame_bytes = CHANNELS as usize * 2;
+        let frames = ((buf.len() / frame_bytes) as u64).min(self.frames_left) as usize;
+
+        for frame in buf[..frames * frame_bytes].chunks_exact_mut(frame_bytes) {
+            for (channel, sample) in frame.chunks_exact_mut(2).enumerate() {
+                sample.copy_from_slice(&self.next_sample(channel).to_le_bytes());
+            }
+            self.sample_index += 1;
+        }
+
+        self.frames_left -= frames as u64;
+        Ok(frames * frame_bytes)
+    }
+}
+
+// in-memory pipe between the encoder and the decoder
+#[derive(Clone, Default)]
+struct Pipe {
+    buffer: Rc<RefCell<VecDeque<u8>>>,
+}
+
+impl Pipe {
+    fn len(&self) -> usize {
+        self.buffer.borrow().len()
+    }
+}
+
+impl Write for Pipe {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.buffer.borrow_mut().extend(buf);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl Read for Pipe {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        self.buffer.borrow_mut().read(buf)
+    }
+}
+
+#[derive(Clone, Default)]
+struct CountingSink {
+    bytes: Rc<Cell<u64>>,
+}
+
+impl CountingSink {
+    fn frames(&self) -> u64 {
+        self.bytes.get() / (CHANNELS as u64 * 2)
+    }
+}
+
+impl Write for CountingSink {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.bytes.set(self.bytes.get() + buf.len() as u64);
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+// resident set size in KiB, only available on Linux
+fn current_rss_kib() -> Option<u64> {
+    let status = fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|line| line.starts_with("VmRSS:"))?;
+    line.split_whitespace().nth(1)?.parse().ok()
+}
+
+struct Window {
+    audio_hours: f64,
+    rss_kib: Option<u64>,
+    realtime_factor: f64,
+}
+
+struct Limits {
+    max_rss_growth_kib: u64,
+    max_throughput_decline: f64,
+}
+
+fn median(values: &mut [f64]) -> f64 {
+    values.sort_unstable_by(|a, b| a.partial_cmp(b).unwrap());
+    values[values.len() / 2]
+}
+
+fn run(
+    name: &str,
+    vbr: bool,
+    streaming: bool,
+    hours: f64,
+    report_minutes: f64,
+    limits: &Limits,
+) -> bool {
+    let settings = EncoderSettings {
+        vbr,
+        residual_bits: if vbr { 3.5 } else { 3.0 },
+        ..Default::default()
+    };
+    let frames_per_chunk = settings.frames_per_chunk as u64;
+
+    // streaming files cannot end with a partial chunk
+    let mut total_frames = (hours * 3600.0 * SAMPLE_RATE as f64) as u64;
+    if streaming {
+        total_frames = total_frames.div_ceil(frames_per_chunk) * frames_per_chunk;
+    }
+    if total_frames > u32::MAX as u64 {
+        eprintln!("Error: {} hours do not fit into a SEA file", hours);
+        std::process::exit(1);
+    }
+
+    let report_frames = ((report_minutes * 60.0 * SAMPLE_RATE as f64) as u64).max(frames_per_chunk);
+
+    let mut source = SyntheticSource::new(total_frames);
+    let pipe = Pipe::default();
+    let mut encoder_pipe = pipe.clone();
+    let sink = CountingSink::default();
+
+    let mut encoder = SeaEncoder::new(
+        CHANNELS,
+        SAMPLE_RATE,
+        if streaming {
+            None
+        } else {
+            Some(total_frames as u32)
+        },
+        settings,
+        &mut source,
+        &mut encoder_pipe,
+    )
+    .unwrap();
+
+    let mut decoder: Option<SeaDecoder<Pipe, CountingSink>> = None;
+
+    let mut windows: Vec<Window> = Vec::new();
+    let mut window_start = Instant::now();
+    let mut window_first_frame = 0u64;
+
+    println!(
+        "{}: {:.2} hours of audio",
+        name,
+        total_frames as f64 / SAMPLE_RATE as f64 / 3600.0
+    );
+
+    loop {
+        let more = encoder.encode_frame().unwrap();
+
+        while pipe.len() > 0 {
+            let decoder = match decoder.as_mut() {
+                Some(decoder) => decoder,
+                None => decoder.insert(SeaDecoder::new(pipe.clone(), sink.clone()).unwrap()),
+            };
+
+            if !decoder.decode_frame().unwrap() {
+                break;
+            }
+
+            let decoded_frames = sink.frames();
+            let window_frames = decoded_frames - window_first_frame;
+
+            if window_frames >= report_frames {
+                let elapsed = window_start.elapsed().as_secs_f64();
+                let window = Window {
+                    audio_hours: decoded_frames as f64 / SAMPLE_RATE as f64 / 3600.0,
+                    rss_kib: current_rss_kib(),
+                    realtime_factor: window_frames as f64 / SAMPLE_RATE as f64 / elapsed,
+                };
+                println!(
+                    "  {:>7.2} h  rss {:>8} KiB  {:>8.1}x realtime",
+                    window.audio_hours,
+                    window
+                        .rss_kib
+                        .map_or("n/a".to_string(), |rss| rss.to_string()),
+                    window.realtime_factor
+                );
+                windows.push(window);
+                window_start = Instant::now();
+                window_first_frame = decoded_frames;
+            }
+        }
+
+        if !more {
+            break;
+        }
+    }
+
+    let decoded_frames = sink.frames();
+    if decoded_frames != total_frames {
+        eprintln!(
+            "  FAILED: decoded {} frames instead of {}",
+            decoded_frames, total_frames
+        );
+        return false;
+    }
+
+    if windows.len() < 4 {
+        println!("  not enough report windows to evaluate trends");
+        return true;
+    }
+
+    let mut passed = true;
+
+    // first window includes allocator warm-up, use the second one as baseline
+    let baseline_rss = windows[1].rss_kib;
+    let peak_rss = windows[1..].iter().filter_map(|w| w.rss_kib).max();
+    if let (Some(baseline), Some(peak)) = (baseline_rss, peak_rss) {
+        let growth = peak.saturating_sub(baseline);
+        println!("  rss growth {} KiB", growth);
+        if growth > limits.max_rss_growth_kib {
+            eprintln!(
+                "  FAILED: memory grew by {} KiB (limit {} KiB)",
+                growth, limits.max_rss_growth_kib
+            );
+            passed = false;
+        }
+    }
+
+    let quarter = windows.len() / 4;
+    let mut first: Vec<f64> = windows[1..=quarter]
+        .iter()
+        .map(|w| w.realtime_factor)
+        .collect();
+    let mut last: Vec<f64> = windows[windows.len() - quarter..]
+        .iter()
+        .map(|w| w.realtime_factor)
+        .collect();
+    let first = median(&mut first);
+    let last = median(&mut last);
+    let decline = 1.0 - last / first;
+    println!(
+        "  throughput {:.1}x -> {:.1}x realtime ({:+.1}%)",
+        first,
+        last,
+        -decline * 100.0
+    );
+    if decline > limits.max_throughput_decline {
+        eprintln!(
+            "  FAILED: throughput declined by {:.1}% (limit {:.1}%)",
+            decline * 100.0,
+            limits.max_throughput_decline * 100.0
+        );
+        passed = false;
+    }
+
+    passed
+}
+
+fn parse_arg<T: std::str::FromStr>(matches: &clap::ArgMatches, name: &str) -> T {
+    matches
+        .get_one::<String>(name)
+        .unwrap()
+        .parse::<T>()
+        .unwrap_or_else(|_| {
+            eprintln!("Error: Failed to parse {}", name);
+            std::process::exit(1);
+        })
+}
+
+fn main() {
+    let matches = Command::new("stress")
+        .about("Streams hours of synthetic audio through the encoder and decoder")
+        .arg(
+            Arg::new("hours")
+                .long("hours")
+                .help("Hours of audio to stream for each mode")
+                .default_value("8"),
+        )
+        .arg(
+            Arg::new("report-minutes")
+                .long("report-minutes")
+                .help("Minutes of audio between two measurements")
+                .default_value("10"),
+        )
+        .arg(
+            Arg::new("max-rss-growth")
+                .long("max-rss-growth")
+                .help("Allowed resident memory growth in KiB")
+                .default_value("1024"),
+        )
+        .arg(
+            Arg::new("max-throughput-decline")
+                .long("max-throughput-decline")
+                .help("Allowed throughput decline in percent")
+                .default_value("25"),
+        )
+        .get_matches();
+
+    let hours: f64 = parse_arg(&matches, "hours");
+    let report_minutes: f64 = parse_arg(&matches, "report-minutes");
+    let limits = Limits {
+        max_rss_growth_kib: parse_arg(&matches, "max-rss-growth"),
+        max_throughput_decline: parse_arg::<f64>(&matches, "max-throughput-decline") / 100.0,
+    };
+
+    let mut passed = true;
+    for (name, vbr, streaming) in [
+        ("cbr streaming", false, true),
+        ("cbr fixed length", false, false),
+        ("vbr streaming", true, true),
+        ("vbr fixed length", true, false),
+    ] {
+        passed &= run(name, vbr, streaming, hours, report_minutes, &limits);
+    }
+
+    if !passed {
+        std::process::exit(1);
+    }
+}
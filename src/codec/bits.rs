@@ -1,5 +1,14 @@
-use std::mem;
+use alloc::vec::Vec;
+use core::mem;
 
+#[cfg(all(
+    target_arch = "wasm32",
+    target_feature = "simd128",
+    feature = "decoder"
+))]
+use core::arch::wasm32::*;
+
+#[cfg(feature = "decoder")]
 pub struct BitUnpacker {
     bits_stored: u32,
     carry: u32,
@@ -8,30 +17,40 @@ pub struct BitUnpacker {
     output: Vec<u8>,
 }
 
+#[cfg(feature = "decoder")]
 impl BitUnpacker {
-    pub fn new_const_bits(bitlength: u8) -> Self {
+    pub fn new() -> Self {
         Self {
             bits_stored: 0,
             carry: 0,
-            bitlengths: vec![bitlength; 1],
+            bitlengths: Vec::new(),
             bitlengths_index: 0,
             output: Vec::new(),
         }
     }
 
-    pub fn new_var_bits(bitlengths: &[u8]) -> Self {
-        Self {
-            bits_stored: 0,
-            carry: 0,
-            bitlengths: bitlengths.to_vec(),
-            bitlengths_index: 0,
-            output: Vec::new(),
-        }
+    // resets use the buffers of the previous run, so nothing is allocated once they are large enough
+    pub fn reset_const_bits(&mut self, bitlength: u8) {
+        self.clear_state();
+        self.bitlengths.push(bitlength);
+    }
+
+    pub fn reset_var_bits(&mut self, bitlengths: impl Iterator<Item = u8>) {
+        self.clear_state();
+        self.bitlengths.extend(bitlengths);
+    }
+
+    pub fn reserve(&mut self, items: usize) {
+        self.bitlengths.reserve(items);
+        self.output.reserve(items);
     }
 
     const MASKS: [u32; 9] = [0, 1, 3, 7, 15, 31, 63, 127, 255];
 
     fn process_bytes_const(&mut self, input: &[u8]) {
+        #[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+        let input = &input[self.process_groups_simd128(input)..];
+
         let bits = self.bitlengths[0] as u32;
         let mask = BitUnpacker::MASKS[bits as usize];
 
@@ -49,6 +68,45 @@ impl BitUnpacker {
         }
     }
 
+    // Unpacks whole groups of `bits` bytes, each holding exactly 8 items, so no carry is left between them.
+    // Every item spans at most two bytes: they are gathered into 16 bit lanes big endian, shifted to the
+    // top of the lane by a per-lane multiplication and then shifted down to the item size.
+    // Returns the number of bytes consumed, the rest is handled by the scalar loop.
+    #[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+    fn process_groups_simd128(&mut self, input: &[u8]) -> usize {
+        if self.bits_stored != 0 {
+            return 0;
+        }
+
+        let bits = self.bitlengths[0] as usize;
+
+        let mut gather = [0u8; 16];
+        let mut multipliers = [0u16; 8];
+        for item in 0..8 {
+            let bit_offset = item * bits;
+            gather[item * 2] = (bit_offset / 8 + 1) as u8;
+            gather[item * 2 + 1] = (bit_offset / 8) as u8;
+            multipliers[item] = 1 << (bit_offset % 8);
+        }
+        let gather = unsafe { v128_load(gather.as_ptr() as *const v128) };
+        let multipliers = unsafe { v128_load(multipliers.as_ptr() as *const v128) };
+
+        let mut offset = 0;
+        // a group is at most 8 bytes, but every load reads 16
+        while offset + 16 <= input.len() {
+            let bytes = unsafe { v128_load(input.as_ptr().add(offset) as *const v128) };
+            let words = i8x16_swizzle(bytes, gather);
+            let items = u16x8_shr(i16x8_mul(words, multipliers), 16 - bits as u32);
+            let items = u8x16_narrow_i16x8(items, items);
+
+            self.output
+                .extend_from_slice(&i64x2_extract_lane::<0>(items).to_le_bytes());
+            offset += bits;
+        }
+
+        offset
+    }
+
     fn process_bytes_variable(&mut self, input: &[u8]) {
         for input_byte in input {
             let value: u32 = (self.carry << 8) | (*input_byte as u32);
@@ -77,21 +135,59 @@ impl BitUnpacker {
         self.process_bytes_variable(input);
     }
 
-    pub fn finish(&mut self) -> Vec<u8> {
+    fn clear_state(&mut self) {
         self.bitlengths.clear();
         self.bitlengths_index = 0;
         self.carry = 0;
         self.bits_stored = 0;
-        mem::take(&mut self.output)
+    }
+
+    // swaps the unpacked items into output, its previous buffer is kept for the next run
+    pub fn finish_into(&mut self, output: &mut Vec<u8>) {
+        self.clear_state();
+        mem::swap(&mut self.output, output);
+        self.output.clear();
+    }
+}
+
+// MSB first reader straight from the packed bytes, bits past the end read as zero
+#[cfg(feature = "decoder")]
+pub struct SliceBitReader<'a> {
+    input: &'a [u8],
+    bit_position: usize,
+}
+
+#[cfg(feature = "decoder")]
+impl<'a> SliceBitReader<'a> {
+    pub fn new(input: &'a [u8]) -> Self {
+        Self {
+            input,
+            bit_position: 0,
+        }
+    }
+
+    // bits has to be 1-8, so an item spans at most two bytes
+    #[inline(always)]
+    pub fn read(&mut self, bits: u8) -> u8 {
+        let byte = self.bit_position / 8;
+        let high = self.input.get(byte).copied().unwrap_or(0) as u32;
+        let low = self.input.get(byte + 1).copied().unwrap_or(0) as u32;
+        let shift = 16 - (self.bit_position % 8) as u32 - bits as u32;
+        self.bit_position += bits as usize;
+
+        let item = (((high << 8) | low) >> shift) & BitUnpacker::MASKS[bits as usize];
+        item as u8
     }
 }
 
+#[cfg(feature = "encoder")]
 pub struct BitPacker {
     accum: u32,
     bits_stored: u32,
     output: Vec<u8>,
 }
 
+#[cfg(feature = "encoder")]
 impl BitPacker {
     pub fn new() -> Self {
         Self {
@@ -1,21 +1,31 @@
-use crate::{
-    codec::{bits::BitUnpacker, lms::LMS_LEN},
-    encoder::EncoderSettings,
-};
-
-use super::{
-    bits::BitPacker,
-    common::{SeaError, SeaResidualSize},
-    file::SeaFileHeader,
-    lms::SeaLMS,
-};
+use alloc::vec::Vec;
+#[cfg(feature = "encoder")]
+use alloc::{borrow::ToOwned, vec};
+
+#[cfg(feature = "encoder")]
+use crate::{codec::bits::BitPacker, encoder::EncoderSettings};
+
+#[cfg(feature = "decoder")]
+use super::{bits::BitUnpacker, common::SeaError, lms::LMS_LEN};
+
+use super::{common::SeaResidualSize, file::SeaFileHeader, lms::SeaLMS};
+
+#[cfg(feature = "encoder")]
+use super::math;
 
 #[derive(Debug, Clone, Copy)]
 pub enum SeaChunkType {
     Cbr = 0x01,
+    #[cfg_attr(not(any(feature = "encoder", feature = "vbr")), allow(dead_code))]
     Vbr = 0x02,
 }
 
+// Set in the type byte of chunks with an enhancement layer. The base layer is a complete CBR or VBR
+// chunk, the enhancement layer follows it: its residual size in a byte, then scale factors and
+// residuals packed like the ones of a CBR chunk. Clearing the flag and cutting the chunk after the
+// base layer leaves a valid chunk of the base layer alone.
+pub const LAYERED_CHUNK: u8 = 0x10;
+
 #[derive(Debug)]
 pub struct SeaChunk {
     pub channels: usize,
@@ -32,8 +42,16 @@ pub struct SeaChunk {
     pub scale_factors: Vec<u8>,
     pub vbr_residual_sizes: Vec<u8>,
     pub residuals: Vec<u8>,
+
+    pub enhancement_size: u8, // 0 without an enhancement layer
+    pub enhancement_scale_factors: Vec<u8>,
+    pub enhancement_residuals: Vec<u8>,
+
+    #[cfg_attr(not(feature = "decoder"), allow(dead_code))]
+    pub base_len: usize, // bytes of the chunk up to the enhancement layer, set by parse_into
 }
 
+#[cfg(feature = "encoder")]
 impl SeaChunk {
     pub fn new(
         file_header: &SeaFileHeader,
@@ -50,6 +68,18 @@ impl SeaChunk {
             SeaChunkType::Cbr
         };
 
+        // VBR sizes are stored relative to the base, from one below it to two above it. Channel bit
+        // offsets can move the sizes out of that range, then the base follows the smallest size.
+        let mut residual_size = math::floorf(encoder_settings.residual_bits) as u8;
+        if let (Some(smallest), Some(largest)) = (
+            vbr_residual_sizes.iter().min(),
+            vbr_residual_sizes.iter().max(),
+        ) {
+            if *smallest + 1 < residual_size || *largest > residual_size + 2 {
+                residual_size = (*smallest + 1).min(8);
+            }
+        }
+
         SeaChunk {
             channels: file_header.channels as usize,
             frames_per_chunk: file_header.frames_per_chunk as usize,
@@ -57,159 +87,34 @@ impl SeaChunk {
             chunk_type,
             scale_factor_bits: encoder_settings.scale_factor_bits,
             scale_factor_frames: encoder_settings.scale_factor_frames,
-            residual_size: SeaResidualSize::from(encoder_settings.residual_bits.floor() as u8),
+            residual_size: SeaResidualSize::from(residual_size),
 
             lms: lms.to_owned(),
             scale_factors,
             vbr_residual_sizes,
             residuals,
-        }
-    }
 
-    pub fn from_slice(
-        encoded: &[u8],
-        file_header: &SeaFileHeader,
-        remaining_frames: Option<usize>,
-    ) -> Result<Self, SeaError> {
-        assert!(encoded.len() <= file_header.chunk_size as usize);
+            enhancement_size: 0,
+            enhancement_scale_factors: Vec::new(),
+            enhancement_residuals: Vec::new(),
 
-        // we cannot calculate last frame size in streaming mode
-        if remaining_frames.is_none() && encoded.len() < file_header.chunk_size as usize {
-            return Err(SeaError::InvalidFrame);
+            base_len: 0,
         }
+    }
 
-        let chunk_type: SeaChunkType = match encoded[0] {
-            0x01 => SeaChunkType::Cbr,
-            0x02 => SeaChunkType::Vbr,
-            _ => return Err(SeaError::InvalidFrame),
-        };
-
-        let scale_factor_bits = encoded[1] >> 4;
-
-        let residual_size = SeaResidualSize::from(encoded[1] & 0b1111);
-        let scale_factor_frames = encoded[2];
-        let _reserved = encoded[3];
-
-        let mut encoded_index = 4;
-
-        let mut lms: Vec<SeaLMS> = vec![];
-        for _ in 0..file_header.channels as usize {
-            lms.push(SeaLMS::from_bytes(
-                &encoded[encoded_index..encoded_index + LMS_LEN * 4]
-                    .try_into()
-                    .unwrap(),
-            ));
-            encoded_index += LMS_LEN * 4;
+    // empty scale factors and residuals leave the chunk without an enhancement layer
+    pub fn with_enhancement(
+        mut self,
+        encoder_settings: &EncoderSettings,
+        scale_factors: Vec<u8>,
+        residuals: Vec<u8>,
+    ) -> SeaChunk {
+        if !residuals.is_empty() {
+            self.enhancement_size = encoder_settings.enhancement_bits;
         }
-
-        let frames_in_this_chunk =
-            (file_header.frames_per_chunk as usize).min(remaining_frames.unwrap_or(usize::MAX));
-
-        let scale_factor_items = frames_in_this_chunk.div_ceil(scale_factor_frames as usize)
-            * file_header.channels as usize;
-
-        let scale_factors = {
-            let packed_scale_factor_bytes =
-                (scale_factor_items * scale_factor_bits as usize).div_ceil(8);
-
-            let packed_scale_factors =
-                &encoded[encoded_index..encoded_index + packed_scale_factor_bytes];
-            encoded_index += packed_scale_factor_bytes;
-
-            let mut unpacker = BitUnpacker::new_const_bits(scale_factor_bits);
-            unpacker.process_bytes(packed_scale_factors);
-            let mut res = unpacker.finish();
-            res.resize(scale_factor_items, 0);
-            res
-        };
-
-        let vbr_residual_sizes: Vec<u8> = if matches!(chunk_type, SeaChunkType::Vbr) {
-            let packed_vbr_residual_sizes_bytes = (scale_factor_items * 2).div_ceil(8);
-            let packed_vbr_residual_sizes =
-                &encoded[encoded_index..encoded_index + packed_vbr_residual_sizes_bytes];
-            encoded_index += packed_vbr_residual_sizes_bytes;
-
-            let mut unpacker: BitUnpacker = BitUnpacker::new_const_bits(2);
-            unpacker.process_bytes(packed_vbr_residual_sizes);
-            let mut res = unpacker.finish();
-            res.resize(scale_factor_items, 0);
-            for item in &mut res {
-                *item += residual_size as u8 - 1;
-            }
-            res
-        } else {
-            Vec::new()
-        };
-
-        let residuals: Vec<u8> = {
-            let mut unpacker = if matches!(chunk_type, SeaChunkType::Vbr) {
-                let mut bitlengths = Vec::new();
-                for vbr_chunk in vbr_residual_sizes.chunks_exact(file_header.channels as usize) {
-                    for _ in 0..scale_factor_frames {
-                        for item in vbr_chunk.iter().take(file_header.channels as usize) {
-                            bitlengths.push(*item);
-                        }
-                    }
-                }
-
-                BitUnpacker::new_var_bits(&bitlengths)
-            } else {
-                BitUnpacker::new_const_bits(residual_size as u8)
-            };
-
-            let packed_residuals_bytes = if matches!(chunk_type, SeaChunkType::Vbr) {
-                let mut residual_bits: u32 = vbr_residual_sizes
-                    [..vbr_residual_sizes.len() - file_header.channels as usize]
-                    .iter()
-                    .map(|x| *x as u32)
-                    .sum();
-
-                residual_bits *= scale_factor_frames as u32;
-
-                let last_frame_samples = frames_in_this_chunk as u32 % scale_factor_frames as u32;
-                let multiplier = if last_frame_samples == 0 {
-                    scale_factor_frames as u32
-                } else {
-                    last_frame_samples
-                };
-
-                for size in vbr_residual_sizes
-                    [(vbr_residual_sizes.len() - file_header.channels as usize)..]
-                    .iter()
-                {
-                    residual_bits += *size as u32 * multiplier;
-                }
-
-                let residual_bytes = residual_bits.div_ceil(8);
-                residual_bytes as usize
-            } else {
-                (frames_in_this_chunk * residual_size as usize * file_header.channels as usize)
-                    .div_ceil(8)
-            };
-
-            let packed_residuals = &encoded[encoded_index..encoded_index + packed_residuals_bytes];
-
-            unpacker.process_bytes(packed_residuals);
-
-            let mut res = unpacker.finish();
-            res.resize(frames_in_this_chunk * file_header.channels as usize, 0);
-            res
-        };
-
-        Ok(Self {
-            channels: file_header.channels as usize,
-            frames_per_chunk: file_header.frames_per_chunk as usize,
-
-            chunk_type,
-            scale_factor_bits,
-            scale_factor_frames,
-            residual_size,
-
-            lms,
-            scale_factors,
-            vbr_residual_sizes,
-            residuals,
-        })
+        self.enhancement_scale_factors = scale_factors;
+        self.enhancement_residuals = residuals;
+        self
     }
 
     fn serialize_header(&self) -> [u8; 4] {
@@ -217,8 +122,14 @@ impl SeaChunk {
         assert!(self.scale_factor_frames > 0);
         assert_eq!(self.frames_per_chunk % self.scale_factor_frames as usize, 0);
 
+        let layered = if self.enhancement_size > 0 {
+            LAYERED_CHUNK
+        } else {
+            0
+        };
+
         [
-            self.chunk_type as u8,
+            self.chunk_type as u8 | layered,
             (self.scale_factor_bits << 4) | self.residual_size as u8,
             self.scale_factor_frames,
             0x5A,
@@ -277,6 +188,22 @@ impl SeaChunk {
         packer.finish()
     }
 
+    fn serialize_enhancement(&self) -> Vec<u8> {
+        let mut packer = BitPacker::new();
+        for scale_factor in self.enhancement_scale_factors.iter() {
+            packer.push(*scale_factor as u32, self.scale_factor_bits);
+        }
+        let mut output = vec![self.enhancement_size];
+        output.extend_from_slice(&packer.finish());
+
+        let mut packer = BitPacker::new();
+        for residual in self.enhancement_residuals.iter() {
+            packer.push(*residual as u32, self.enhancement_size);
+        }
+        output.extend_from_slice(&packer.finish());
+        output
+    }
+
     pub fn serialize(&self) -> Vec<u8> {
         let mut output = Vec::new();
 
@@ -287,7 +214,236 @@ impl SeaChunk {
             output.extend_from_slice(&self.serialize_vbr_residual_sizes());
         }
         output.extend_from_slice(&self.serialize_residuals());
+        if self.enhancement_size > 0 {
+            output.extend_from_slice(&self.serialize_enhancement());
+        }
 
         output
     }
 }
+
+#[cfg(feature = "decoder")]
+impl SeaChunk {
+    // empty chunk with buffers large enough for any chunk of the file, see parse_into
+    pub fn with_capacity(file_header: &SeaFileHeader) -> SeaChunk {
+        // a byte unpacks to at most 8 items, the buffers are swapped with the unpacker so all of them get the same size
+        Self::empty(file_header, file_header.chunk_size as usize * 8)
+    }
+
+    fn empty(file_header: &SeaFileHeader, items: usize) -> SeaChunk {
+        SeaChunk {
+            channels: file_header.channels as usize,
+            frames_per_chunk: file_header.frames_per_chunk as usize,
+
+            chunk_type: SeaChunkType::Cbr,
+            scale_factor_bits: 0,
+            scale_factor_frames: 0,
+            residual_size: SeaResidualSize::from(1),
+
+            lms: Vec::with_capacity(file_header.channels as usize),
+            scale_factors: Vec::with_capacity(items),
+            vbr_residual_sizes: Vec::with_capacity(items),
+            residuals: Vec::with_capacity(items),
+
+            enhancement_size: 0,
+            enhancement_scale_factors: Vec::with_capacity(items),
+            enhancement_residuals: Vec::with_capacity(items),
+
+            base_len: 0,
+        }
+    }
+
+    pub fn from_slice(
+        encoded: &[u8],
+        file_header: &SeaFileHeader,
+        remaining_frames: Option<usize>,
+    ) -> Result<Self, SeaError> {
+        let mut chunk = Self::empty(file_header, 0);
+        let mut unpacker = BitUnpacker::new();
+        chunk.parse_into(encoded, file_header, remaining_frames, &mut unpacker)?;
+        Ok(chunk)
+    }
+
+    // Parses the chunk reusing the buffers of this chunk and of the unpacker,
+    // it does not allocate if they were created by with_capacity and BitUnpacker::reserve.
+    pub fn parse_into(
+        &mut self,
+        encoded: &[u8],
+        file_header: &SeaFileHeader,
+        remaining_frames: Option<usize>,
+        unpacker: &mut BitUnpacker,
+    ) -> Result<(), SeaError> {
+        assert!(encoded.len() <= file_header.chunk_size as usize);
+
+        // we cannot calculate last frame size in streaming mode
+        if remaining_frames.is_none() && encoded.len() < file_header.chunk_size as usize {
+            return Err(SeaError::InvalidFrame);
+        }
+
+        let channels = file_header.channels as usize;
+        // a truncated chunk, e.g. from a stream that ended early, fails in the first section it cuts
+        let mut encoded_index = 4 + channels * LMS_LEN * 4;
+        if encoded.len() < encoded_index {
+            return Err(SeaError::InvalidFrame);
+        }
+
+        let layered = encoded[0] & LAYERED_CHUNK != 0;
+        let chunk_type: SeaChunkType = match encoded[0] & !LAYERED_CHUNK {
+            0x01 => SeaChunkType::Cbr,
+            #[cfg(feature = "vbr")]
+            0x02 => SeaChunkType::Vbr,
+            _ => return Err(SeaError::InvalidFrame),
+        };
+
+        let scale_factor_bits = encoded[1] >> 4;
+        let scale_factor_frames = encoded[2];
+        let _reserved = encoded[3];
+        if !(1..=8).contains(&scale_factor_bits)
+            || !(1..=8).contains(&(encoded[1] & 0b1111))
+            || scale_factor_frames == 0
+        {
+            return Err(SeaError::InvalidFrame);
+        }
+        let residual_size = SeaResidualSize::from(encoded[1] & 0b1111);
+
+        self.lms.clear();
+        for lms in encoded[4..encoded_index].chunks_exact(LMS_LEN * 4) {
+            self.lms.push(SeaLMS::from_bytes(lms.try_into().unwrap()));
+        }
+
+        let frames_in_this_chunk =
+            (file_header.frames_per_chunk as usize).min(remaining_frames.unwrap_or(usize::MAX));
+
+        let scale_factor_items =
+            frames_in_this_chunk.div_ceil(scale_factor_frames as usize) * channels;
+
+        {
+            let packed_scale_factor_bytes =
+                (scale_factor_items * scale_factor_bits as usize).div_ceil(8);
+
+            let packed_scale_factors =
+                section(encoded, &mut encoded_index, packed_scale_factor_bytes)?;
+
+            unpacker.reset_const_bits(scale_factor_bits);
+            unpacker.process_bytes(packed_scale_factors);
+            unpacker.finish_into(&mut self.scale_factors);
+            self.scale_factors.resize(scale_factor_items, 0);
+        }
+
+        self.vbr_residual_sizes.clear();
+        if matches!(chunk_type, SeaChunkType::Vbr) {
+            let packed_vbr_residual_sizes_bytes = (scale_factor_items * 2).div_ceil(8);
+            let packed_vbr_residual_sizes =
+                section(encoded, &mut encoded_index, packed_vbr_residual_sizes_bytes)?;
+
+            unpacker.reset_const_bits(2);
+            unpacker.process_bytes(packed_vbr_residual_sizes);
+            unpacker.finish_into(&mut self.vbr_residual_sizes);
+            self.vbr_residual_sizes.resize(scale_factor_items, 0);
+            for item in &mut self.vbr_residual_sizes {
+                *item += residual_size as u8 - 1;
+                if *item == 0 || *item > 8 {
+                    return Err(SeaError::InvalidFrame);
+                }
+            }
+        }
+
+        {
+            if matches!(chunk_type, SeaChunkType::Vbr) {
+                let bitlengths =
+                    self.vbr_residual_sizes
+                        .chunks_exact(channels)
+                        .flat_map(|vbr_chunk| {
+                            (0..scale_factor_frames).flat_map(move |_| vbr_chunk.iter().copied())
+                        });
+
+                unpacker.reset_var_bits(bitlengths);
+            } else {
+                unpacker.reset_const_bits(residual_size as u8);
+            }
+
+            let packed_residuals_bytes = if matches!(chunk_type, SeaChunkType::Vbr) {
+                let vbr_residual_sizes = &self.vbr_residual_sizes;
+                let mut residual_bits: u32 = vbr_residual_sizes
+                    [..vbr_residual_sizes.len() - channels]
+                    .iter()
+                    .map(|x| *x as u32)
+                    .sum();
+
+                residual_bits *= scale_factor_frames as u32;
+
+                let last_frame_samples = frames_in_this_chunk as u32 % scale_factor_frames as u32;
+                let multiplier = if last_frame_samples == 0 {
+                    scale_factor_frames as u32
+                } else {
+                    last_frame_samples
+                };
+
+                for size in vbr_residual_sizes[(vbr_residual_sizes.len() - channels)..].iter() {
+                    residual_bits += *size as u32 * multiplier;
+                }
+
+                let residual_bytes = residual_bits.div_ceil(8);
+                residual_bytes as usize
+            } else {
+                (frames_in_this_chunk * residual_size as usize * channels).div_ceil(8)
+            };
+
+            let packed_residuals = section(encoded, &mut encoded_index, packed_residuals_bytes)?;
+
+            unpacker.process_bytes(packed_residuals);
+            unpacker.finish_into(&mut self.residuals);
+            self.residuals.resize(frames_in_this_chunk * channels, 0);
+        }
+        self.base_len = encoded_index;
+
+        self.enhancement_size = 0;
+        self.enhancement_scale_factors.clear();
+        self.enhancement_residuals.clear();
+        if layered {
+            let enhancement_size = *encoded.get(encoded_index).ok_or(SeaError::InvalidFrame)?;
+            if !(1..=8).contains(&enhancement_size) {
+                return Err(SeaError::InvalidFrame);
+            }
+            encoded_index += 1;
+
+            let sections = [
+                (scale_factor_items, scale_factor_bits),
+                (frames_in_this_chunk * channels, enhancement_size),
+            ];
+            let outputs = [
+                &mut self.enhancement_scale_factors,
+                &mut self.enhancement_residuals,
+            ];
+            for ((items, bits), output) in sections.into_iter().zip(outputs) {
+                let packed_bytes = (items * bits as usize).div_ceil(8);
+                let packed = section(encoded, &mut encoded_index, packed_bytes)?;
+
+                unpacker.reset_const_bits(bits);
+                unpacker.process_bytes(packed);
+                unpacker.finish_into(output);
+                output.resize(items, 0);
+            }
+            self.enhancement_size = enhancement_size;
+        }
+
+        self.channels = channels;
+        self.frames_per_chunk = file_header.frames_per_chunk as usize;
+        self.chunk_type = chunk_type;
+        self.scale_factor_bits = scale_factor_bits;
+        self.scale_factor_frames = scale_factor_frames;
+        self.residual_size = residual_size;
+
+        Ok(())
+    }
+}
+
+// the next length bytes of the chunk, a chunk that ends before them is invalid
+#[cfg(feature = "decoder")]
+fn section<'a>(encoded: &'a [u8], offset: &mut usize, length: usize) -> Result<&'a [u8], SeaError> {
+    let bytes = encoded
+        .get(*offset..*offset + length)
+        .ok_or(SeaError::InvalidFrame)?;
+    *offset += length;
+    Ok(bytes)
+}
@@ -1,5 +1,12 @@
+#[cfg(feature = "std")]
 use std::io;
 
+#[cfg(feature = "encoder")]
+use alloc::vec::Vec;
+
+#[cfg(feature = "encoder")]
+use super::lms::SeaLMS;
+
 pub const SEAC_MAGIC: u32 = u32::from_be_bytes(*b"seac"); // 0x73 0x65 0x61 0x63
 
 #[inline(always)]
@@ -35,6 +42,7 @@ impl SeaResidualSize {
         }
     }
 
+    #[cfg(feature = "encoder")]
     #[inline(always)]
     pub fn to_binary_combinations(self) -> usize {
         match self {
@@ -60,46 +68,19 @@ pub enum SeaError {
     UnsupportedVersion,
     TooManyFrames,
     MetadataTooLarge,
+    OutputTooSmall,
+    #[cfg(feature = "std")]
     IoError(io::Error),
 }
 
+#[cfg(feature = "std")]
 impl From<io::Error> for SeaError {
     fn from(error: io::Error) -> Self {
         SeaError::IoError(error)
     }
 }
 
-#[inline(always)]
-pub fn read_bytes<R: io::Read, const BYTES: usize>(mut reader: R) -> io::Result<[u8; BYTES]> {
-    let mut buf = [0_u8; BYTES];
-    reader.read_exact(&mut buf)?;
-    Ok(buf)
-}
-
-#[inline(always)]
-pub fn read_u8<R: io::Read>(reader: R) -> io::Result<u8> {
-    let data: [u8; 1] = read_bytes(reader)?;
-    Ok(data[0])
-}
-
-#[inline(always)]
-pub fn read_u16_le<R: io::Read>(reader: R) -> io::Result<u16> {
-    let data = read_bytes(reader)?;
-    Ok(u16::from_le_bytes(data))
-}
-
-#[inline(always)]
-pub fn read_u32_be<R: io::Read>(reader: R) -> io::Result<u32> {
-    let data = read_bytes(reader)?;
-    Ok(u32::from_be_bytes(data))
-}
-
-#[inline(always)]
-pub fn read_u32_le<R: io::Read>(reader: R) -> io::Result<u32> {
-    let data = read_bytes(reader)?;
-    Ok(u32::from_le_bytes(data))
-}
-
+#[cfg(feature = "std")]
 pub fn read_max_or_zero<R: io::Read>(mut reader: R, at_least_bytes: usize) -> io::Result<Vec<u8>> {
     let mut buffer = vec![0u8; at_least_bytes];
     let mut total_bytes_read = 0;
@@ -122,13 +103,20 @@ pub fn read_max_or_zero<R: io::Read>(mut reader: R, at_least_bytes: usize) -> io
     Ok(buffer[..total_bytes_read].to_vec())
 }
 
+#[cfg(feature = "encoder")]
 #[derive(Debug)]
 pub struct EncodedSamples {
+    pub initial_lms: Vec<SeaLMS>, // stored in the chunk header
     pub scale_factors: Vec<u8>,
     pub residuals: Vec<u8>,
     pub residual_bits: Vec<u8>,
+    pub sse: Vec<u64>, // squared reconstruction error per channel
+    // empty without an enhancement layer
+    pub enhancement_scale_factors: Vec<u8>,
+    pub enhancement_residuals: Vec<u8>,
 }
 
+#[cfg(feature = "encoder")]
 pub trait SeaEncoderTrait {
     fn encode(&mut self, input_slice: &[i16]) -> EncodedSamples;
 }
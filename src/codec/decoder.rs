@@ -1,4 +1,11 @@
-use super::{chunk::SeaChunk, common::clamp_i16, dqt::SeaDequantTab};
+use crate::sample::{FrameGain, SeaGain, SeaSample, Unity};
+
+use super::{
+    chunk::{SeaChunk, SeaChunkType},
+    common::clamp_i16,
+    dqt::SeaDequantTab,
+    lms::SeaLMS,
+};
 
 pub struct Decoder {
     channels: usize,
@@ -17,71 +24,145 @@ impl Decoder {
         }
     }
 
-    pub fn decode_cbr(&self, chunk: &SeaChunk) -> Vec<i16> {
-        assert_eq!(chunk.scale_factor_bits as usize, self.scale_factor_bits);
+    // the dequantization tables are only regenerated if the scale factor bits change
+    pub fn reset(&mut self, channels: usize, scale_factor_bits: usize) {
+        self.channels = channels;
+        self.scale_factor_bits = scale_factor_bits;
+        self.dequant_tab.set_scalefactor_bits(scale_factor_bits);
+    }
 
-        let mut output: Vec<i16> = Vec::with_capacity(chunk.frames_per_chunk * self.channels);
+    pub fn scale_factor_bits(&self) -> usize {
+        self.scale_factor_bits
+    }
 
+    // output has to hold at least chunk.residuals.len() samples
+    pub fn decode<S: SeaSample>(
+        &self,
+        chunk: &SeaChunk,
+        output: &mut [S],
+        gain: Option<&mut SeaGain>,
+    ) {
         let mut lms = chunk.lms.clone();
+        let output = &mut output[..chunk.residuals.len()];
+        self.decode_frames(chunk, &mut lms, 0, output, gain);
+    }
 
-        let dqts: &Vec<Vec<i32>> = self.dequant_tab.get_dqt(chunk.residual_size as usize);
-
-        for (scale_factor_index, subchunk_residuals) in chunk
-            .residuals
-            .chunks(self.channels * chunk.scale_factor_frames as usize)
-            .enumerate()
-        {
-            let scale_factors = &chunk.scale_factors[scale_factor_index * self.channels..];
-
-            for channel_residuals in subchunk_residuals.chunks(self.channels) {
-                for (channel_index, residual) in channel_residuals.iter().enumerate() {
-                    let scale_factor = scale_factors[channel_index];
-                    let predicted = lms[channel_index].predict();
-                    let quantized: usize = *residual as usize;
-                    let dequantized = dqts[scale_factor as usize][quantized];
-                    let reconstructed = clamp_i16(predicted + dequantized);
-                    output.push(reconstructed);
-                    lms[channel_index].update(reconstructed, dequantized);
-                }
-            }
+    // Decodes output.len() / channels frames of the chunk starting at start_frame.
+    // lms has to hold the state after the previous frame, it is updated so decoding can continue with the next frame.
+    // The gain advances by the decoded frames.
+    pub fn decode_frames<S: SeaSample>(
+        &self,
+        chunk: &SeaChunk,
+        lms: &mut [SeaLMS],
+        start_frame: usize,
+        output: &mut [S],
+        gain: Option<&mut SeaGain>,
+    ) {
+        match gain {
+            Some(gain) => self.decode_frames_with_gain(chunk, lms, start_frame, output, gain),
+            None => self.decode_frames_with_gain(chunk, lms, start_frame, output, &mut Unity),
         }
-
-        output
     }
 
-    pub fn decode_vbr(&self, chunk: &SeaChunk) -> Vec<i16> {
+    fn decode_frames_with_gain<S: SeaSample, G: FrameGain>(
+        &self,
+        chunk: &SeaChunk,
+        lms: &mut [SeaLMS],
+        start_frame: usize,
+        output: &mut [S],
+        gain: &mut G,
+    ) {
         assert_eq!(chunk.scale_factor_bits as usize, self.scale_factor_bits);
 
-        let mut output: Vec<i16> = Vec::with_capacity(chunk.frames_per_chunk * self.channels);
+        let scale_factor_frames = chunk.scale_factor_frames as usize;
+        let end_frame = start_frame + output.len() / self.channels;
 
-        let mut lms = chunk.lms.clone();
+        let first_residual = start_frame * self.channels;
+        let mut output_index = 0;
+        let mut frame = start_frame;
 
-        let dqts: &Vec<Vec<Vec<i32>>> = &(1..=8)
-            .map(|i| self.dequant_tab.get_dqt(i).clone())
-            .collect();
+        while frame < end_frame {
+            let scale_factor_index = frame / scale_factor_frames;
+            let subchunk_end = ((scale_factor_index + 1) * scale_factor_frames).min(end_frame);
 
-        for (scale_factor_index, subchunk_residuals) in chunk
-            .residuals
-            .chunks(self.channels * chunk.scale_factor_frames as usize)
-            .enumerate()
-        {
+            let subchunk_residuals =
+                &chunk.residuals[frame * self.channels..subchunk_end * self.channels];
             let scale_factors = &chunk.scale_factors[scale_factor_index * self.channels..];
-            let vbr_residuals = &chunk.vbr_residual_sizes[scale_factor_index * self.channels..];
-
-            for channel_residuals in subchunk_residuals.chunks(self.channels) {
-                for (channel_index, residual) in channel_residuals.iter().enumerate() {
-                    let residual_size: usize = vbr_residuals[channel_index] as usize;
-                    let scale_factor = scale_factors[channel_index];
-                    let predicted = lms[channel_index].predict();
-                    let quantized: usize = *residual as usize;
-                    let dequantized = dqts[residual_size - 1][scale_factor as usize][quantized];
-                    let reconstructed = clamp_i16(predicted + dequantized);
-                    output.push(reconstructed);
-                    lms[channel_index].update(reconstructed, dequantized);
+
+            match chunk.chunk_type {
+                SeaChunkType::Cbr => {
+                    let dqts = self.dequant_tab.get_dqt(chunk.residual_size as usize);
+
+                    for channel_residuals in subchunk_residuals.chunks(self.channels) {
+                        for (channel_index, residual) in channel_residuals.iter().enumerate() {
+                            let scale_factor = scale_factors[channel_index];
+                            let predicted = lms[channel_index].predict();
+                            let quantized: usize = *residual as usize;
+                            let dequantized = dqts[scale_factor as usize][quantized];
+                            let reconstructed = clamp_i16(predicted + dequantized);
+                            output[output_index] = gain.apply(self.refine(
+                                chunk,
+                                reconstructed,
+                                scale_factor_index * self.channels + channel_index,
+                                first_residual + output_index,
+                            ));
+                            output_index += 1;
+                            lms[channel_index].update(reconstructed, dequantized);
+                        }
+                        gain.next_frame();
+                    }
                 }
+                #[cfg(feature = "vbr")]
+                SeaChunkType::Vbr => {
+                    let vbr_residuals =
+                        &chunk.vbr_residual_sizes[scale_factor_index * self.channels..];
+
+                    for channel_residuals in subchunk_residuals.chunks(self.channels) {
+                        for (channel_index, residual) in channel_residuals.iter().enumerate() {
+                            let residual_size: usize = vbr_residuals[channel_index] as usize;
+                            let scale_factor = scale_factors[channel_index];
+                            let predicted = lms[channel_index].predict();
+                            let quantized: usize = *residual as usize;
+                            let dequantized = self.dequant_tab.get_dqt(residual_size)
+                                [scale_factor as usize][quantized];
+                            let reconstructed = clamp_i16(predicted + dequantized);
+                            output[output_index] = gain.apply(self.refine(
+                                chunk,
+                                reconstructed,
+                                scale_factor_index * self.channels + channel_index,
+                                first_residual + output_index,
+                            ));
+                            output_index += 1;
+                            lms[channel_index].update(reconstructed, dequantized);
+                        }
+                        gain.next_frame();
+                    }
+                }
+                #[cfg(not(feature = "vbr"))]
+                SeaChunkType::Vbr => unreachable!("VBR chunks are rejected by the parser"),
             }
+
+            frame = subchunk_end;
         }
+    }
 
-        output
+    // The base layer sample refined by the enhancement layer, if the chunk has one. The LMS keeps
+    // predicting from the base layer, which is what the encoder predicted from.
+    #[inline(always)]
+    fn refine(
+        &self,
+        chunk: &SeaChunk,
+        reconstructed: i16,
+        scale_factor_item: usize,
+        residual_index: usize,
+    ) -> i16 {
+        if chunk.enhancement_size == 0 {
+            return reconstructed;
+        }
+        let scale_factor = chunk.enhancement_scale_factors[scale_factor_item] as usize;
+        let quantized = chunk.enhancement_residuals[residual_index] as usize;
+        let dequantized =
+            self.dequant_tab.get_dqt(chunk.enhancement_size as usize)[scale_factor][quantized];
+        clamp_i16(reconstructed as i32 + dequantized)
     }
 }
@@ -1,9 +1,13 @@
-use std::array;
+use alloc::{vec, vec::Vec};
+use core::array;
+
+use super::math;
 
 #[derive(Debug, PartialEq)]
 pub struct SeaDequantTab {
     scale_factor_bits: usize,
 
+    #[cfg(feature = "encoder")]
     cached_reciprocals: [Vec<i32>; 9],
     cached_dqt: [Vec<Vec<i32>>; 9],
 }
@@ -17,6 +21,7 @@ impl SeaDequantTab {
     pub fn init(scale_factor_bits: usize) -> Self {
         let mut res = SeaDequantTab {
             scale_factor_bits: 0,
+            #[cfg(feature = "encoder")]
             cached_reciprocals: array::from_fn(|_| Vec::new()),
             cached_dqt: array::from_fn(|_| Vec::new()),
         };
@@ -32,8 +37,11 @@ impl SeaDequantTab {
         }
 
         self.scale_factor_bits = scale_factor_bits;
-        self.cached_reciprocals =
-            array::from_fn(|i| Self::generate_reciprocal(scale_factor_bits, i));
+        #[cfg(feature = "encoder")]
+        {
+            self.cached_reciprocals =
+                array::from_fn(|i| Self::generate_reciprocal(scale_factor_bits, i));
+        }
         self.cached_dqt = array::from_fn(|i: usize| Self::generate_dqt(scale_factor_bits, i));
     }
 
@@ -41,19 +49,20 @@ impl SeaDequantTab {
         IDEAL_POW_FACTOR[residual_bits - 1] / (scale_factor_bits as f32)
     }
 
-    fn calculate_scale_factors(residual_bits: usize, scale_factor_bits: usize) -> Vec<i32> {
-        let mut output: Vec<i32> = Vec::new();
+    // single entry of calculate_scale_factors, also used by the allocation-free decoder
+    pub fn scale_factor(scale_factor_bits: usize, residual_bits: usize, index: usize) -> i32 {
         let power_factor = Self::get_ideal_pow_factor(scale_factor_bits, residual_bits);
+        math::powf((index + 1) as f32, power_factor) as i32
+    }
 
+    fn calculate_scale_factors(residual_bits: usize, scale_factor_bits: usize) -> Vec<i32> {
         let scale_factor_items = 1 << scale_factor_bits;
-        for index in 1..=scale_factor_items {
-            let value: f32 = (index as f32).powf(power_factor);
-            output.push(value as i32);
-        }
-
-        output
+        (0..scale_factor_items)
+            .map(|index| Self::scale_factor(scale_factor_bits, residual_bits, index))
+            .collect()
     }
 
+    #[cfg(feature = "encoder")]
     fn generate_reciprocal(scale_factor_bits: usize, residual_bits: usize) -> Vec<i32> {
         if residual_bits == 0 {
             return vec![];
@@ -68,32 +77,38 @@ impl SeaDequantTab {
         new_reciprocal
     }
 
+    #[cfg(feature = "encoder")]
     pub fn get_scalefactor_reciprocals(&self, residual_bits: usize) -> &Vec<i32> {
         &self.cached_reciprocals[residual_bits]
     }
 
-    fn gen_dqt_table(residual_bits: usize) -> Vec<f32> {
+    // item of the dequantization curve, gen_dqt_table holds all 1 << (residual_bits - 1) of them
+    pub fn dqt_curve_item(residual_bits: usize, index: usize) -> f32 {
         match residual_bits {
-            1 => return vec![2.0],
-            2 => return vec![1.115, 4.0],
+            1 => return 2.0,
+            2 => return [1.115, 4.0][index],
             _ => (),
         }
 
         let start: f32 = 0.75f32;
         let steps = 1 << (residual_bits - 1);
         let end = ((1 << residual_bits) - 1) as f32;
-        let step = (end - start) / (steps - 1) as f32;
-        let step_floor = step.floor();
-
-        let mut curve = vec![0.0; steps];
-        for (i, item) in curve.iter_mut().enumerate().take(steps).skip(1) {
-            let y = 0.5 + i as f32 * step_floor;
-            *item = y;
+        if index == 0 {
+            return start;
         }
+        if index == steps - 1 {
+            return end;
+        }
+
+        let step = (end - start) / (steps - 1) as f32;
+        0.5 + index as f32 * math::floorf(step)
+    }
 
-        curve[0] = start;
-        curve[steps - 1] = end;
-        curve
+    fn gen_dqt_table(residual_bits: usize) -> Vec<f32> {
+        let steps = 1 << (residual_bits - 1);
+        (0..steps)
+            .map(|index| Self::dqt_curve_item(residual_bits, index))
+            .collect()
     }
 
     fn generate_dqt(scale_factor_bits: usize, residual_bits: usize) -> Vec<Vec<i32>> {
@@ -116,7 +131,7 @@ impl SeaDequantTab {
 
             // zig zag pattern decreases quantization error
             for item in dqt.iter().take(dqt_items) {
-                let val = (scale_factors[s] as f32 * item).round() as i32;
+                let val = math::roundf(scale_factors[s] as f32 * item) as i32;
                 output[s].push(val);
                 output[s].push(-val);
             }
@@ -1,43 +1,249 @@
-use std::mem;
+use alloc::{vec, vec::Vec};
+use core::mem;
+
+use crate::encoder::EncoderSettings;
 
 use super::{
-    common::{clamp_i16, SeaResidualSize},
+    common::{clamp_i16, EncodedSamples, SeaResidualSize},
     dqt::SeaDequantTab,
     lms::SeaLMS,
     qt::SeaQuantTab,
+    stats::{Stage, StatsRecorder},
 };
 
 pub struct EncoderBase {
     channels: usize,
     scale_factor_bits: usize,
+    beam: Option<BeamSettings>,
+    optimize_lms: bool,
+    enhancement_size: Option<SeaResidualSize>,
 
     current_residuals: Vec<u8>,
+    beam_buffers: BeamBuffers,
     prev_scalefactor: Vec<i32>,
     best_residual_bits: Vec<u8>,
+    base_reconstructed: Vec<i16>,
     dequant_tab: SeaDequantTab,
     quant_tab: SeaQuantTab,
     pub lms: Vec<SeaLMS>,
+    pub stats: StatsRecorder,
 }
 
+// frames at the start of a chunk the least squares LMS weights are fitted to
+const LMS_FIT_FRAMES: usize = 256;
+
 #[inline(always)]
 pub fn sea_div(v: i32, scalefactor_reciprocal: i64) -> i32 {
     let n = (v as i64 * scalefactor_reciprocal + (1 << 15)) >> 16;
     (n + (v.signum() as i64 - n.signum())) as i32
 }
 
+// Rate-distortion optimized search of the residual codes. The greedy search takes the nearest code
+// for every sample, the beam keeps the `width` best paths through each scale factor group instead
+// and extends them by `codes` codes around the nearest one. A code with a larger error can steer
+// the LMS towards better predictions for the rest of the group.
+#[derive(Debug, Clone, Copy)]
+struct BeamSettings {
+    width: usize,
+    codes: usize, // 2 adds the neighbour towards the residual, 3 both neighbours
+}
+
+impl BeamSettings {
+    fn from_effort(effort: u8) -> Option<Self> {
+        let (width, codes) = match effort {
+            0 => return None,
+            1 => (2, 2),
+            2 => (4, 2),
+            _ => (8, 3),
+        };
+        Some(Self { width, codes })
+    }
+}
+
+#[derive(Clone)]
+struct BeamPath {
+    lms: SeaLMS,
+    rank: u64,
+    sse: u64,
+    code: u8,
+    parent: usize, // index of the path this one extends in the previous step
+}
+
+#[derive(Default)]
+struct BeamBuffers {
+    paths: Vec<BeamPath>,
+    next: Vec<BeamPath>,
+    trace: Vec<(u8, usize)>, // code and parent of every path in every step
+}
+
+// Codes of the neighbouring dequantized values. The dequantization tables alternate signs, code 2k
+// is the k-th positive value and 2k + 1 its negation, with values growing in k.
+#[inline(always)]
+fn next_larger_code(code: usize, codes: usize) -> Option<usize> {
+    match code {
+        1 => Some(0),
+        _ if !code.is_multiple_of(2) => Some(code - 2),
+        _ => (code + 2 < codes).then_some(code + 2),
+    }
+}
+
+#[inline(always)]
+fn next_smaller_code(code: usize, codes: usize) -> Option<usize> {
+    match code {
+        0 => Some(1),
+        _ if code.is_multiple_of(2) => Some(code - 2),
+        _ => (code + 2 < codes).then_some(code + 2),
+    }
+}
+
 impl EncoderBase {
-    pub fn new(channels: usize, scale_factor_bits: usize) -> Self {
+    pub fn new(channels: usize, settings: &EncoderSettings) -> Self {
+        let scale_factor_bits = settings.scale_factor_bits as usize;
         Self {
             channels,
             scale_factor_bits,
+            beam: BeamSettings::from_effort(settings.effort),
+            optimize_lms: settings.optimize_lms,
+            enhancement_size: Self::enhancement_size(settings),
 
             current_residuals: Vec::new(),
+            beam_buffers: BeamBuffers::default(),
             prev_scalefactor: vec![0; channels],
             best_residual_bits: Vec::new(),
+            base_reconstructed: Vec::new(),
             dequant_tab: SeaDequantTab::init(scale_factor_bits),
             quant_tab: SeaQuantTab::init(),
             lms: SeaLMS::init_vec(channels as u32),
+            stats: StatsRecorder::default(),
+        }
+    }
+
+    fn enhancement_size(settings: &EncoderSettings) -> Option<SeaResidualSize> {
+        (settings.enhancement_bits > 0).then(|| SeaResidualSize::from(settings.enhancement_bits))
+    }
+
+    // Starts a new file and keeps the tables and buffers. The dequantization tables are only
+    // regenerated if the scale factor bits change.
+    #[cfg(feature = "std")]
+    pub fn reset(&mut self, channels: usize, settings: &EncoderSettings) {
+        let scale_factor_bits = settings.scale_factor_bits as usize;
+        self.channels = channels;
+        self.scale_factor_bits = scale_factor_bits;
+        self.beam = BeamSettings::from_effort(settings.effort);
+        self.optimize_lms = settings.optimize_lms;
+        self.enhancement_size = Self::enhancement_size(settings);
+
+        self.dequant_tab.set_scalefactor_bits(scale_factor_bits);
+        self.prev_scalefactor.clear();
+        self.prev_scalefactor.resize(channels, 0);
+        self.lms.clear();
+        self.lms.resize(channels, SeaLMS::initial());
+        self.stats = StatsRecorder::default();
+    }
+
+    // Returns the LMS states the chunk starts with, which the chunk header stores. By default that
+    // is the state the previous chunk ended with. With optimize_lms every channel starts with the
+    // weights that encode the chunk with the lowest error, out of the carried over weights, the
+    // weights of a new file and least squares fits to the opening and to the whole chunk. Every
+    // candidate costs an encoding pass of the chunk.
+    pub fn start_chunk(
+        &mut self,
+        samples: &[i16],
+        residual_bits: &[u8], // per scale factor group and channel
+        scale_factor_frames: usize,
+    ) -> Vec<SeaLMS> {
+        if !self.optimize_lms {
+            return self.lms.clone();
         }
+
+        let mut buffers = (
+            mem::take(&mut self.best_residual_bits),
+            mem::take(&mut self.current_residuals),
+            mem::take(&mut self.beam_buffers),
+        );
+        buffers.0.resize(scale_factor_frames, 0);
+        buffers.1.resize(scale_factor_frames, 0);
+
+        for channel in 0..self.channels {
+            let carried = self.lms[channel].clone();
+            let mut initial = SeaLMS::initial();
+            initial.history = carried.history;
+            let frames = samples.len() / self.channels;
+            let fitted_opening = carried.fitted(&samples[channel..], self.channels, LMS_FIT_FRAMES);
+            let fitted_chunk = (frames > LMS_FIT_FRAMES)
+                .then(|| carried.fitted(&samples[channel..], self.channels, frames));
+
+            let mut best_error = u64::MAX;
+            let candidates = [
+                Some(carried),
+                Some(initial),
+                Some(fitted_opening),
+                fitted_chunk,
+            ];
+            for candidate in candidates.into_iter().flatten() {
+                let error = self.chunk_error(
+                    &candidate,
+                    channel,
+                    samples,
+                    residual_bits,
+                    scale_factor_frames,
+                    &mut buffers,
+                );
+                if error < best_error {
+                    best_error = error;
+                    self.lms[channel] = candidate;
+                }
+            }
+        }
+
+        (
+            self.best_residual_bits,
+            self.current_residuals,
+            self.beam_buffers,
+        ) = buffers;
+        self.lms.clone()
+    }
+
+    // squared reconstruction error of one channel of the chunk encoded from the given state
+    fn chunk_error(
+        &self,
+        lms: &SeaLMS,
+        channel: usize,
+        samples: &[i16],
+        residual_bits: &[u8],
+        scale_factor_frames: usize,
+        (best_residual_bits, current_residuals, beam_buffers): &mut (Vec<u8>, Vec<u8>, BeamBuffers),
+    ) -> u64 {
+        let mut lms = lms.clone();
+        let mut scalefactor = self.prev_scalefactor[channel];
+        let mut error = 0;
+        for (slice_index, slice) in samples
+            .chunks(scale_factor_frames * self.channels)
+            .enumerate()
+        {
+            let frames = slice.len() / self.channels;
+            let residual_size = residual_bits[slice_index * self.channels + channel] as usize;
+            let dqt = self.dequant_tab.get_dqt(residual_size);
+            let scalefactor_reciprocals =
+                self.dequant_tab.get_scalefactor_reciprocals(residual_size);
+
+            let (_, sse, next_lms, next_scalefactor) = self.get_residuals_with_best_scalefactor(
+                self.channels,
+                dqt,
+                scalefactor_reciprocals,
+                &slice[channel..],
+                scalefactor,
+                &lms,
+                SeaResidualSize::from(residual_size as u8),
+                &mut best_residual_bits[..frames],
+                &mut current_residuals[..frames],
+                beam_buffers,
+            );
+            error += sse;
+            lms = next_lms;
+            scalefactor = next_scalefactor;
+        }
+        error
     }
 
     #[allow(clippy::too_many_arguments)]
@@ -52,8 +258,9 @@ impl EncoderBase {
         residual_size: SeaResidualSize,
         scalefactor_reciprocals: &[i32],
         current_residuals: &mut [u8],
-    ) -> u64 {
+    ) -> (u64, u64) {
         let mut current_rank: u64 = 0;
+        let mut current_sse: u64 = 0;
 
         let clamp_limit = residual_size.to_binary_combinations() as i32;
 
@@ -70,6 +277,9 @@ impl EncoderBase {
                 scalefactor_reciprocals[scalefactor as usize] as i64,
             );
             let clamped = scaled.clamp(-clamp_limit, clamp_limit);
+            if clamped != scaled {
+                self.stats.add_clamp_event();
+            }
             let quantized = quant_tab.quant_tab[(quant_tab_offset + clamped) as usize];
 
             let dequantized = dequant_tab[quantized as usize];
@@ -79,8 +289,10 @@ impl EncoderBase {
 
             let error_sq = error.pow(2) as u64;
 
+            current_sse += error_sq;
             current_rank += error_sq + lms.get_weights_penalty();
             if current_rank > best_rank {
+                self.stats.add_early_exit();
                 break;
             }
 
@@ -88,7 +300,121 @@ impl EncoderBase {
             current_residuals[index] = quantized;
         }
 
-        current_rank
+        (current_rank, current_sse)
+    }
+
+    // same as calculate_residuals, but with a beam search over the codes
+    #[allow(clippy::too_many_arguments)]
+    fn calculate_residuals_beam(
+        &self,
+        beam: BeamSettings,
+        channels: usize,
+        dequant_tab: &[i32],
+        samples: &[i16],
+        scalefactor: i32,
+        lms: &mut SeaLMS,
+        best_rank: u64,
+        residual_size: SeaResidualSize,
+        scalefactor_reciprocals: &[i32],
+        current_residuals: &mut [u8],
+        buffers: &mut BeamBuffers,
+    ) -> (u64, u64) {
+        let BeamBuffers { paths, next, trace } = buffers;
+
+        let clamp_limit = residual_size.to_binary_combinations() as i32;
+        let quant_tab = &self.quant_tab;
+        let quant_tab_offset = clamp_limit + quant_tab.offsets[residual_size as usize] as i32;
+
+        paths.clear();
+        paths.push(BeamPath {
+            lms: lms.clone(),
+            rank: 0,
+            sse: 0,
+            code: 0,
+            parent: 0,
+        });
+        trace.clear();
+
+        let mut steps = 0;
+        for sample_i16 in samples.iter().step_by(channels) {
+            let sample = *sample_i16 as i32;
+
+            next.clear();
+            for (parent, path) in paths.iter().enumerate() {
+                let predicted = path.lms.predict();
+                let residual = sample - predicted;
+                let scaled = sea_div(
+                    residual,
+                    scalefactor_reciprocals[scalefactor as usize] as i64,
+                );
+                let clamped = scaled.clamp(-clamp_limit, clamp_limit);
+                if clamped != scaled {
+                    self.stats.add_clamp_event();
+                }
+                let nearest = quant_tab.quant_tab[(quant_tab_offset + clamped) as usize] as usize;
+
+                let larger = next_larger_code(nearest, dequant_tab.len());
+                let smaller = next_smaller_code(nearest, dequant_tab.len());
+                let candidates = match residual > dequant_tab[nearest] {
+                    true => [Some(nearest), larger, smaller],
+                    false => [Some(nearest), smaller, larger],
+                };
+
+                let penalty = path.lms.get_weights_penalty();
+                for code in candidates[..beam.codes].iter().flatten() {
+                    let dequantized = dequant_tab[*code];
+                    let reconstructed = clamp_i16(predicted + dequantized);
+
+                    let error: i64 = sample as i64 - reconstructed as i64;
+                    let error_sq = error.pow(2) as u64;
+
+                    let rank = path.rank + error_sq + penalty;
+                    if rank > best_rank {
+                        continue;
+                    }
+
+                    let mut path_lms = path.lms.clone();
+                    path_lms.update(reconstructed, dequantized);
+                    next.push(BeamPath {
+                        lms: path_lms,
+                        rank,
+                        sse: path.sse + error_sq,
+                        code: *code as u8,
+                        parent,
+                    });
+                }
+            }
+
+            // every path is worse than the best scale factor so far
+            if next.is_empty() {
+                self.stats.add_early_exit();
+                return (u64::MAX, 0);
+            }
+
+            if next.len() > beam.width {
+                next.select_nth_unstable_by_key(beam.width - 1, |path| path.rank);
+                next.truncate(beam.width);
+            }
+            trace.resize(steps * beam.width, (0, 0));
+            trace.extend(next.iter().map(|path| (path.code, path.parent)));
+
+            mem::swap(paths, next);
+            steps += 1;
+        }
+
+        let (mut index, best) = paths
+            .iter()
+            .enumerate()
+            .min_by_key(|(_, path)| path.rank)
+            .unwrap();
+        for step in (0..steps).rev() {
+            let (code, parent) = trace[step * beam.width + index];
+            current_residuals[step] = code;
+            index = parent;
+        }
+
+        lms.clone_from(&best.lms);
+        (best.rank, best.sse)
     }
 
     #[allow(clippy::too_many_arguments)]
@@ -103,8 +429,10 @@ impl EncoderBase {
         residual_size: SeaResidualSize,
         best_residual_bits: &mut [u8],
         current_residuals: &mut [u8],
-    ) -> (u64, SeaLMS, i32) {
+        beam_buffers: &mut BeamBuffers,
+    ) -> (u64, u64, SeaLMS, i32) {
         let mut best_rank: u64 = u64::MAX;
+        let mut best_sse: u64 = 0;
 
         let mut best_lms = SeaLMS::new();
         let mut best_scalefactor: i32 = 0;
@@ -112,6 +440,8 @@ impl EncoderBase {
         let mut current_lms: SeaLMS = ref_lms.clone();
 
         let scalefactor_end = 1 << self.scale_factor_bits;
+        self.stats
+            .add_scale_factor_candidates(scalefactor_end as u64);
 
         for sfi in 0..scalefactor_end {
             let scalefactor: i32 = (sfi + prev_scalefactor) % scalefactor_end;
@@ -120,27 +450,43 @@ impl EncoderBase {
 
             let dqt = &dequant_tab[scalefactor as usize];
 
-            let current_rank = self.calculate_residuals(
-                channels,
-                dqt,
-                samples,
-                scalefactor,
-                &mut current_lms,
-                best_rank,
-                residual_size,
-                scalefactor_reciprocals,
-                current_residuals,
-            );
+            let (current_rank, current_sse) = match self.beam {
+                Some(beam) => self.calculate_residuals_beam(
+                    beam,
+                    channels,
+                    dqt,
+                    samples,
+                    scalefactor,
+                    &mut current_lms,
+                    best_rank,
+                    residual_size,
+                    scalefactor_reciprocals,
+                    current_residuals,
+                    beam_buffers,
+                ),
+                None => self.calculate_residuals(
+                    channels,
+                    dqt,
+                    samples,
+                    scalefactor,
+                    &mut current_lms,
+                    best_rank,
+                    residual_size,
+                    scalefactor_reciprocals,
+                    current_residuals,
+                ),
+            };
 
             if current_rank < best_rank {
                 best_rank = current_rank;
+                best_sse = current_sse;
                 best_residual_bits[..current_residuals.len()].clone_from_slice(current_residuals);
                 best_lms.clone_from(&current_lms);
                 best_scalefactor = scalefactor;
             }
         }
 
-        (best_rank, best_lms, best_scalefactor)
+        (best_rank, best_sse, best_lms, best_scalefactor)
     }
 
     pub fn get_residuals_for_chunk(
@@ -150,13 +496,18 @@ impl EncoderBase {
         scale_factors: &mut [u8],
         residuals: &mut [u8],
         ranks: &mut [u64],
+        sse: &mut [u64], // accumulated
     ) {
+        let stage_start = self.stats.start();
+
         let mut best_residual_bits = mem::take(&mut self.best_residual_bits);
         best_residual_bits.resize(samples.len() / self.channels, 0);
 
         let mut current_residuals = mem::take(&mut self.current_residuals);
         current_residuals.resize(best_residual_bits.len(), 0);
 
+        let mut beam_buffers = mem::take(&mut self.beam_buffers);
+
         for channel_offset in 0..self.channels {
             let dqt: &Vec<Vec<i32>> = self
                 .dequant_tab
@@ -166,23 +517,26 @@ impl EncoderBase {
                 .dequant_tab
                 .get_scalefactor_reciprocals(residual_size[channel_offset] as usize);
 
-            let (best_rank, best_lms, best_scalefactor) = self.get_residuals_with_best_scalefactor(
-                self.channels,
-                dqt,
-                scalefactor_reciprocals,
-                &samples[channel_offset..],
-                self.prev_scalefactor[channel_offset],
-                &self.lms[channel_offset],
-                residual_size[channel_offset],
-                &mut best_residual_bits,
-                &mut current_residuals,
-            );
+            let (best_rank, best_sse, best_lms, best_scalefactor) = self
+                .get_residuals_with_best_scalefactor(
+                    self.channels,
+                    dqt,
+                    scalefactor_reciprocals,
+                    &samples[channel_offset..],
+                    self.prev_scalefactor[channel_offset],
+                    &self.lms[channel_offset],
+                    residual_size[channel_offset],
+                    &mut best_residual_bits,
+                    &mut current_residuals,
+                    &mut beam_buffers,
+                );
 
             self.prev_scalefactor[channel_offset] = best_scalefactor;
             self.lms[channel_offset] = best_lms;
 
             scale_factors[channel_offset] = best_scalefactor as u8;
             ranks[channel_offset] = best_rank;
+            sse[channel_offset] += best_sse;
 
             // interleave output
             for i in 0..best_residual_bits.len() {
@@ -192,5 +546,106 @@ impl EncoderBase {
 
         self.best_residual_bits = best_residual_bits;
         self.current_residuals = current_residuals;
+        self.beam_buffers = beam_buffers;
+
+        self.stats.finish(Stage::Residuals, stage_start);
+    }
+
+    // Quantizes what the base layer leaves of every sample into the enhancement layer. The base is
+    // reconstructed like decoders do it, its LMS never sees the enhancement, so the base layer
+    // decodes on its own. No prediction is involved, every scale factor group only picks the
+    // scale factor with the lowest error. The sse of the chunk becomes the one of both layers.
+    pub fn enhance(
+        &mut self,
+        samples: &[i16],
+        residual_size: SeaResidualSize, // of the groups, if encoded.residual_bits is empty
+        scale_factor_frames: usize,
+        encoded: &mut EncodedSamples,
+    ) {
+        let Some(enhancement_size) = self.enhancement_size else {
+            return;
+        };
+        let stage_start = self.stats.start();
+        let channels = self.channels;
+
+        let mut reconstructed = mem::take(&mut self.base_reconstructed);
+        reconstructed.resize(samples.len(), 0);
+        let mut lms = encoded.initial_lms.clone();
+        for (frame_index, frame) in encoded.residuals.chunks_exact(channels).enumerate() {
+            let group = frame_index / scale_factor_frames * channels;
+            for (channel, residual) in frame.iter().enumerate() {
+                let size = match encoded.residual_bits.is_empty() {
+                    true => residual_size as usize,
+                    false => encoded.residual_bits[group + channel] as usize,
+                };
+                let scale_factor = encoded.scale_factors[group + channel] as usize;
+                let predicted = lms[channel].predict();
+                let dequantized = self.dequant_tab.get_dqt(size)[scale_factor][*residual as usize];
+                let sample = clamp_i16(predicted + dequantized);
+                lms[channel].update(sample, dequantized);
+                reconstructed[frame_index * channels + channel] = sample;
+            }
+        }
+
+        let dqts = self.dequant_tab.get_dqt(enhancement_size as usize);
+        let reciprocals = self
+            .dequant_tab
+            .get_scalefactor_reciprocals(enhancement_size as usize);
+        let clamp_limit = enhancement_size.to_binary_combinations() as i32;
+        let quant_tab_offset =
+            clamp_limit + self.quant_tab.offsets[enhancement_size as usize] as i32;
+        let quantize = |index: usize, dqt: &[i32], reciprocal: i32| -> (u8, u64) {
+            let base = reconstructed[index] as i32;
+            let scaled = sea_div(samples[index] as i32 - base, reciprocal as i64);
+            let clamped = scaled.clamp(-clamp_limit, clamp_limit);
+            let quantized = self.quant_tab.quant_tab[(quant_tab_offset + clamped) as usize];
+            let refined = clamp_i16(base + dqt[quantized as usize]);
+            let error = samples[index] as i64 - refined as i64;
+            (quantized, error.pow(2) as u64)
+        };
+
+        encoded.enhancement_scale_factors = vec![0; encoded.scale_factors.len()];
+        encoded.enhancement_residuals = vec![0; samples.len()];
+        encoded.sse.fill(0);
+
+        let group_samples = scale_factor_frames * channels;
+        for item in 0..encoded.enhancement_scale_factors.len() {
+            let (group, channel) = (item / channels, item % channels);
+            let group_end = ((group + 1) * group_samples).min(samples.len());
+            let indices = (group * group_samples + channel..group_end).step_by(channels);
+
+            // the search starts at the scale factor of the previous group, like the base layer's
+            let previous_scale_factor = match item.checked_sub(channels) {
+                Some(previous) => encoded.enhancement_scale_factors[previous] as usize,
+                None => 0,
+            };
+            let mut best_sse = u64::MAX;
+            let mut best_scale_factor = previous_scale_factor;
+            for scale_factor_index in 0..dqts.len() {
+                let scale_factor = (scale_factor_index + previous_scale_factor) % dqts.len();
+                let (dqt, reciprocal) = (&dqts[scale_factor], reciprocals[scale_factor]);
+                let mut sse = 0;
+                for index in indices.clone() {
+                    sse += quantize(index, dqt, reciprocal).1;
+                    if sse >= best_sse {
+                        break;
+                    }
+                }
+                if sse < best_sse {
+                    best_sse = sse;
+                    best_scale_factor = scale_factor;
+                }
+            }
+
+            let (dqt, reciprocal) = (&dqts[best_scale_factor], reciprocals[best_scale_factor]);
+            for index in indices {
+                encoded.enhancement_residuals[index] = quantize(index, dqt, reciprocal).0;
+            }
+            encoded.enhancement_scale_factors[item] = best_scale_factor as u8;
+            encoded.sse[channel] += best_sse;
+        }
+
+        self.base_reconstructed = reconstructed;
+        self.stats.finish(Stage::Residuals, stage_start);
     }
 }
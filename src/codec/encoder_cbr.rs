@@ -1,15 +1,21 @@
+use alloc::{vec, vec::Vec};
+
 use crate::encoder::EncoderSettings;
 
 use super::{
     common::{EncodedSamples, SeaEncoderTrait, SeaResidualSize},
     encoder_base::EncoderBase,
     file::SeaFileHeader,
-    lms::SeaLMS,
+    math,
 };
 
+#[cfg(feature = "stats")]
+use super::stats::StatsRecorder;
+
 pub struct CbrEncoder {
     channels: usize,
     residual_size: SeaResidualSize,
+    residual_sizes: Vec<SeaResidualSize>, // per channel
     scale_factor_frames: usize,
     base_encoder: EncoderBase,
 }
@@ -18,17 +24,55 @@ impl CbrEncoder {
     pub fn new(file_header: &SeaFileHeader, encoder_settings: &EncoderSettings) -> Self {
         CbrEncoder {
             channels: file_header.channels as usize,
-            residual_size: SeaResidualSize::from(encoder_settings.residual_bits.floor() as u8),
+            residual_size: SeaResidualSize::from(math::floorf(encoder_settings.residual_bits) as u8),
+            residual_sizes: Self::channel_residual_sizes(file_header, encoder_settings),
             scale_factor_frames: encoder_settings.scale_factor_frames as usize,
-            base_encoder: EncoderBase::new(
-                file_header.channels as usize,
-                encoder_settings.scale_factor_bits as usize,
-            ),
+            base_encoder: EncoderBase::new(file_header.channels as usize, encoder_settings),
         }
     }
 
-    pub fn get_lms(&self) -> &Vec<SeaLMS> {
-        &self.base_encoder.lms
+    // reuses the tables and buffers of the encoder of a previous file
+    #[cfg(feature = "std")]
+    pub fn with_base(
+        file_header: &SeaFileHeader,
+        encoder_settings: &EncoderSettings,
+        mut base_encoder: EncoderBase,
+    ) -> Self {
+        base_encoder.reset(file_header.channels as usize, encoder_settings);
+        CbrEncoder {
+            channels: file_header.channels as usize,
+            residual_size: SeaResidualSize::from(math::floorf(encoder_settings.residual_bits) as u8),
+            residual_sizes: Self::channel_residual_sizes(file_header, encoder_settings),
+            scale_factor_frames: encoder_settings.scale_factor_frames as usize,
+            base_encoder,
+        }
+    }
+
+    // the residual bits shifted by the channel offsets, see SeaFile::check_settings for the limits
+    fn channel_residual_sizes(
+        file_header: &SeaFileHeader,
+        encoder_settings: &EncoderSettings,
+    ) -> Vec<SeaResidualSize> {
+        let residual_bits = math::floorf(encoder_settings.residual_bits) as i8;
+        (0..file_header.channels as usize)
+            .map(|channel| {
+                let offset = encoder_settings
+                    .channel_bit_offsets
+                    .get(channel)
+                    .unwrap_or(&0);
+                SeaResidualSize::from((residual_bits + offset) as u8)
+            })
+            .collect()
+    }
+
+    #[cfg(feature = "std")]
+    pub fn into_base(self) -> EncoderBase {
+        self.base_encoder
+    }
+
+    #[cfg(feature = "stats")]
+    pub fn get_stats(&self) -> &StatsRecorder {
+        &self.base_encoder.stats
     }
 }
 
@@ -40,28 +84,57 @@ impl SeaEncoderTrait for CbrEncoder {
                 (samples.len() / self.channels).div_ceil(self.scale_factor_frames) * self.channels
             ];
 
+        let residual_bits: Vec<u8> = (0..scale_factors.len())
+            .map(|index| self.residual_sizes[index % self.channels] as u8)
+            .collect();
+
+        let initial_lms =
+            self.base_encoder
+                .start_chunk(samples, &residual_bits, self.scale_factor_frames);
+
         let mut residuals: Vec<u8> = vec![0u8; samples.len()];
 
         let mut ranks = vec![0u64; self.channels];
+        let mut sse = vec![0u64; self.channels];
 
         let slice_size = self.scale_factor_frames * self.channels;
 
-        let residual_sizes = vec![self.residual_size; self.channels];
-
         for (slice_index, input_slice) in samples.chunks(slice_size).enumerate() {
             self.base_encoder.get_residuals_for_chunk(
                 input_slice,
-                &residual_sizes,
+                &self.residual_sizes,
                 &mut scale_factors[slice_index * self.channels..],
                 &mut residuals[slice_index * slice_size..],
                 &mut ranks,
+                &mut sse,
             );
         }
 
-        EncodedSamples {
+        // channels of different sizes need the residual sizes of the VBR chunk layout
+        let channel_offsets = self
+            .residual_sizes
+            .iter()
+            .any(|size| *size != self.residual_size);
+
+        let mut encoded = EncodedSamples {
+            initial_lms,
             scale_factors,
             residuals,
-            residual_bits: vec![],
-        }
+            residual_bits: if channel_offsets {
+                residual_bits
+            } else {
+                vec![]
+            },
+            sse,
+            enhancement_scale_factors: vec![],
+            enhancement_residuals: vec![],
+        };
+        self.base_encoder.enhance(
+            samples,
+            self.residual_size,
+            self.scale_factor_frames,
+            &mut encoded,
+        );
+        encoded
     }
 }
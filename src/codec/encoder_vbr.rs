@@ -1,3 +1,5 @@
+use alloc::{vec, vec::Vec};
+
 use crate::{
     codec::{common::SeaResidualSize, lms::LMS_LEN},
     encoder::EncoderSettings,
@@ -7,13 +9,18 @@ use super::{
     common::{EncodedSamples, SeaEncoderTrait},
     encoder_base::EncoderBase,
     file::SeaFileHeader,
-    lms::SeaLMS,
+    math,
+    stats::Stage,
 };
 
+#[cfg(feature = "stats")]
+use super::stats::StatsRecorder;
+
 pub struct VbrEncoder {
     channels: usize,
     scale_factor_frames: u8,
     vbr_target_bitrate: f32,
+    channel_bit_offsets: Vec<i8>,
     base_encoder: EncoderBase,
 }
 
@@ -25,16 +32,37 @@ impl VbrEncoder {
         VbrEncoder {
             channels: file_header.channels as usize,
             scale_factor_frames: encoder_settings.scale_factor_frames,
-            base_encoder: EncoderBase::new(
-                file_header.channels as usize,
-                encoder_settings.scale_factor_bits as usize,
-            ),
+            base_encoder: EncoderBase::new(file_header.channels as usize, encoder_settings),
             vbr_target_bitrate: Self::get_normalized_vbr_bitrate(encoder_settings),
+            channel_bit_offsets: encoder_settings.channel_bit_offsets.clone(),
         }
     }
 
-    pub fn get_lms(&self) -> &Vec<SeaLMS> {
-        &self.base_encoder.lms
+    // reuses the tables and buffers of the encoder of a previous file
+    #[cfg(feature = "std")]
+    pub fn with_base(
+        file_header: &SeaFileHeader,
+        encoder_settings: &EncoderSettings,
+        mut base_encoder: EncoderBase,
+    ) -> Self {
+        base_encoder.reset(file_header.channels as usize, encoder_settings);
+        VbrEncoder {
+            channels: file_header.channels as usize,
+            scale_factor_frames: encoder_settings.scale_factor_frames,
+            base_encoder,
+            vbr_target_bitrate: Self::get_normalized_vbr_bitrate(encoder_settings),
+            channel_bit_offsets: encoder_settings.channel_bit_offsets.clone(),
+        }
+    }
+
+    #[cfg(feature = "std")]
+    pub fn into_base(self) -> EncoderBase {
+        self.base_encoder
+    }
+
+    #[cfg(feature = "stats")]
+    pub fn get_stats(&self) -> &StatsRecorder {
+        &self.base_encoder.stats
     }
 
     fn get_normalized_vbr_bitrate(encoder_settings: &EncoderSettings) -> f32 {
@@ -51,7 +79,7 @@ impl VbrEncoder {
         vbr_bitrate -= 2.0 / encoder_settings.scale_factor_frames as f32;
 
         // compensate with target distribution
-        let base_residuals = encoder_settings.residual_bits.floor();
+        let base_residuals = math::floorf(encoder_settings.residual_bits);
         let new_bitrate = TARGET_RESIDUAL_DISTRIBUTION[1] * (base_residuals - 1.0)
             + TARGET_RESIDUAL_DISTRIBUTION[2] * base_residuals
             + TARGET_RESIDUAL_DISTRIBUTION[3] * (base_residuals + 1.0)
@@ -59,7 +87,8 @@ impl VbrEncoder {
         let diff = new_bitrate - base_residuals;
         vbr_bitrate -= diff;
 
-        vbr_bitrate
+        // short chunks or dense scale factors can leave less than a bit, residuals need at least one
+        vbr_bitrate.max(1.0)
     }
 
     // returns items count [target-1, target, target+1, target+2]
@@ -102,8 +131,11 @@ impl VbrEncoder {
         let mut indices: Vec<u16> = (0..sortable_items as u16).collect();
         indices.sort_unstable_by(|&a, &b| errors[a as usize].cmp(&errors[b as usize]));
 
-        let [minus_one_items, _, plus_one_items, plus_two_items] =
-            Self::interpolate_distribution(sortable_items, self.vbr_target_bitrate);
+        let distribution = Self::interpolate_distribution(sortable_items, self.vbr_target_bitrate);
+        if self.channel_bit_offsets.iter().any(|offset| *offset != 0) {
+            return self.choose_offset_residual_lens(&indices, distribution, errors.len());
+        }
+        let [minus_one_items, _, plus_one_items, plus_two_items] = distribution;
 
         let base_residual_bits = self.vbr_target_bitrate as u8;
 
@@ -127,12 +159,55 @@ impl VbrEncoder {
             residual_sizes[*index as usize] = base_residual_bits + 2;
         }
 
-        // count how many times each residual size appears
-        let mut residual_size_counts = [0; 9];
-        for i in 0..errors.len() {
-            residual_size_counts[residual_sizes[i] as usize] += 1;
+        residual_sizes
+    }
+
+    // Same distribution with every channel's sizes shifted by its offset. The chunk stores sizes
+    // relative to its base, which covers four sizes from the smallest one, so a change that would
+    // leave that range goes to the next scale factor group in error order instead. The number of
+    // changes depends only on the counts, which keeps the chunk size the same for every chunk.
+    fn choose_offset_residual_lens(
+        &self,
+        indices: &[u16], // sorted by error
+        [minus_one_items, _, plus_one_items, plus_two_items]: [usize; 4],
+        items: usize,
+    ) -> Vec<u8> {
+        let base_residual_bits = self.vbr_target_bitrate as i32;
+        let mut channel_sizes: Vec<i32> = self
+            .channel_bit_offsets
+            .iter()
+            .map(|offset| (base_residual_bits + *offset as i32).clamp(1, 8))
+            .collect();
+        let smallest = *channel_sizes.iter().min().unwrap();
+        let largest = (smallest + 3).min(8);
+        for size in channel_sizes.iter_mut() {
+            *size = (*size).min(largest);
         }
 
+        let mut residual_sizes: Vec<u8> = (0..items)
+            .map(|index| channel_sizes[index % self.channels] as u8)
+            .collect();
+
+        let mut change = |indices: &mut dyn Iterator<Item = &u16>, count: usize, step: i32| {
+            let mut changed = 0;
+            for index in indices {
+                if changed == count {
+                    break;
+                }
+                let channel_size = channel_sizes[*index as usize % self.channels];
+                let size = &mut residual_sizes[*index as usize];
+                if *size as i32 == channel_size
+                    && (smallest..=largest).contains(&(channel_size + step))
+                {
+                    *size = (channel_size + step) as u8;
+                    changed += 1;
+                }
+            }
+        };
+        change(&mut indices.iter(), minus_one_items, -1);
+        change(&mut indices.iter().rev(), plus_two_items, 2);
+        change(&mut indices.iter().rev(), plus_one_items, 1);
+
         residual_sizes
     }
 
@@ -148,6 +223,8 @@ impl VbrEncoder {
         let mut scale_factors = vec![0u8; slice_size];
         let mut residuals: Vec<u8> = vec![0u8; slice_size];
 
+        let mut analyze_sse = vec![0u64; self.channels];
+
         let mut errors = vec![
             0u64;
             (input_slice.len() / self.channels)
@@ -162,6 +239,7 @@ impl VbrEncoder {
                 &mut scale_factors,
                 &mut residuals,
                 &mut errors[slice_index * self.channels..],
+                &mut analyze_sse,
             );
         }
 
@@ -182,13 +260,22 @@ impl SeaEncoderTrait for VbrEncoder {
 
         let mut residuals: Vec<u8> = vec![0u8; samples.len()];
 
+        let stage_start = self.base_encoder.stats.start();
         let residual_bits: Vec<u8> = self.analyze(samples);
+        self.base_encoder.stats.finish(Stage::Analyze, stage_start);
+
+        let initial_lms = self.base_encoder.start_chunk(
+            samples,
+            &residual_bits,
+            self.scale_factor_frames as usize,
+        );
 
         let slice_size = self.scale_factor_frames as usize * self.channels;
 
         let mut residual_sizes = vec![SeaResidualSize::from(2); self.channels];
 
         let mut ranks = vec![0u64; self.channels];
+        let mut sse = vec![0u64; self.channels];
 
         for (slice_index, input_slice) in samples.chunks(slice_size).enumerate() {
             for channel_offset in 0..self.channels {
@@ -203,13 +290,26 @@ impl SeaEncoderTrait for VbrEncoder {
                 &mut scale_factors[slice_index * self.channels..],
                 &mut residuals[slice_index * slice_size..],
                 &mut ranks,
+                &mut sse,
             );
         }
 
-        EncodedSamples {
+        let mut encoded = EncodedSamples {
+            initial_lms,
             scale_factors,
             residuals,
             residual_bits,
-        }
+            sse,
+            enhancement_scale_factors: vec![],
+            enhancement_residuals: vec![],
+        };
+        // the residual size is only used for chunks without residual_bits
+        self.base_encoder.enhance(
+            samples,
+            residual_sizes[0],
+            self.scale_factor_frames as usize,
+            &mut encoded,
+        );
+        encoded
     }
 }
@@ -1,80 +1,172 @@
-use std::{
-    io::{self},
-    rc::Rc,
-};
+#[cfg(all(feature = "decoder", feature = "std"))]
+use std::io;
 
-use crate::{
-    codec::{chunk::SeaChunk, common::read_max_or_zero},
-    encoder::EncoderSettings,
-};
+use alloc::{string::String, sync::Arc};
+#[cfg(any(feature = "encoder", feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+#[cfg(feature = "encoder")]
+use crate::encoder::{ChannelQuality, ChunkStats, EncoderSettings};
 
 use super::{
-    chunk::SeaChunkType,
-    common::{
-        read_u16_le, read_u32_be, read_u32_le, read_u8, SeaEncoderTrait, SeaError, SEAC_MAGIC,
-    },
-    decoder::Decoder,
-    encoder_cbr::CbrEncoder,
-    encoder_vbr::VbrEncoder,
+    chunk::SeaChunk,
+    common::{SeaError, SEAC_MAGIC},
+    stats::{Stage, StatsRecorder},
 };
 
-#[derive(Debug, Clone)]
-pub struct SeaFileHeader {
+#[cfg(feature = "decoder")]
+use super::decoder::Decoder;
+#[cfg(feature = "decoder")]
+use crate::sample::{SeaGain, SeaSample};
+
+#[cfg(all(feature = "decoder", feature = "std"))]
+use super::common::read_max_or_zero;
+
+#[cfg(feature = "encoder")]
+use super::{common::SeaEncoderTrait, encoder_cbr::CbrEncoder, lms::LMS_LEN};
+
+#[cfg(all(feature = "encoder", feature = "vbr"))]
+use super::encoder_vbr::VbrEncoder;
+
+#[cfg(feature = "encoder")]
+use super::math;
+
+#[cfg(feature = "stats")]
+use super::stats::SeaStats;
+
+// the header fields before the metadata, parsed without allocating
+#[cfg(feature = "decoder")]
+#[derive(Debug, Clone, Copy)]
+pub struct SeaFixedHeader {
     pub version: u8,
     pub channels: u8,
     pub chunk_size: u16,
     pub frames_per_chunk: u16,
     pub sample_rate: u32,
     pub total_frames: u32,
-    pub metadata: Rc<String>,
+    pub metadata_len: u32,
 }
 
-impl SeaFileHeader {
-    fn validate(&self) -> bool {
-        self.channels > 0
-            && self.chunk_size >= 16
-            && self.frames_per_chunk > 0
-            && self.sample_rate > 0
-    }
-
-    pub fn from_reader<R: io::Read>(mut reader: &mut R) -> Result<Self, SeaError> {
-        let magic = read_u32_be(&mut reader)?;
-        if magic != SEAC_MAGIC {
+#[cfg(feature = "decoder")]
+impl SeaFixedHeader {
+    pub const EMPTY: Self = Self {
+        version: 0,
+        channels: 0,
+        chunk_size: 0,
+        frames_per_chunk: 0,
+        sample_rate: 0,
+        total_frames: 0,
+        metadata_len: 0,
+    };
+
+    // prefix has to hold at least SeaFileHeader::FIXED_SIZE bytes
+    pub fn parse(prefix: &[u8]) -> Result<Self, SeaError> {
+        if prefix.len() < SeaFileHeader::FIXED_SIZE {
             return Err(SeaError::InvalidFile);
         }
-        let version = read_u8(&mut reader)?;
-        let channels = read_u8(&mut reader)?;
-        let chunk_size = read_u16_le(&mut reader)?;
-        let frames_per_chunk = read_u16_le(&mut reader)?;
-        let sample_rate = read_u32_le(&mut reader)?;
-        let total_frames = read_u32_le(&mut reader)?;
-        let metadata_size = read_u32_le(&mut reader)?;
+        let u16_at = |offset: usize| u16::from_le_bytes([prefix[offset], prefix[offset + 1]]);
+        let u32_at =
+            |offset: usize| u32::from_le_bytes(prefix[offset..offset + 4].try_into().unwrap());
 
-        let mut metadata = Vec::<u8>::with_capacity(metadata_size as usize);
-        reader.read_exact(&mut metadata)?;
-        let metadata_string = String::from_utf8(metadata).unwrap();
+        if u32::from_be_bytes(prefix[..4].try_into().unwrap()) != SEAC_MAGIC {
+            return Err(SeaError::InvalidFile);
+        }
 
-        let res: SeaFileHeader = Self {
-            version,
-            channels,
-            chunk_size,
-            frames_per_chunk,
-            sample_rate,
-            total_frames,
-            metadata: Rc::new(metadata_string),
+        let header = Self {
+            version: prefix[4],
+            channels: prefix[5],
+            chunk_size: u16_at(6),
+            frames_per_chunk: u16_at(8),
+            sample_rate: u32_at(10),
+            total_frames: u32_at(14),
+            metadata_len: u32_at(18),
         };
 
-        if !res.validate() {
+        let valid = header.channels > 0
+            && header.chunk_size >= 16
+            && header.frames_per_chunk > 0
+            && header.sample_rate > 0;
+        if !valid {
             return Err(SeaError::InvalidFile);
         }
 
-        Ok(res)
+        Ok(header)
+    }
+
+    // size of the whole header including the metadata
+    pub fn header_len(&self) -> usize {
+        SeaFileHeader::FIXED_SIZE.saturating_add(self.metadata_len as usize)
+    }
+}
+
+#[derive(Debug, Clone)]
+pub struct SeaFileHeader {
+    pub version: u8,
+    pub channels: u8,
+    pub chunk_size: u16,
+    pub frames_per_chunk: u16,
+    pub sample_rate: u32,
+    pub total_frames: u32,
+    pub metadata: Arc<String>,
+}
+
+impl SeaFileHeader {
+    // size of the header without metadata
+    pub const FIXED_SIZE: usize = 22;
+
+    // size of the whole header, if the fixed part is already available
+    #[cfg(feature = "decoder")]
+    pub fn size_from_prefix(prefix: &[u8]) -> Option<usize> {
+        if prefix.len() < Self::FIXED_SIZE {
+            return None;
+        }
+        let metadata_size = u32::from_le_bytes(prefix[18..22].try_into().unwrap());
+        Some(Self::FIXED_SIZE + metadata_size as usize)
+    }
+
+    // size of the whole header including the metadata
+    #[cfg(feature = "decoder")]
+    pub fn size(&self) -> usize {
+        Self::FIXED_SIZE + self.metadata.len()
     }
 
+    // bytes has to hold the whole header, anything after it is ignored
+    #[cfg(feature = "decoder")]
+    pub fn from_slice(bytes: &[u8]) -> Result<Self, SeaError> {
+        let fixed = SeaFixedHeader::parse(bytes)?;
+        let metadata = bytes
+            .get(Self::FIXED_SIZE..fixed.header_len())
+            .ok_or(SeaError::InvalidFile)?;
+        let metadata = String::from_utf8(metadata.to_vec()).map_err(|_| SeaError::InvalidFile)?;
+
+        Ok(Self {
+            version: fixed.version,
+            channels: fixed.channels,
+            chunk_size: fixed.chunk_size,
+            frames_per_chunk: fixed.frames_per_chunk,
+            sample_rate: fixed.sample_rate,
+            total_frames: fixed.total_frames,
+            metadata: Arc::new(metadata),
+        })
+    }
+
+    #[cfg(all(feature = "decoder", feature = "std"))]
+    pub fn from_reader<R: io::Read>(reader: &mut R) -> Result<Self, SeaError> {
+        let mut bytes = vec![0u8; Self::FIXED_SIZE];
+        reader.read_exact(&mut bytes)?;
+        let fixed = SeaFixedHeader::parse(&bytes)?;
+
+        bytes.resize(fixed.header_len(), 0);
+        reader.read_exact(&mut bytes[Self::FIXED_SIZE..])?;
+        Self::from_slice(&bytes)
+    }
+
+    #[cfg(feature = "decoder")]
     pub fn set_total_frames(&mut self, total_frames: u32) {
         self.total_frames = total_frames;
     }
 
+    #[cfg(feature = "encoder")]
     pub fn serialize(&self) -> Vec<u8> {
         let mut output = Vec::new();
 
@@ -93,75 +185,251 @@ impl SeaFileHeader {
     }
 }
 
+#[cfg(feature = "encoder")]
 enum ActiveEncoder {
     Cbr(CbrEncoder),
+    #[cfg(feature = "vbr")]
     Vbr(VbrEncoder),
 }
 
 pub struct SeaFile {
     pub header: SeaFileHeader,
 
+    #[cfg(feature = "decoder")]
     decoder: Option<Decoder>,
 
+    #[cfg(feature = "encoder")]
     encoder: Option<ActiveEncoder>,
+    #[cfg(feature = "encoder")]
     encoder_settings: Option<EncoderSettings>,
+
+    #[cfg(feature = "encoder")]
+    pub chunk_stats: Option<ChunkStats>,
+    pub stats: StatsRecorder,
 }
 
 impl SeaFile {
+    #[cfg(feature = "encoder")]
     pub fn new(
         header: SeaFileHeader,
         encoder_settings: &EncoderSettings,
     ) -> Result<Self, SeaError> {
-        let encoder = if encoder_settings.vbr {
-            let vbr_encoder = VbrEncoder::new(&header, &encoder_settings.clone());
-            Some(ActiveEncoder::Vbr(vbr_encoder))
-        } else {
-            let cbr_encoder = CbrEncoder::new(&header, &encoder_settings.clone());
-            Some(ActiveEncoder::Cbr(cbr_encoder))
+        Self::check_settings(&header, encoder_settings)?;
+
+        let encoder = match encoder_settings.vbr {
+            #[cfg(feature = "vbr")]
+            true => {
+                let vbr_encoder = VbrEncoder::new(&header, &encoder_settings.clone());
+                Some(ActiveEncoder::Vbr(vbr_encoder))
+            }
+            // built without the vbr feature
+            #[cfg(not(feature = "vbr"))]
+            true => return Err(SeaError::InvalidParameters),
+            false => {
+                let cbr_encoder = CbrEncoder::new(&header, &encoder_settings.clone());
+                Some(ActiveEncoder::Cbr(cbr_encoder))
+            }
         };
 
         Ok(SeaFile {
             header,
+            #[cfg(feature = "decoder")]
             decoder: None,
             encoder,
             encoder_settings: Some(encoder_settings.clone()),
+            chunk_stats: None,
+            stats: StatsRecorder::default(),
         })
     }
 
-    pub fn from_reader<R: io::Read>(mut reader: &mut R) -> Result<Self, SeaError> {
-        let header = SeaFileHeader::from_reader(&mut reader)?;
+    // Starts encoding a new file. The encoder of the previous file is reused, so only the tables
+    // that depend on changed settings are regenerated.
+    #[cfg(all(feature = "encoder", feature = "std"))]
+    pub fn reset_encoder(
+        &mut self,
+        header: SeaFileHeader,
+        encoder_settings: &EncoderSettings,
+    ) -> Result<(), SeaError> {
+        // nothing may fail once the encoder is taken, or the file is left without one
+        Self::check_settings(&header, encoder_settings)?;
+
+        let base_encoder = match self.encoder.take() {
+            Some(ActiveEncoder::Cbr(encoder)) => encoder.into_base(),
+            #[cfg(feature = "vbr")]
+            Some(ActiveEncoder::Vbr(encoder)) => encoder.into_base(),
+            None => {
+                *self = Self::new(header, encoder_settings)?;
+                return Ok(());
+            }
+        };
 
-        Ok(SeaFile {
+        let encoder = match encoder_settings.vbr {
+            #[cfg(feature = "vbr")]
+            true => ActiveEncoder::Vbr(VbrEncoder::with_base(
+                &header,
+                encoder_settings,
+                base_encoder,
+            )),
+            #[cfg(not(feature = "vbr"))]
+            true => unreachable!("rejected by check_settings"),
+            false => ActiveEncoder::Cbr(CbrEncoder::with_base(
+                &header,
+                encoder_settings,
+                base_encoder,
+            )),
+        };
+
+        self.header = header;
+        self.encoder = Some(encoder);
+        self.encoder_settings = Some(encoder_settings.clone());
+        self.chunk_stats = None;
+        self.stats = StatsRecorder::default();
+        Ok(())
+    }
+
+    // VBR needs the vbr feature. The enhancement layer takes residual sizes up to 8 bits. Settings
+    // whose chunks cannot fit the 16 bit chunk size of the header even with one bit residuals are
+    // rejected here, the size of VBR chunks is only known once they are encoded, see make_chunk.
+    // Channel bit offsets need one entry per channel and the VBR chunk layout, which the vbr
+    // feature provides. With CBR every channel's size has to fit into the four sizes a VBR chunk
+    // can store.
+    #[cfg(feature = "encoder")]
+    fn check_settings(
+        header: &SeaFileHeader,
+        encoder_settings: &EncoderSettings,
+    ) -> Result<(), SeaError> {
+        if (encoder_settings.vbr && cfg!(not(feature = "vbr")))
+            || encoder_settings.enhancement_bits > 8
+        {
+            return Err(SeaError::InvalidParameters);
+        }
+
+        let channels = header.channels as usize;
+        let samples = encoder_settings.frames_per_chunk as usize * channels;
+        let scale_factor_items = (encoder_settings.frames_per_chunk as usize)
+            .div_ceil(encoder_settings.scale_factor_frames as usize)
+            * channels;
+        let scale_factor_bytes =
+            (scale_factor_items * encoder_settings.scale_factor_bits as usize).div_ceil(8);
+        let mut min_chunk_size =
+            4 + channels * LMS_LEN * 4 + scale_factor_bytes + samples.div_ceil(8);
+        if encoder_settings.enhancement_bits > 0 {
+            min_chunk_size += 1
+                + scale_factor_bytes
+                + (samples * encoder_settings.enhancement_bits as usize).div_ceil(8);
+        }
+        if min_chunk_size > u16::MAX as usize {
+            return Err(SeaError::InvalidParameters);
+        }
+
+        let offsets = &encoder_settings.channel_bit_offsets;
+        if offsets.iter().all(|offset| *offset == 0) {
+            return Ok(());
+        }
+        if offsets.len() != header.channels as usize || cfg!(not(feature = "vbr")) {
+            return Err(SeaError::InvalidParameters);
+        }
+
+        if !encoder_settings.vbr {
+            let residual_bits = math::floorf(encoder_settings.residual_bits) as i32;
+            let smallest = residual_bits + *offsets.iter().min().unwrap() as i32;
+            let largest = residual_bits + *offsets.iter().max().unwrap() as i32;
+            if smallest < 1 || largest > 8 || largest - smallest > 3 {
+                return Err(SeaError::InvalidParameters);
+            }
+        }
+        Ok(())
+    }
+
+    #[cfg(all(feature = "decoder", feature = "std"))]
+    pub fn from_reader<R: io::Read>(reader: &mut R) -> Result<Self, SeaError> {
+        Ok(Self::from_header(SeaFileHeader::from_reader(reader)?))
+    }
+
+    #[cfg(feature = "decoder")]
+    pub fn from_header(header: SeaFileHeader) -> Self {
+        SeaFile {
             header,
             decoder: None,
+            #[cfg(feature = "encoder")]
             encoder: None,
+            #[cfg(feature = "encoder")]
             encoder_settings: None,
-        })
+            #[cfg(feature = "encoder")]
+            chunk_stats: None,
+            stats: StatsRecorder::default(),
+        }
     }
 
+    // Starts decoding a new file, the decoder of the previous file is kept for its tables
+    #[cfg(all(feature = "decoder", feature = "std"))]
+    pub fn reset_decoder(&mut self, header: SeaFileHeader) {
+        self.header = header;
+        self.stats = StatsRecorder::default();
+    }
+
+    #[cfg(feature = "encoder")]
     pub fn make_chunk(&mut self, samples: &[i16]) -> Result<Vec<u8>, SeaError> {
         let encoder_settings = self.encoder_settings.as_ref().unwrap();
         let encoder = self.encoder.as_mut().unwrap();
 
-        let initial_lms = match encoder {
-            ActiveEncoder::Cbr(encoder) => encoder.get_lms().clone(),
-            ActiveEncoder::Vbr(encoder) => encoder.get_lms().clone(),
-        };
-
         let encoded = match encoder {
             ActiveEncoder::Cbr(encoder) => encoder.encode(samples),
+            #[cfg(feature = "vbr")]
             ActiveEncoder::Vbr(encoder) => encoder.encode(samples),
         };
 
+        let mut scale_factor_histogram = vec![0u32; 1 << encoder_settings.scale_factor_bits];
+        for scale_factor in encoded.scale_factors.iter() {
+            scale_factor_histogram[*scale_factor as usize] += 1;
+        }
+
+        let mut residual_size_histogram = [0u32; 9];
+        if encoded.residual_bits.is_empty() {
+            residual_size_histogram[math::floorf(encoder_settings.residual_bits) as usize] =
+                encoded.scale_factors.len() as u32;
+        } else {
+            for residual_size in encoded.residual_bits.iter() {
+                residual_size_histogram[*residual_size as usize] += 1;
+            }
+        }
+
+        let frames = samples.len() / self.header.channels as usize;
+        let channels = encoded
+            .sse
+            .iter()
+            .map(|sse| ChannelQuality::new(*sse, frames))
+            .collect();
+
         let chunk = SeaChunk::new(
             &self.header,
-            &initial_lms,
+            &encoded.initial_lms,
             encoder_settings,
             encoded.scale_factors,
             encoded.residual_bits,
             encoded.residuals,
+        )
+        .with_enhancement(
+            encoder_settings,
+            encoded.enhancement_scale_factors,
+            encoded.enhancement_residuals,
         );
+        let stage_start = self.stats.start();
         let output = chunk.serialize();
+        self.stats.finish(Stage::Serialize, stage_start);
+        if output.len() > u16::MAX as usize {
+            return Err(SeaError::InvalidParameters);
+        }
+        self.stats.add_chunk();
+
+        self.chunk_stats = Some(ChunkStats {
+            frames,
+            bytes: output.len(),
+            bits_per_sample: (output.len() * 8) as f32 / samples.len() as f32,
+            channels,
+            scale_factor_histogram,
+            residual_size_histogram,
+        });
 
         if self.header.chunk_size == 0 {
             self.header.chunk_size = output.len() as u16;
@@ -177,6 +445,7 @@ impl SeaFile {
         Ok(output)
     }
 
+    #[cfg(all(feature = "decoder", feature = "std"))]
     pub fn samples_from_reader<R: io::Read>(
         &mut self,
         reader: &mut R,
@@ -186,25 +455,81 @@ impl SeaFile {
         if encoded.is_empty() {
             return Ok(None);
         }
+        self.stats.add_bytes_read(encoded.len());
 
-        let chunk = SeaChunk::from_slice(&encoded, &self.header, remaining_frames);
-
-        match chunk {
-            Ok(chunk) => {
-                if self.decoder.is_none() {
-                    self.decoder = Some(Decoder::init(
-                        self.header.channels as usize,
-                        chunk.scale_factor_bits as usize,
-                    ));
-                }
-                let decoder = self.decoder.as_mut().unwrap();
-                let decoded = match chunk.chunk_type {
-                    SeaChunkType::Cbr => decoder.decode_cbr(&chunk),
-                    SeaChunkType::Vbr => decoder.decode_vbr(&chunk),
-                };
-                Ok(Some(decoded))
-            }
-            Err(err) => Err(err),
+        let chunk = self.parse_chunk(&encoded, remaining_frames)?;
+        let mut samples = vec![0i16; chunk.residuals.len()];
+        self.decode_chunk(&chunk, &mut samples, None);
+        Ok(Some(samples))
+    }
+
+    // decodes a single chunk straight into the output, returns the number of samples written
+    #[cfg(feature = "decoder")]
+    pub fn samples_into<S: SeaSample>(
+        &mut self,
+        encoded: &[u8],
+        remaining_frames: Option<usize>,
+        output: &mut [S],
+        gain: Option<&mut SeaGain>,
+    ) -> Result<usize, SeaError> {
+        self.stats.add_bytes_read(encoded.len());
+
+        let chunk = self.parse_chunk(encoded, remaining_frames)?;
+        let samples = chunk.residuals.len();
+        if samples > output.len() {
+            return Err(SeaError::OutputTooSmall);
+        }
+
+        self.decode_chunk(&chunk, &mut output[..samples], gain);
+        Ok(samples)
+    }
+
+    #[cfg(feature = "decoder")]
+    fn parse_chunk(
+        &mut self,
+        encoded: &[u8],
+        remaining_frames: Option<usize>,
+    ) -> Result<SeaChunk, SeaError> {
+        let stage_start = self.stats.start();
+        let chunk = SeaChunk::from_slice(encoded, &self.header, remaining_frames)?;
+        self.stats.finish(Stage::Parse, stage_start);
+
+        let channels = self.header.channels as usize;
+        let scale_factor_bits = chunk.scale_factor_bits as usize;
+        match &mut self.decoder {
+            None => self.decoder = Some(Decoder::init(channels, scale_factor_bits)),
+            // e.g. kept from a previous file by reset_decoder()
+            Some(decoder) => decoder.reset(channels, scale_factor_bits),
+        }
+
+        Ok(chunk)
+    }
+
+    #[cfg(feature = "decoder")]
+    fn decode_chunk<S: SeaSample>(
+        &mut self,
+        chunk: &SeaChunk,
+        output: &mut [S],
+        gain: Option<&mut SeaGain>,
+    ) {
+        let decoder = self.decoder.as_ref().unwrap();
+        let stage_start = self.stats.start();
+        decoder.decode(chunk, output, gain);
+        self.stats.finish(Stage::Decode, stage_start);
+        self.stats.add_chunk();
+    }
+
+    #[cfg(feature = "stats")]
+    pub fn stats(&self) -> SeaStats {
+        let mut stats = SeaStats::default();
+        self.stats.merge_into(&mut stats);
+        #[cfg(feature = "encoder")]
+        match &self.encoder {
+            Some(ActiveEncoder::Cbr(encoder)) => encoder.get_stats().merge_into(&mut stats),
+            #[cfg(feature = "vbr")]
+            Some(ActiveEncoder::Vbr(encoder)) => encoder.get_stats().merge_into(&mut stats),
+            None => (),
         }
+        stats
     }
 }
@@ -1,6 +1,14 @@
+use alloc::{vec, vec::Vec};
+
+#[cfg(feature = "encoder")]
+use super::math;
+
+#[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+use core::arch::wasm32::*;
+
 pub const LMS_LEN: usize = 4;
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq)]
 pub struct SeaLMS {
     pub history: [i32; LMS_LEN],
     pub weights: [i32; LMS_LEN],
@@ -9,6 +17,7 @@ pub struct SeaLMS {
 const FLOATING_BITS: usize = 3;
 
 impl SeaLMS {
+    #[cfg(feature = "encoder")]
     pub fn new() -> Self {
         Self {
             history: [0; LMS_LEN],
@@ -16,20 +25,21 @@ impl SeaLMS {
         }
     }
 
+    // state at the start of a file
+    pub fn initial() -> Self {
+        let mut lms = SeaLMS {
+            history: [0; LMS_LEN],
+            weights: [0; LMS_LEN],
+        };
+        lms.weights[LMS_LEN - 2] = -(1 << (16 - FLOATING_BITS));
+        lms.weights[LMS_LEN - 1] = 1 << (17 - FLOATING_BITS);
+        lms
+    }
+
     pub fn init_vec(channels: u32) -> Vec<SeaLMS> {
-        let mut lms_vec = Vec::with_capacity(channels as usize);
-        for _ in 0..channels {
-            let mut lms = SeaLMS {
-                history: [0; LMS_LEN],
-                weights: [0; LMS_LEN],
-            };
-            lms.weights[LMS_LEN - 2] = -(1 << (16 - FLOATING_BITS));
-            lms.weights[LMS_LEN - 1] = 1 << (17 - FLOATING_BITS);
-
-            lms_vec.push(lms);
-        }
-        lms_vec
+        vec![Self::initial(); channels as usize]
     }
+    #[cfg(not(all(target_arch = "wasm32", target_feature = "simd128")))]
     pub fn predict(&self) -> i32 {
         let mut prediction: i32 = 0;
 
@@ -40,6 +50,7 @@ impl SeaLMS {
         prediction >> (16 - FLOATING_BITS)
     }
 
+    #[cfg(not(all(target_arch = "wasm32", target_feature = "simd128")))]
     pub fn update(&mut self, sample: i16, residual: i32) {
         let delta = residual >> (FLOATING_BITS + 1);
         for i in 0..LMS_LEN {
@@ -50,6 +61,8 @@ impl SeaLMS {
         self.history[LMS_LEN - 1] = sample as i32;
     }
 
+    #[cfg(not(all(target_arch = "wasm32", target_feature = "simd128")))]
+    #[cfg(feature = "encoder")]
     pub fn get_weights_penalty(&self) -> u64 {
         let mut sum: i64 = 0;
 
@@ -61,6 +74,65 @@ impl SeaLMS {
         (penalty.max(0) as u64).pow(2)
     }
 
+    // LMS_LEN equals the lane count of i32x4, so history and weights fit into a single vector each
+
+    #[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+    #[inline(always)]
+    pub fn predict(&self) -> i32 {
+        let products = i32x4_mul(self.weights_v128(), self.history_v128());
+        let sum = i32x4_add(products, i32x4_shuffle::<2, 3, 0, 1>(products, products));
+        let sum = i32x4_add(sum, i32x4_shuffle::<1, 0, 3, 2>(sum, sum));
+
+        i32x4_extract_lane::<0>(sum) >> (16 - FLOATING_BITS)
+    }
+
+    #[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+    #[inline(always)]
+    pub fn update(&mut self, sample: i16, residual: i32) {
+        let history = self.history_v128();
+        let delta = i32x4_splat(residual >> (FLOATING_BITS + 1));
+
+        // all ones for negative history, which turns delta into -delta
+        let sign = i32x4_shr(history, 31);
+        let step = i32x4_sub(v128_xor(delta, sign), sign);
+        let weights = i32x4_add(self.weights_v128(), step);
+
+        let history = i32x4_shuffle::<1, 2, 3, 4>(history, i32x4_splat(sample as i32));
+
+        unsafe {
+            v128_store(self.weights.as_mut_ptr() as *mut v128, weights);
+            v128_store(self.history.as_mut_ptr() as *mut v128, history);
+        }
+    }
+
+    #[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+    #[cfg(feature = "encoder")]
+    #[inline(always)]
+    pub fn get_weights_penalty(&self) -> u64 {
+        let weights = self.weights_v128();
+        let squares = i64x2_add(
+            i64x2_extmul_low_i32x4(weights, weights),
+            i64x2_extmul_high_i32x4(weights, weights),
+        );
+        let sum = i64x2_extract_lane::<0>(squares) + i64x2_extract_lane::<1>(squares);
+
+        let penalty = (sum >> 18) - 0x8ff;
+        (penalty.max(0) as u64).pow(2)
+    }
+
+    #[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+    #[inline(always)]
+    fn history_v128(&self) -> v128 {
+        unsafe { v128_load(self.history.as_ptr() as *const v128) }
+    }
+
+    #[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+    #[inline(always)]
+    fn weights_v128(&self) -> v128 {
+        unsafe { v128_load(self.weights.as_ptr() as *const v128) }
+    }
+
+    #[cfg(feature = "encoder")]
     pub fn serialize(&self) -> [u8; LMS_LEN * 4] {
         let mut output = [0u8; LMS_LEN * 4];
 
@@ -77,6 +149,60 @@ impl SeaLMS {
         output
     }
 
+    // Same history with the weights that predict the first `frames` samples of one channel best in
+    // the least squares sense, limited to what a chunk header can store
+    #[cfg(feature = "encoder")]
+    pub fn fitted(&self, samples: &[i16], channels: usize, frames: usize) -> Self {
+        let mut window = self.history.map(|sample| sample as f64);
+
+        // normal equations of the fit
+        let mut a = [[0f64; LMS_LEN + 1]; LMS_LEN];
+        for sample in samples.iter().step_by(channels).take(frames) {
+            let sample = *sample as f64;
+            for row in 0..LMS_LEN {
+                for column in 0..LMS_LEN {
+                    a[row][column] += window[row] * window[column];
+                }
+                a[row][LMS_LEN] += window[row] * sample;
+            }
+            window.copy_within(1.., 0);
+            window[LMS_LEN - 1] = sample;
+        }
+
+        // a little ridge keeps silent or constant openings solvable
+        let trace: f64 = (0..LMS_LEN).map(|i| a[i][i]).sum();
+        for (i, row) in a.iter_mut().enumerate() {
+            row[i] += trace * 1e-6 + 1.0;
+        }
+
+        // gaussian elimination with partial pivoting
+        for column in 0..LMS_LEN {
+            let pivot = (column..LMS_LEN)
+                .max_by(|x, y| a[*x][column].abs().total_cmp(&a[*y][column].abs()))
+                .unwrap();
+            a.swap(column, pivot);
+            for row in column + 1..LMS_LEN {
+                let factor = a[row][column] / a[column][column];
+                for k in column..=LMS_LEN {
+                    a[row][k] -= factor * a[column][k];
+                }
+            }
+        }
+        let mut solution = [0f64; LMS_LEN];
+        for row in (0..LMS_LEN).rev() {
+            let known: f64 = (row + 1..LMS_LEN).map(|k| a[row][k] * solution[k]).sum();
+            solution[row] = (a[row][LMS_LEN] - known) / a[row][row];
+        }
+
+        let mut lms = self.clone();
+        for (weight, solution) in lms.weights.iter_mut().zip(solution) {
+            let fixed = math::round(solution * (1 << (16 - FLOATING_BITS)) as f64);
+            *weight = fixed.clamp(i16::MIN as f64, i16::MAX as f64) as i32;
+        }
+        lms
+    }
+
+    #[cfg(feature = "decoder")]
     pub fn from_bytes(data: &[u8; LMS_LEN * 4]) -> Self {
         let mut history = [0i32; LMS_LEN];
         let mut weights = [0i32; LMS_LEN];
@@ -0,0 +1,54 @@
+// float functions that core does not have, from std or from libm when the libm feature is enabled
+
+#[cfg(not(any(
+    feature = "std",
+    feature = "libm",
+    all(target_arch = "wasm32", feature = "wasm-api")
+)))]
+compile_error!("no_std builds need the libm feature for float math");
+
+#[cfg(not(feature = "libm"))]
+mod imp {
+    #[inline(always)]
+    pub fn floorf(x: f32) -> f32 {
+        x.floor()
+    }
+
+    #[inline(always)]
+    pub fn roundf(x: f32) -> f32 {
+        x.round()
+    }
+
+    #[inline(always)]
+    pub fn powf(x: f32, y: f32) -> f32 {
+        x.powf(y)
+    }
+
+    #[cfg(feature = "encoder")]
+    #[inline(always)]
+    pub fn sqrt(x: f64) -> f64 {
+        x.sqrt()
+    }
+
+    #[cfg(feature = "encoder")]
+    #[inline(always)]
+    pub fn log10(x: f64) -> f64 {
+        x.log10()
+    }
+
+    #[cfg(feature = "encoder")]
+    #[inline(always)]
+    pub fn round(x: f64) -> f64 {
+        x.round()
+    }
+}
+
+#[cfg(feature = "libm")]
+mod imp {
+    pub use libm::{floorf, powf, roundf};
+
+    #[cfg(feature = "encoder")]
+    pub use libm::{log10, round, sqrt};
+}
+
+pub use imp::*;
@@ -1,11 +1,20 @@
-mod bits;
-mod chunk;
+pub mod bits;
+pub mod chunk;
 pub mod common;
-mod decoder;
-mod dqt;
+#[cfg(feature = "decoder")]
+pub mod decoder;
+pub mod dqt;
+#[cfg(feature = "encoder")]
 mod encoder_base;
+#[cfg(feature = "encoder")]
 mod encoder_cbr;
+#[cfg(all(feature = "encoder", feature = "vbr"))]
 mod encoder_vbr;
 pub mod file;
-mod lms;
+pub mod lms;
+pub mod math;
+#[cfg(feature = "encoder")]
 mod qt;
+#[cfg(all(feature = "encoder", feature = "decoder"))]
+pub mod repack;
+pub mod stats;
@@ -0,0 +1,352 @@
+use alloc::vec::Vec;
+use core::mem;
+
+use super::{
+    bits::BitUnpacker,
+    chunk::{SeaChunk, SeaChunkType},
+    common::{SeaError, SeaResidualSize},
+    decoder::Decoder,
+    file::SeaFileHeader,
+    lms::SeaLMS,
+};
+
+// Calls chunk_fn with every chunk of the file in order, all parsed into the same buffers
+fn for_each_chunk(
+    encoded: &[u8],
+    header: &SeaFileHeader,
+    mut chunk_fn: impl FnMut(&SeaChunk) -> Result<(), SeaError>,
+) -> Result<(), SeaError> {
+    let mut reader = encoded.get(header.size()..).ok_or(SeaError::InvalidFile)?;
+
+    let channels = header.channels as usize;
+    let total_frames = header.total_frames as usize;
+    let chunk_size = header.chunk_size as usize;
+    let mut chunk = SeaChunk::with_capacity(header);
+    let mut unpacker = BitUnpacker::new();
+    let mut frames_read = 0;
+
+    while !reader.is_empty() {
+        let remaining_frames = if total_frames > 0 {
+            if frames_read >= total_frames {
+                break;
+            }
+            Some(total_frames - frames_read)
+        } else {
+            None
+        };
+
+        let chunk_len = reader.len().min(chunk_size);
+        chunk.parse_into(
+            &reader[..chunk_len],
+            header,
+            remaining_frames,
+            &mut unpacker,
+        )?;
+        chunk_fn(&chunk)?;
+
+        frames_read += chunk.residuals.len() / channels;
+        reader = &reader[chunk_len..];
+    }
+
+    Ok(())
+}
+
+// The file of the given chunks. Chunks can differ in size after repacking, all but the last one
+// are padded with zeroes to the size of the largest.
+fn assemble(
+    mut header: SeaFileHeader,
+    chunks: &[Vec<u8>],
+    total_frames: usize,
+) -> Result<Vec<u8>, SeaError> {
+    let chunk_size = chunks.iter().map(Vec::len).max().unwrap_or(16);
+    header.chunk_size = u16::try_from(chunk_size).map_err(|_| SeaError::InvalidParameters)?;
+    header.total_frames = u32::try_from(total_frames).map_err(|_| SeaError::TooManyFrames)?;
+
+    let mut output = header.serialize();
+    for (index, chunk) in chunks.iter().enumerate() {
+        output.extend_from_slice(chunk);
+        if index + 1 < chunks.len() {
+            output.resize(output.len() + chunk_size - chunk.len(), 0);
+        }
+    }
+    Ok(output)
+}
+
+// Runs the LMS of every channel from start_frame to end_frame of the chunk, only the states are
+// needed, the samples go to scratch
+fn advance_lms(
+    decoder: &Decoder,
+    chunk: &SeaChunk,
+    lms: &mut [SeaLMS],
+    start_frame: usize,
+    end_frame: usize,
+    scratch: &mut Vec<i16>,
+) {
+    scratch.resize((end_frame - start_frame) * chunk.channels, 0);
+    decoder.decode_frames(chunk, lms, start_frame, scratch, None);
+}
+
+// chunk of the repacked file, collected scale factor group by group
+#[derive(Default)]
+struct PendingChunk {
+    channels: Vec<usize>, // input channels it takes, in order
+    frames: usize,
+    lms: Vec<SeaLMS>,
+
+    chunk_type: Option<SeaChunkType>,
+    scale_factor_bits: u8,
+    scale_factor_frames: u8,
+    residual_size: u8,
+    enhancement_size: u8,
+
+    scale_factors: Vec<u8>,
+    residual_sizes: Vec<u8>, // per group and channel, even for CBR chunks
+    residuals: Vec<u8>,
+    enhancement_scale_factors: Vec<u8>,
+    enhancement_residuals: Vec<u8>,
+}
+
+impl PendingChunk {
+    fn new(channels: Vec<usize>) -> Self {
+        PendingChunk {
+            channels,
+            ..Default::default()
+        }
+    }
+
+    // lms holds the state of every input channel at the first frame of the new chunk
+    fn start(&mut self, chunk: &SeaChunk, lms: &[SeaLMS]) {
+        self.lms = self
+            .channels
+            .iter()
+            .map(|channel| lms[*channel].clone())
+            .collect();
+        self.chunk_type = Some(chunk.chunk_type);
+        self.scale_factor_bits = chunk.scale_factor_bits;
+        self.scale_factor_frames = chunk.scale_factor_frames;
+        self.residual_size = chunk.residual_size as u8;
+        self.enhancement_size = chunk.enhancement_size;
+    }
+
+    // whether the groups of the chunk can follow the ones collected so far
+    fn continues_with(&self, chunk: &SeaChunk) -> bool {
+        self.scale_factor_bits == chunk.scale_factor_bits
+            && self.scale_factor_frames == chunk.scale_factor_frames
+            && self.enhancement_size == chunk.enhancement_size
+    }
+
+    fn push_group(&mut self, chunk: &SeaChunk, group: usize) {
+        let scale_factor_frames = chunk.scale_factor_frames as usize;
+        let frames = chunk.residuals.len() / chunk.channels;
+        let group_frames = (frames - group * scale_factor_frames).min(scale_factor_frames);
+
+        if matches!(chunk.chunk_type, SeaChunkType::Vbr) {
+            self.chunk_type = Some(SeaChunkType::Vbr);
+        }
+        let item = group * chunk.channels;
+        for channel in self.channels.iter().map(|channel| item + channel) {
+            self.scale_factors.push(chunk.scale_factors[channel]);
+            self.residual_sizes.push(match chunk.chunk_type {
+                SeaChunkType::Cbr => chunk.residual_size as u8,
+                SeaChunkType::Vbr => chunk.vbr_residual_sizes[channel],
+            });
+            if chunk.enhancement_size > 0 {
+                self.enhancement_scale_factors
+                    .push(chunk.enhancement_scale_factors[channel]);
+            }
+        }
+
+        let first_frame = group * scale_factor_frames;
+        for frame in first_frame..first_frame + group_frames {
+            for sample in self
+                .channels
+                .iter()
+                .map(|channel| frame * chunk.channels + channel)
+            {
+                self.residuals.push(chunk.residuals[sample]);
+                if chunk.enhancement_size > 0 {
+                    self.enhancement_residuals
+                        .push(chunk.enhancement_residuals[sample]);
+                }
+            }
+        }
+        self.frames += group_frames;
+    }
+
+    // Serializes the collected groups and starts over. Fails if the residual sizes do not fit into
+    // one chunk or if a chunk header cannot store the LMS state.
+    fn finish(&mut self, header: &SeaFileHeader) -> Result<Vec<u8>, SeaError> {
+        let smallest = *self.residual_sizes.iter().min().unwrap();
+        let largest = *self.residual_sizes.iter().max().unwrap();
+
+        // VBR sizes are stored relative to the base, from one below it to two above it
+        let mut residual_size = self.residual_size;
+        let mut vbr_residual_sizes = mem::take(&mut self.residual_sizes);
+        let chunk_type = match self.chunk_type.take().unwrap() {
+            SeaChunkType::Cbr if smallest == largest => {
+                residual_size = smallest;
+                vbr_residual_sizes.clear();
+                SeaChunkType::Cbr
+            }
+            _ => {
+                if largest - smallest > 3 {
+                    return Err(SeaError::InvalidParameters);
+                }
+                if smallest + 1 < residual_size || largest > residual_size + 2 {
+                    residual_size = (smallest + 1).min(8);
+                }
+                SeaChunkType::Vbr
+            }
+        };
+
+        // headers store the LMS state in 16 bits
+        let lms = mem::take(&mut self.lms);
+        if lms
+            .iter()
+            .any(|lms| SeaLMS::from_bytes(&lms.serialize()) != *lms)
+        {
+            return Err(SeaError::InvalidParameters);
+        }
+
+        let chunk = SeaChunk {
+            channels: header.channels as usize,
+            frames_per_chunk: header.frames_per_chunk as usize,
+
+            chunk_type,
+            scale_factor_bits: self.scale_factor_bits,
+            scale_factor_frames: self.scale_factor_frames,
+            residual_size: SeaResidualSize::from(residual_size),
+
+            lms,
+            scale_factors: mem::take(&mut self.scale_factors),
+            vbr_residual_sizes,
+            residuals: mem::take(&mut self.residuals),
+
+            enhancement_size: self.enhancement_size,
+            enhancement_scale_factors: mem::take(&mut self.enhancement_scale_factors),
+            enhancement_residuals: mem::take(&mut self.enhancement_residuals),
+
+            base_len: 0,
+        };
+        self.frames = 0;
+        Ok(chunk.serialize())
+    }
+}
+
+// Moves the chunk boundaries to every frames_per_chunk frames, see sea_rechunk(). A new chunk
+// starts with the LMS state the decoder has at its first frame, which is only decoded where a new
+// boundary falls inside an input chunk. Where a new chunk spans the boundary of two input chunks,
+// decoders carry the LMS state over it, so the second input chunk has to start with that state.
+pub fn rechunk(encoded: &[u8], frames_per_chunk: u16) -> Result<Vec<u8>, SeaError> {
+    let header = SeaFileHeader::from_slice(encoded)?;
+    let channels = header.channels as usize;
+    let new_header = SeaFileHeader {
+        frames_per_chunk,
+        ..header.clone()
+    };
+    let frames_per_chunk = frames_per_chunk as usize;
+
+    let mut decoder: Option<Decoder> = None;
+    let mut scratch = Vec::new();
+    let mut pending = PendingChunk::new((0..channels).collect());
+    let mut carried_lms = Vec::new(); // at the end of the previous input chunk
+    let mut chunks = Vec::new();
+    let mut total_frames = 0;
+
+    for_each_chunk(encoded, &header, |chunk| {
+        let scale_factor_frames = chunk.scale_factor_frames as usize;
+        if frames_per_chunk == 0 || !frames_per_chunk.is_multiple_of(scale_factor_frames) {
+            return Err(SeaError::InvalidParameters);
+        }
+        if pending.frames > 0 && (!pending.continues_with(chunk) || carried_lms != chunk.lms) {
+            return Err(SeaError::InvalidParameters);
+        }
+
+        let scale_factor_bits = chunk.scale_factor_bits as usize;
+        let decoder = match &mut decoder {
+            Some(decoder) => {
+                decoder.reset(channels, scale_factor_bits);
+                decoder
+            }
+            None => decoder.insert(Decoder::init(channels, scale_factor_bits)),
+        };
+
+        let frames = chunk.residuals.len() / channels;
+        let mut lms = chunk.lms.clone();
+        let mut decoded_frames = 0;
+        for group_start in (0..frames).step_by(scale_factor_frames) {
+            if pending.frames == 0 {
+                advance_lms(
+                    decoder,
+                    chunk,
+                    &mut lms,
+                    decoded_frames,
+                    group_start,
+                    &mut scratch,
+                );
+                decoded_frames = group_start;
+                pending.start(chunk, &lms);
+            }
+
+            pending.push_group(chunk, group_start / scale_factor_frames);
+            if pending.frames == frames_per_chunk {
+                chunks.push(pending.finish(&new_header)?);
+            }
+        }
+
+        // the new chunk continues into the next input chunk
+        if pending.frames > 0 {
+            advance_lms(
+                decoder,
+                chunk,
+                &mut lms,
+                decoded_frames,
+                frames,
+                &mut scratch,
+            );
+            carried_lms = lms;
+        }
+        total_frames += frames;
+        Ok(())
+    })?;
+
+    if pending.frames > 0 {
+        chunks.push(pending.finish(&new_header)?);
+    }
+    assemble(new_header, &chunks, total_frames)
+}
+
+// Keeps the given input channels in the given order, see sea_extract_channels(). Every channel is
+// stored independently in a chunk, so nothing has to be decoded.
+pub fn extract_channels(encoded: &[u8], channels: &[usize]) -> Result<Vec<u8>, SeaError> {
+    let header = SeaFileHeader::from_slice(encoded)?;
+    let valid = !channels.is_empty()
+        && channels.len() <= u8::MAX as usize
+        && channels
+            .iter()
+            .all(|channel| *channel < header.channels as usize);
+    if !valid {
+        return Err(SeaError::InvalidParameters);
+    }
+    let new_header = SeaFileHeader {
+        channels: channels.len() as u8,
+        ..header.clone()
+    };
+
+    let mut pending = PendingChunk::new(channels.to_vec());
+    let mut chunks = Vec::new();
+    let mut total_frames = 0;
+
+    for_each_chunk(encoded, &header, |chunk| {
+        pending.start(chunk, &chunk.lms);
+        let groups = chunk.scale_factors.len() / chunk.channels;
+        for group in 0..groups {
+            pending.push_group(chunk, group);
+        }
+        total_frames += pending.frames;
+        chunks.push(pending.finish(&new_header)?);
+        Ok(())
+    })?;
+
+    assemble(new_header, &chunks, total_frames)
+}
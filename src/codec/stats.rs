@@ -0,0 +1,163 @@
+// Instrumentation of the codec internals, only collected with the "stats" feature.
+// Without the feature StatsRecorder is a zero sized type and every method compiles to nothing.
+
+#[cfg(feature = "stats")]
+use std::{
+    cell::Cell,
+    time::{Duration, Instant},
+};
+
+// encoder and decoder stages, a build with only one side never records the others
+#[allow(dead_code)]
+#[derive(Debug, Clone, Copy)]
+pub enum Stage {
+    Analyze = 0,
+    Residuals = 1,
+    Serialize = 2,
+    Parse = 3,
+    Decode = 4,
+}
+
+#[cfg(feature = "stats")]
+const STAGES: usize = 5;
+
+// stage timers can overlap: VBR analysis runs residual searches as well
+#[cfg(feature = "stats")]
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct SeaStats {
+    pub analyze_time: Duration,
+    pub residuals_time: Duration,
+    pub serialize_time: Duration,
+    pub parse_time: Duration,
+    pub decode_time: Duration,
+
+    pub chunks: u64,
+    pub scale_factor_candidates: u64,
+    pub early_exits: u64,
+    pub clamp_events: u64,
+    pub bytes_read: u64,
+    pub bytes_written: u64,
+}
+
+#[cfg(feature = "stats")]
+#[derive(Default)]
+pub struct StatsRecorder {
+    stage_nanos: [Cell<u64>; STAGES],
+    chunks: Cell<u64>,
+    scale_factor_candidates: Cell<u64>,
+    early_exits: Cell<u64>,
+    clamp_events: Cell<u64>,
+    bytes_read: Cell<u64>,
+    bytes_written: Cell<u64>,
+}
+
+#[cfg(feature = "stats")]
+pub type StageStart = Instant;
+
+#[cfg(feature = "stats")]
+#[inline(always)]
+fn add(cell: &Cell<u64>, value: u64) {
+    cell.set(cell.get() + value);
+}
+
+#[cfg(feature = "stats")]
+#[allow(dead_code)]
+impl StatsRecorder {
+    #[inline(always)]
+    pub fn start(&self) -> StageStart {
+        Instant::now()
+    }
+
+    #[inline(always)]
+    pub fn finish(&self, stage: Stage, start: StageStart) {
+        add(
+            &self.stage_nanos[stage as usize],
+            start.elapsed().as_nanos() as u64,
+        );
+    }
+
+    #[inline(always)]
+    pub fn add_chunk(&self) {
+        add(&self.chunks, 1);
+    }
+
+    #[inline(always)]
+    pub fn add_scale_factor_candidates(&self, count: u64) {
+        add(&self.scale_factor_candidates, count);
+    }
+
+    #[inline(always)]
+    pub fn add_early_exit(&self) {
+        add(&self.early_exits, 1);
+    }
+
+    #[inline(always)]
+    pub fn add_clamp_event(&self) {
+        add(&self.clamp_events, 1);
+    }
+
+    #[inline(always)]
+    pub fn add_bytes_read(&self, bytes: usize) {
+        add(&self.bytes_read, bytes as u64);
+    }
+
+    #[inline(always)]
+    pub fn add_bytes_written(&self, bytes: usize) {
+        add(&self.bytes_written, bytes as u64);
+    }
+
+    pub fn merge_into(&self, stats: &mut SeaStats) {
+        let nanos = |stage: Stage| Duration::from_nanos(self.stage_nanos[stage as usize].get());
+
+        stats.analyze_time += nanos(Stage::Analyze);
+        stats.residuals_time += nanos(Stage::Residuals);
+        stats.serialize_time += nanos(Stage::Serialize);
+        stats.parse_time += nanos(Stage::Parse);
+        stats.decode_time += nanos(Stage::Decode);
+
+        stats.chunks += self.chunks.get();
+        stats.scale_factor_candidates += self.scale_factor_candidates.get();
+        stats.early_exits += self.early_exits.get();
+        stats.clamp_events += self.clamp_events.get();
+        stats.bytes_read += self.bytes_read.get();
+        stats.bytes_written += self.bytes_written.get();
+    }
+}
+
+#[cfg(not(feature = "stats"))]
+#[derive(Default)]
+pub struct StatsRecorder {}
+
+#[cfg(not(feature = "stats"))]
+#[derive(Clone, Copy)]
+pub struct StageStart;
+
+#[cfg(not(feature = "stats"))]
+#[allow(dead_code)]
+impl StatsRecorder {
+    #[inline(always)]
+    pub fn start(&self) -> StageStart {
+        StageStart
+    }
+
+    #[inline(always)]
+    pub fn finish(&self, _stage: Stage, _start: StageStart) {}
+
+    #[inline(always)]
+    pub fn add_chunk(&self) {}
+
+    #[inline(always)]
+    pub fn add_scale_factor_candidates(&self, _count: u64) {}
+
+    #[inline(always)]
+    pub fn add_early_exit(&self) {}
+
+    #[inline(always)]
+    pub fn add_clamp_event(&self) {}
+
+    #[inline(always)]
+    pub fn add_bytes_read(&self, _bytes: usize) {}
+
+    #[inline(always)]
+    pub fn add_bytes_written(&self, _bytes: usize) {}
+}
@@ -7,6 +7,9 @@ use crate::codec::{
     file::{SeaFile, SeaFileHeader},
 };
 
+#[cfg(feature = "stats")]
+use crate::codec::stats::SeaStats;
+
 pub struct SeaDecoder<R, W> {
     reader: R,
     writer: W,
@@ -30,6 +33,15 @@ where
         })
     }
 
+    // Decodes a new file from reader into the same writer, the tables of this decoder are kept
+    pub fn reset(&mut self, mut reader: R) -> Result<(), SeaError> {
+        let header = SeaFileHeader::from_reader(&mut reader)?;
+        self.file.reset_decoder(header);
+        self.reader = reader;
+        self.frames_read = 0;
+        Ok(())
+    }
+
     pub fn decode_frame(&mut self) -> Result<bool, SeaError> {
         if self.file.header.total_frames != 0
             && (self.file.header.total_frames as usize) <= self.frames_read
@@ -52,6 +64,7 @@ where
                 self.frames_read += samples.len() / self.file.header.channels as usize;
                 let samples_u8: &[u8] = cast_slice(&samples);
                 self.writer.write_all(samples_u8)?;
+                self.file.stats.add_bytes_written(samples_u8.len());
                 Ok(true)
             }
             None => Ok(false),
@@ -70,4 +83,9 @@ where
     pub fn get_header(&self) -> SeaFileHeader {
         self.file.header.clone()
     }
+
+    #[cfg(feature = "stats")]
+    pub fn stats(&self) -> SeaStats {
+        self.file.stats()
+    }
 }
@@ -1,12 +1,23 @@
-use std::{io, rc::Rc};
+#[cfg(feature = "std")]
+use std::{io, sync::Arc};
 
+use alloc::vec::Vec;
+
+#[cfg(feature = "std")]
 use bytemuck::cast_slice;
 
+#[cfg(feature = "std")]
 use crate::codec::{
     common::{read_max_or_zero, SeaError},
     file::{SeaFile, SeaFileHeader},
 };
 
+#[cfg(all(feature = "std", feature = "stats"))]
+use crate::codec::stats::SeaStats;
+
+use crate::codec::math;
+
+#[cfg(feature = "std")]
 pub enum SeaEncoderState {
     Start,
     WritingFrames,
@@ -20,6 +31,20 @@ pub struct EncoderSettings {
     pub residual_bits: f32, // 1-8
     pub frames_per_chunk: u16,
     pub vbr: bool,
+    // 0 quantizes every residual to the nearest code, 1-3 search rate-distortion optimized codes
+    // with growing beams, which is slower to encode but gives a higher quality at the same bitrate
+    pub effort: u8,
+    // start every chunk with the LMS weights that predict it best instead of the weights the
+    // previous chunk ended with, decoders read them from the chunk header either way
+    pub optimize_lms: bool,
+    // Residual bits added to or taken from each channel, e.g. -2 for an LFE channel. Empty for
+    // none, otherwise one per channel. CBR files with offsets use the VBR chunk layout, which
+    // stores a residual size per channel, so every size has to be within 3 bits of the others.
+    pub channel_bit_offsets: Vec<i8>,
+    // 1-8 adds an enhancement layer with this residual size after the base layer of every chunk,
+    // 0 for none. It refines what the base layer leaves of each sample, and the base decodes
+    // without it, see sea_drop_enhancement().
+    pub enhancement_bits: u8,
 }
 
 impl Default for EncoderSettings {
@@ -30,10 +55,70 @@ impl Default for EncoderSettings {
             scale_factor_frames: 20,
             residual_bits: 3.0,
             vbr: false,
+            effort: 0,
+            optimize_lms: false,
+            channel_bit_offsets: Vec::new(),
+            enhancement_bits: 0,
         }
     }
 }
 
+#[derive(Debug, Clone, PartialEq)]
+pub struct ChannelQuality {
+    pub sse: u64,  // sum of squared reconstruction errors
+    pub psnr: f64, // negated PSNR in dB, lower is better
+}
+
+// quality and bitrate of a single encoded chunk, collected from the encoder's own search
+#[derive(Debug, Clone, PartialEq)]
+pub struct ChunkStats {
+    pub frames: usize,
+    pub bytes: usize,
+    pub bits_per_sample: f32,
+    pub channels: Vec<ChannelQuality>,
+    pub scale_factor_histogram: Vec<u32>, // indexed by scale factor
+    pub residual_size_histogram: [u32; 9], // scale factor groups per residual size
+}
+
+// Quality every channel of every chunk has to reach in sea_encode_quality()
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum QualityTarget {
+    // Highest PSNR in dB in the convention of ChannelQuality: the negated PSNR, so lower is better
+    // and targets are negative. Psnr(-30.0) asks for a conventional PSNR of at least 30 dB.
+    Psnr(f64),
+    // highest root mean square error relative to full scale
+    Rms(f64),
+}
+
+impl QualityTarget {
+    pub fn reached(&self, quality: &ChannelQuality) -> bool {
+        let max_psnr = match *self {
+            QualityTarget::Psnr(psnr) => psnr,
+            QualityTarget::Rms(rms) => -20.0 * math::log10(2.0 / rms),
+        };
+        quality.psnr <= max_psnr
+    }
+}
+
+// result of sea_encode_quality()
+pub struct QualityEncoded {
+    pub encoded: Vec<u8>,
+    pub settings: EncoderSettings, // with the chosen residual_bits
+    pub target_reached: bool,
+}
+
+impl ChannelQuality {
+    pub fn new(sse: u64, frames: usize) -> Self {
+        // same convention as the PSNR reported by the test helpers and the web demo
+        let rms = math::sqrt(sse as f64 / frames.max(1) as f64) / i16::MAX as f64;
+        ChannelQuality {
+            sse,
+            psnr: -20.0 * math::log10(2.0 / rms),
+        }
+    }
+}
+
+#[cfg(feature = "std")]
 pub struct SeaEncoder<R, W> {
     reader: R,
     writer: W,
@@ -42,6 +127,7 @@ pub struct SeaEncoder<R, W> {
     written_frames: u32,
 }
 
+#[cfg(feature = "std")]
 impl<R, W> SeaEncoder<R, W>
 where
     R: io::Read,
@@ -53,36 +139,69 @@ where
         total_frames: Option<u32>,
         settings: EncoderSettings,
         reader: R,
-        mut writer: W,
+        writer: W,
     ) -> Result<Self, SeaError> {
-        let header = SeaFileHeader {
+        let header = Self::file_header(channels, sample_rate, total_frames, &settings);
+        let file = SeaFile::new(header, &settings)?;
+
+        let mut encoder = SeaEncoder {
+            file,
+            state: SeaEncoderState::Start,
+            reader,
+            writer,
+            written_frames: 0,
+        };
+        encoder.start(total_frames)?;
+        Ok(encoder)
+    }
+
+    // Encodes a new file with the same arguments as new(), but keeps the tables and buffers of this
+    // encoder. The previous file should be finished, its reader and writer are dropped.
+    pub fn reset(
+        &mut self,
+        channels: u8,
+        sample_rate: u32,
+        total_frames: Option<u32>,
+        settings: EncoderSettings,
+        reader: R,
+        writer: W,
+    ) -> Result<(), SeaError> {
+        let header = Self::file_header(channels, sample_rate, total_frames, &settings);
+        self.file.reset_encoder(header, &settings)?;
+
+        self.state = SeaEncoderState::Start;
+        self.reader = reader;
+        self.writer = writer;
+        self.written_frames = 0;
+        self.start(total_frames)
+    }
+
+    fn file_header(
+        channels: u8,
+        sample_rate: u32,
+        total_frames: Option<u32>,
+        settings: &EncoderSettings,
+    ) -> SeaFileHeader {
+        SeaFileHeader {
             version: 1,
             channels,
             chunk_size: 0, // will be set later by the first chunk
             frames_per_chunk: settings.frames_per_chunk,
             sample_rate,
             total_frames: total_frames.unwrap_or(0),
-            metadata: Rc::new(String::new()),
-        };
-
-        let file = SeaFile::new(header, &settings)?;
-
-        let mut state = SeaEncoderState::Start;
-
-        if let Some(total_frames) = total_frames {
-            if total_frames == 0 {
-                writer.write_all(&file.header.serialize())?;
-                state = SeaEncoderState::WritingFrames;
-            }
+            metadata: Arc::new(String::new()),
         }
+    }
 
-        Ok(SeaEncoder {
-            file,
-            state,
-            reader,
-            writer,
-            written_frames: 0,
-        })
+    // a file without frames has no first chunk to write the header after
+    fn start(&mut self, total_frames: Option<u32>) -> Result<(), SeaError> {
+        if total_frames == Some(0) {
+            let header = self.file.header.serialize();
+            self.writer.write_all(&header)?;
+            self.file.stats.add_bytes_written(header.len());
+            self.state = SeaEncoderState::WritingFrames;
+        }
+        Ok(())
     }
 
     fn read_samples(&mut self, max_sample_count: usize) -> Result<Vec<i16>, SeaError> {
@@ -92,6 +211,7 @@ where
         if buffer.is_empty() {
             return Ok(Vec::new());
         }
+        self.file.stats.add_bytes_read(buffer.len());
 
         if buffer.len() % (std::mem::size_of::<i16>() * self.file.header.channels as usize) != 0 {
             return Err(SeaError::IoError(io::Error::from(
@@ -133,11 +253,14 @@ where
 
             // we need to write file header after the first chunk is generated
             if matches!(self.state, SeaEncoderState::Start) {
-                self.writer.write_all(&self.file.header.serialize())?;
+                let header = self.file.header.serialize();
+                self.writer.write_all(&header)?;
+                self.file.stats.add_bytes_written(header.len());
                 self.state = SeaEncoderState::WritingFrames;
             }
 
             self.writer.write_all(&encoded_chunk)?;
+            self.file.stats.add_bytes_written(encoded_chunk.len());
             self.written_frames += frames as u32;
         }
 
@@ -157,4 +280,14 @@ where
         self.state = SeaEncoderState::Finished;
         Ok(())
     }
+
+    // stats of the most recently encoded chunk
+    pub fn chunk_stats(&self) -> Option<&ChunkStats> {
+        self.file.chunk_stats.as_ref()
+    }
+
+    #[cfg(feature = "stats")]
+    pub fn stats(&self) -> SeaStats {
+        self.file.stats()
+    }
 }
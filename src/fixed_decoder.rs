@@ -0,0 +1,248 @@
+use crate::{
+    codec::{
+        bits::SliceBitReader,
+        chunk::LAYERED_CHUNK,
+        common::{clamp_i16, SeaError},
+        dqt::SeaDequantTab,
+        file::SeaFixedHeader,
+        lms::{SeaLMS, LMS_LEN},
+        math,
+    },
+    sample::SeaSample,
+};
+
+const EMPTY_LMS: SeaLMS = SeaLMS {
+    history: [0; LMS_LEN],
+    weights: [0; LMS_LEN],
+};
+
+// Decoder that never allocates, for targets without a heap. Its state is sized by CHANNELS, the
+// most channels a file may have, and new() is const so it can be placed in a static.
+// Chunks are decoded straight from their bytes, the dequantized values of the current scale factor
+// of each channel are computed on demand instead of keeping the whole table.
+pub struct SeaFixedDecoder<const CHANNELS: usize> {
+    header: SeaFixedHeader,
+    frames_read: usize,
+
+    lms: [SeaLMS; CHANNELS],
+    residual_sizes: [u8; CHANNELS],
+    dequant_keys: [u32; CHANNELS], // scale factor bits, residual size and scale factor of the row
+    dequant_rows: [[i32; 256]; CHANNELS],
+}
+
+impl<const CHANNELS: usize> Default for SeaFixedDecoder<CHANNELS> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<const CHANNELS: usize> SeaFixedDecoder<CHANNELS> {
+    pub const fn new() -> Self {
+        Self {
+            header: SeaFixedHeader::EMPTY,
+            frames_read: 0,
+
+            lms: [EMPTY_LMS; CHANNELS],
+            residual_sizes: [0; CHANNELS],
+            dequant_keys: [0; CHANNELS],
+            dequant_rows: [[0; 256]; CHANNELS],
+        }
+    }
+
+    // Starts a new file, prefix has to hold the first 22 bytes of it. Returns the length of the
+    // whole header, the first chunk starts after the metadata. Files with more than CHANNELS
+    // channels are rejected with InvalidParameters.
+    pub fn init(&mut self, prefix: &[u8]) -> Result<usize, SeaError> {
+        let header = SeaFixedHeader::parse(prefix)?;
+        if header.channels as usize > CHANNELS {
+            return Err(SeaError::InvalidParameters);
+        }
+
+        self.header = header;
+        self.frames_read = 0;
+        self.dequant_keys = [0; CHANNELS];
+        Ok(header.header_len())
+    }
+
+    pub fn channels(&self) -> usize {
+        self.header.channels as usize
+    }
+
+    pub fn sample_rate(&self) -> u32 {
+        self.header.sample_rate
+    }
+
+    pub fn chunk_size(&self) -> usize {
+        self.header.chunk_size as usize
+    }
+
+    pub fn frames_per_chunk(&self) -> usize {
+        self.header.frames_per_chunk as usize
+    }
+
+    // 0 for streaming files
+    pub fn total_frames(&self) -> u32 {
+        self.header.total_frames
+    }
+
+    // Decodes a chunk of chunk_size() bytes into interleaved samples, only the last chunk of a file
+    // with known total_frames can be shorter. The output has to hold frames_per_chunk() * channels()
+    // samples. Returns the number of samples written, 0 once every frame of the file was decoded.
+    // Only the base layer of layered chunks is decoded, the enhancement layer is skipped.
+    pub fn decode_chunk<S: SeaSample>(
+        &mut self,
+        chunk: &[u8],
+        output: &mut [S],
+    ) -> Result<usize, SeaError> {
+        let channels = self.header.channels as usize;
+        let chunk_size = self.header.chunk_size as usize;
+        if channels == 0 {
+            return Err(SeaError::InvalidFile);
+        }
+
+        let total_frames = self.header.total_frames as usize;
+        let frames = if total_frames > 0 {
+            if self.frames_read >= total_frames {
+                return Ok(0);
+            }
+            (total_frames - self.frames_read).min(self.header.frames_per_chunk as usize)
+        } else {
+            // we cannot calculate last frame size in streaming mode
+            if chunk.len() != chunk_size {
+                return Err(SeaError::InvalidFrame);
+            }
+            self.header.frames_per_chunk as usize
+        };
+
+        let mut offset = 4 + channels * LMS_LEN * 4;
+        if chunk.len() > chunk_size || chunk.len() < offset {
+            return Err(SeaError::InvalidFrame);
+        }
+
+        let is_vbr = match chunk[0] & !LAYERED_CHUNK {
+            0x01 => false,
+            #[cfg(feature = "vbr")]
+            0x02 => true,
+            _ => return Err(SeaError::InvalidFrame),
+        };
+        let scale_factor_bits = chunk[1] >> 4;
+        let residual_size = chunk[1] & 0b1111;
+        let scale_factor_frames = chunk[2] as usize;
+        if !(1..=8).contains(&scale_factor_bits)
+            || !(1..=8).contains(&residual_size)
+            || scale_factor_frames == 0
+        {
+            return Err(SeaError::InvalidFrame);
+        }
+
+        let samples = frames * channels;
+        if output.len() < samples {
+            return Err(SeaError::OutputTooSmall);
+        }
+
+        for (lms, data) in self.lms[..channels]
+            .iter_mut()
+            .zip(chunk[4..offset].chunks_exact(LMS_LEN * 4))
+        {
+            *lms = SeaLMS::from_bytes(data.try_into().unwrap());
+        }
+
+        let groups = frames.div_ceil(scale_factor_frames);
+        let scale_factor_bytes = (groups * channels * scale_factor_bits as usize).div_ceil(8);
+        let scale_factors = section(chunk, &mut offset, scale_factor_bytes)?;
+
+        let (vbr_residual_sizes, residual_bits) = if is_vbr {
+            let vbr_residual_sizes =
+                section(chunk, &mut offset, (groups * channels * 2).div_ceil(8))?;
+
+            // every size is checked before decoding, the sum gives the length of the residuals
+            let mut reader = SliceBitReader::new(vbr_residual_sizes);
+            let mut residual_bits = 0;
+            for group in 0..groups {
+                let group_frames = (frames - group * scale_factor_frames).min(scale_factor_frames);
+                for _ in 0..channels {
+                    let size = residual_size - 1 + reader.read(2);
+                    if !(1..=8).contains(&size) {
+                        return Err(SeaError::InvalidFrame);
+                    }
+                    residual_bits += size as usize * group_frames;
+                }
+            }
+            (vbr_residual_sizes, residual_bits)
+        } else {
+            (&[][..], samples * residual_size as usize)
+        };
+        let residuals = section(chunk, &mut offset, residual_bits.div_ceil(8))?;
+
+        let mut scale_factor_reader = SliceBitReader::new(scale_factors);
+        let mut vbr_residual_size_reader = SliceBitReader::new(vbr_residual_sizes);
+        let mut residual_reader = SliceBitReader::new(residuals);
+
+        for group_output in output[..samples].chunks_mut(scale_factor_frames * channels) {
+            for channel in 0..channels {
+                let scale_factor = scale_factor_reader.read(scale_factor_bits);
+                let size = if is_vbr {
+                    residual_size - 1 + vbr_residual_size_reader.read(2)
+                } else {
+                    residual_size
+                };
+                self.load_dequant_row(channel, scale_factor_bits, size, scale_factor);
+            }
+
+            for frame in group_output.chunks_exact_mut(channels) {
+                for (channel, sample) in frame.iter_mut().enumerate() {
+                    let quantized = residual_reader.read(self.residual_sizes[channel]);
+                    let dequantized = self.dequant_rows[channel][quantized as usize];
+                    let lms = &mut self.lms[channel];
+                    let reconstructed = clamp_i16(lms.predict() + dequantized);
+                    lms.update(reconstructed, dequantized);
+                    *sample = S::from_i16(reconstructed);
+                }
+            }
+        }
+
+        self.frames_read += frames;
+        Ok(samples)
+    }
+
+    // same values as the row of SeaDequantTab, only recomputed when the scale factor changes
+    fn load_dequant_row(
+        &mut self,
+        channel: usize,
+        scale_factor_bits: u8,
+        residual_size: u8,
+        scale_factor: u8,
+    ) {
+        self.residual_sizes[channel] = residual_size;
+
+        let key =
+            (scale_factor_bits as u32) << 16 | (residual_size as u32) << 8 | scale_factor as u32;
+        if self.dequant_keys[channel] == key {
+            return;
+        }
+        self.dequant_keys[channel] = key;
+
+        let residual_size = residual_size as usize;
+        let scale = SeaDequantTab::scale_factor(
+            scale_factor_bits as usize,
+            residual_size,
+            scale_factor as usize,
+        ) as f32;
+
+        let row = &mut self.dequant_rows[channel];
+        for index in 0..1 << (residual_size - 1) {
+            let value =
+                math::roundf(scale * SeaDequantTab::dqt_curve_item(residual_size, index)) as i32;
+            row[index * 2] = value;
+            row[index * 2 + 1] = -value;
+        }
+    }
+}
+
+fn section<'a>(chunk: &'a [u8], offset: &mut usize, length: usize) -> Result<&'a [u8], SeaError> {
+    let bytes = chunk
+        .get(*offset..*offset + length)
+        .ok_or(SeaError::InvalidFrame)?;
+    *offset += length;
+    Ok(bytes)
+}
@@ -1,63 +1,452 @@
-use std::io::Cursor;
+// Without the std feature the crate is no_std and only needs alloc, see fixed_decoder for a decoder
+// that does not allocate at all. The WASM API links std in any case.
+#![cfg_attr(not(feature = "std"), no_std)]
 
-use bytemuck::cast_slice;
-use decoder::SeaDecoder;
-use encoder::{EncoderSettings, SeaEncoder};
+extern crate alloc;
+#[cfg(all(not(feature = "std"), target_arch = "wasm32", feature = "wasm-api"))]
+extern crate std;
 
+#[cfg(feature = "encoder")]
+use alloc::{string::String, sync::Arc};
+#[cfg(any(feature = "encoder", feature = "decoder"))]
+use alloc::{vec, vec::Vec};
+
+#[cfg(feature = "encoder")]
+use codec::lms::LMS_LEN;
+#[cfg(feature = "decoder")]
+use codec::{
+    bits::BitUnpacker,
+    chunk::{SeaChunk, LAYERED_CHUNK},
+};
+#[cfg(any(feature = "encoder", feature = "decoder"))]
+use codec::{
+    common::SeaError,
+    file::{SeaFile, SeaFileHeader},
+};
+#[cfg(feature = "encoder")]
+use encoder::{EncoderSettings, QualityEncoded, QualityTarget};
+
+#[cfg(any(feature = "encoder", feature = "decoder"))]
 mod codec;
+#[cfg(all(feature = "decoder", feature = "std"))]
 pub mod decoder;
+#[cfg(feature = "encoder")]
 pub mod encoder;
+#[cfg(feature = "decoder")]
+pub mod fixed_decoder;
+#[cfg(feature = "decoder")]
+pub mod realtime;
 #[cfg(all(target_arch = "wasm32", feature = "wasm-api"))]
 pub mod wasm_api;
 
+#[cfg(feature = "decoder")]
+pub mod sample;
+#[cfg(feature = "async")]
+pub mod stream;
+
+#[cfg(all(feature = "stats", any(feature = "encoder", feature = "decoder")))]
+pub use codec::stats::SeaStats;
+#[cfg(feature = "decoder")]
+use sample::{SeaGain, SeaSample};
+
+#[cfg(feature = "encoder")]
 pub fn sea_encode(
     input_samples: &[i16],
     sample_rate: u32,
     channels: u32,
     settings: EncoderSettings,
 ) -> Vec<u8> {
-    let u8_input_samples: &[u8] = cast_slice(input_samples);
-    let mut cursor: Cursor<_> = Cursor::new(u8_input_samples);
-    let mut sea_encoded = Vec::<u8>::with_capacity(input_samples.len());
-    let mut sea_encoder = SeaEncoder::new(
-        channels as u8,
+    let mut sea_encoded = vec![0u8; sea_encoded_max_len(input_samples.len(), channels, &settings)];
+    let encoded_len = sea_encode_into(
+        input_samples,
         sample_rate,
-        Some(input_samples.len() as u32 / channels),
+        channels,
         settings,
-        &mut cursor,
         &mut sea_encoded,
     )
     .unwrap();
-
-    while sea_encoder.encode_frame().unwrap() {}
-    sea_encoder.finalize().unwrap();
+    sea_encoded.truncate(encoded_len);
 
     sea_encoded
 }
 
+#[cfg(feature = "decoder")]
 pub struct SeaDecodeInfo {
     pub samples: Vec<i16>,
     pub sample_rate: u32,
     pub channels: u32,
 }
 
-pub fn sea_decode(encoded: &[u8]) -> SeaDecodeInfo {
-    let mut cursor: Cursor<&[u8]> = Cursor::new(encoded);
-    let mut sea_decoded = Vec::<u8>::with_capacity(encoded.len() * 8);
+#[cfg(feature = "decoder")]
+pub struct SeaDecodeIntoInfo {
+    pub samples: usize, // number of samples written to the output
+    pub sample_rate: u32,
+    pub channels: u32,
+}
+
+// Encodes with the lowest residual_bits at which every chunk reaches the target quality. The
+// bitrate is chosen for the whole file, as all chunks of a file have the same size. Whole residual
+// sizes are tried without settings.vbr, VBR bitrates up to 7 in steps of 1/8 bit with it. If no
+// bitrate reaches the target, the highest one is used and target_reached is unset.
+#[cfg(feature = "encoder")]
+pub fn sea_encode_quality(
+    input_samples: &[i16],
+    sample_rate: u32,
+    channels: u32,
+    settings: EncoderSettings,
+    target: QualityTarget,
+) -> Result<QualityEncoded, SeaError> {
+    let (candidates, step): (Vec<f32>, usize) = match settings.vbr {
+        true => ((12..=56).map(|eighths| eighths as f32 / 8.0).collect(), 8),
+        false => ((1..=8).map(|bits| bits as f32).collect(), 1),
+    };
+    let candidate_settings = |index: usize| EncoderSettings {
+        residual_bits: candidates[index],
+        ..settings.clone()
+    };
+    let encode = |index: usize, target: Option<QualityTarget>| {
+        let settings = candidate_settings(index);
+        encode_with_target(input_samples, sample_rate, channels, &settings, target)
+    };
 
-    let mut sea_decoder: SeaDecoder<&mut Cursor<&[u8]>, &mut Vec<u8>> =
-        SeaDecoder::new(&mut cursor, &mut sea_decoded).unwrap();
+    // Quality rises with the bitrate, but not strictly, so the candidates are tried upwards in
+    // whole bits. A probe that misses the target stops at the first failing chunk.
+    let last = candidates.len() - 1;
+    let mut low = 0;
+    let mut index = 0;
+    let (mut high, mut encoded) = loop {
+        if let Some(encoded) = encode(index, Some(target))? {
+            break (index, encoded);
+        }
+        if index == last {
+            return Ok(QualityEncoded {
+                encoded: encode(last, None)?.unwrap(),
+                settings: candidate_settings(last),
+                target_reached: false,
+            });
+        }
+        low = index + 1;
+        index = (index + step).min(last);
+    };
 
-    while sea_decoder.decode_frame().unwrap() {}
-    sea_decoder.finalize().unwrap();
+    // the lowest passing VBR bitrate within the last whole bit
+    while low < high {
+        let middle = (low + high) / 2;
+        match encode(middle, Some(target))? {
+            Some(passing) => {
+                encoded = passing;
+                high = middle;
+            }
+            None => low = middle + 1,
+        }
+    }
 
-    let header = sea_decoder.get_header();
+    Ok(QualityEncoded {
+        encoded,
+        settings: candidate_settings(high),
+        target_reached: true,
+    })
+}
 
-    let decoded: &[i16] = cast_slice(&sea_decoded);
+// like sea_encode, but stops with None at the first chunk that misses the target
+#[cfg(feature = "encoder")]
+fn encode_with_target(
+    input_samples: &[i16],
+    sample_rate: u32,
+    channels: u32,
+    settings: &EncoderSettings,
+    target: Option<QualityTarget>,
+) -> Result<Option<Vec<u8>>, SeaError> {
+    let (mut file, input_chunks) = slice_file(input_samples, sample_rate, channels, settings)?;
+
+    let mut chunks = Vec::new();
+    for samples in input_chunks {
+        chunks.push(file.make_chunk(samples)?);
+
+        let stats = file.chunk_stats.as_ref().unwrap();
+        let missed = |target: QualityTarget| {
+            stats
+                .channels
+                .iter()
+                .any(|quality| !target.reached(quality))
+        };
+        if target.is_some_and(missed) {
+            return Ok(None);
+        }
+    }
+
+    let mut encoded = file.header.serialize();
+    for chunk in chunks {
+        encoded.extend_from_slice(&chunk);
+    }
+    Ok(Some(encoded))
+}
+
+// The file of a whole slice of samples and the samples of its chunks, a partial frame at the end
+// is left out
+#[cfg(feature = "encoder")]
+fn slice_file<'a>(
+    input_samples: &'a [i16],
+    sample_rate: u32,
+    channels: u32,
+    settings: &EncoderSettings,
+) -> Result<(SeaFile, core::slice::Chunks<'a, i16>), SeaError> {
+    let total_frames = input_samples.len() as u32 / channels;
+    let header = SeaFileHeader {
+        version: 1,
+        channels: channels as u8,
+        chunk_size: 0, // will be set by the first chunk
+        frames_per_chunk: settings.frames_per_chunk,
+        sample_rate,
+        total_frames,
+        metadata: Arc::new(String::new()),
+    };
+    let chunk_samples = settings.frames_per_chunk as usize * channels as usize;
+    let file = SeaFile::new(header, settings)?;
+
+    let input_samples = &input_samples[..total_frames as usize * channels as usize];
+    Ok((file, input_samples.chunks(chunk_samples)))
+}
+
+// upper bound of the encoded size in bytes, VBR chunks are sized as if every residual used the largest size
+#[cfg(feature = "encoder")]
+pub fn sea_encoded_max_len(samples: usize, channels: u32, settings: &EncoderSettings) -> usize {
+    let channels = channels as usize;
+    let frames_per_chunk = settings.frames_per_chunk as usize;
+    let scale_factor_items =
+        frames_per_chunk.div_ceil(settings.scale_factor_frames as usize) * channels;
+
+    let largest_offset = settings.channel_bit_offsets.iter().max().unwrap_or(&0);
+    let mut residual_bits = (codec::math::floorf(settings.residual_bits) as i32
+        + (*largest_offset).max(0) as i32) as usize;
+    let mut chunk_size = 4
+        + channels * LMS_LEN * 4
+        + (scale_factor_items * settings.scale_factor_bits as usize).div_ceil(8);
+    if settings.vbr {
+        residual_bits += 2;
+    }
+    if settings.vbr
+        || settings
+            .channel_bit_offsets
+            .iter()
+            .any(|offset| *offset != 0)
+    {
+        chunk_size += (scale_factor_items * 2).div_ceil(8);
+    }
+    chunk_size += (frames_per_chunk * channels * residual_bits).div_ceil(8);
+    if settings.enhancement_bits > 0 {
+        chunk_size += 1
+            + (scale_factor_items * settings.scale_factor_bits as usize).div_ceil(8)
+            + (frames_per_chunk * channels * settings.enhancement_bits as usize).div_ceil(8);
+    }
+
+    let chunks = (samples / channels).div_ceil(frames_per_chunk);
+    SeaFileHeader::FIXED_SIZE + chunks * chunk_size
+}
+
+#[cfg(feature = "encoder")]
+fn write_at(output: &mut [u8], offset: usize, bytes: &[u8]) -> Result<usize, SeaError> {
+    let end = offset + bytes.len();
+    if end > output.len() {
+        return Err(SeaError::OutputTooSmall);
+    }
+    output[offset..end].copy_from_slice(bytes);
+    Ok(end)
+}
+
+// encodes directly into the output, returns the number of bytes written
+#[cfg(feature = "encoder")]
+pub fn sea_encode_into(
+    input_samples: &[i16],
+    sample_rate: u32,
+    channels: u32,
+    settings: EncoderSettings,
+    output: &mut [u8],
+) -> Result<usize, SeaError> {
+    let (mut file, input_chunks) = slice_file(input_samples, sample_rate, channels, &settings)?;
+
+    let mut written = 0;
+    for samples in input_chunks {
+        let chunk = file.make_chunk(samples)?;
+
+        // the header depends on the size of the first chunk
+        if written == 0 {
+            written = write_at(output, 0, &file.header.serialize())?;
+        }
+        written = write_at(output, written, &chunk)?;
+    }
+
+    if written == 0 {
+        written = write_at(output, 0, &file.header.serialize())?;
+    }
+
+    Ok(written)
+}
+
+// Upper bound of the number of samples the file decodes to, only the header and the length of the
+// file are needed. It is exact for complete files, truncated or corrupt ones decode to fewer.
+#[cfg(feature = "decoder")]
+pub fn sea_decoded_len(header: &[u8], encoded_len: usize) -> usize {
+    let Ok(header) = SeaFileHeader::from_slice(header) else {
+        return 0;
+    };
+
+    let channels = header.channels as usize;
+    let payload_len = encoded_len.saturating_sub(header.size());
+    let chunk_size = header.chunk_size as usize;
+    let frames_per_chunk = header.frames_per_chunk as usize;
+
+    // the header alone is not trusted, the chunks that are there bound the frames
+    if header.total_frames > 0 {
+        let chunks = payload_len.div_ceil(chunk_size);
+        let frames = (header.total_frames as usize).min(chunks * frames_per_chunk);
+        return frames * channels;
+    }
+
+    // streaming files only contain full chunks
+    let chunks = payload_len / chunk_size;
+    chunks * frames_per_chunk * channels
+}
+
+// decodes directly into the output, which should hold sea_decoded_len() samples of any sample type
+#[cfg(feature = "decoder")]
+pub fn sea_decode_into<S: SeaSample>(
+    encoded: &[u8],
+    output: &mut [S],
+) -> Result<SeaDecodeIntoInfo, SeaError> {
+    decode_into(encoded, output, None)
+}
+
+// same as sea_decode_into, with every sample scaled by gain as it is reconstructed
+#[cfg(feature = "decoder")]
+pub fn sea_decode_into_gain<S: SeaSample>(
+    encoded: &[u8],
+    output: &mut [S],
+    mut gain: SeaGain,
+) -> Result<SeaDecodeIntoInfo, SeaError> {
+    decode_into(encoded, output, Some(&mut gain))
+}
+
+#[cfg(feature = "decoder")]
+fn decode_into<S: SeaSample>(
+    encoded: &[u8],
+    output: &mut [S],
+    mut gain: Option<&mut SeaGain>,
+) -> Result<SeaDecodeIntoInfo, SeaError> {
+    let mut file = SeaFile::from_header(SeaFileHeader::from_slice(encoded)?);
+    let mut reader = &encoded[file.header.size()..];
+
+    let channels = file.header.channels as usize;
+    let total_frames = file.header.total_frames as usize;
+    let chunk_size = file.header.chunk_size as usize;
+    let mut written = 0;
+
+    while !reader.is_empty() {
+        let frames_read = written / channels;
+        let remaining_frames = if total_frames > 0 {
+            if frames_read >= total_frames {
+                break;
+            }
+            Some(total_frames - frames_read)
+        } else {
+            None
+        };
+
+        let chunk_len = reader.len().min(chunk_size);
+        written += file.samples_into(
+            &reader[..chunk_len],
+            remaining_frames,
+            &mut output[written..],
+            gain.as_deref_mut(),
+        )?;
+        reader = &reader[chunk_len..];
+    }
+
+    Ok(SeaDecodeIntoInfo {
+        samples: written,
+        sample_rate: file.header.sample_rate,
+        channels: channels as u32,
+    })
+}
+
+// Cuts the enhancement layer off every chunk, the result decodes to the base layer alone. Only the
+// chunks are parsed, no sample is decoded or encoded. Files without enhancement layers come back
+// unchanged.
+#[cfg(feature = "decoder")]
+pub fn sea_drop_enhancement(encoded: &[u8]) -> Result<Vec<u8>, SeaError> {
+    let header = SeaFileHeader::from_slice(encoded)?;
+    let mut output = encoded[..header.size()].to_vec();
+    let mut reader = &encoded[header.size()..];
+
+    let channels = header.channels as usize;
+    let total_frames = header.total_frames as usize;
+    let chunk_size = header.chunk_size as usize;
+    let mut chunk = SeaChunk::with_capacity(&header);
+    let mut unpacker = BitUnpacker::new();
+    let mut bases = Vec::new();
+    let mut frames_read = 0;
+
+    while !reader.is_empty() {
+        let remaining_frames = if total_frames > 0 {
+            if frames_read >= total_frames {
+                break;
+            }
+            Some(total_frames - frames_read)
+        } else {
+            None
+        };
+
+        let chunk_len = reader.len().min(chunk_size);
+        let encoded_chunk = &reader[..chunk_len];
+        chunk.parse_into(encoded_chunk, &header, remaining_frames, &mut unpacker)?;
+        bases.push(&encoded_chunk[..chunk.base_len]);
+
+        frames_read += chunk.residuals.len() / channels;
+        reader = &reader[chunk_len..];
+    }
+
+    // Base layers of the same size unless the file was repacked, then all but the last one are
+    // padded to the largest. The chunk size field of the header follows.
+    let base_chunk_size = bases.iter().map(|base| base.len()).max();
+    let base_chunk_size = base_chunk_size.unwrap_or(chunk_size);
+    output[6..8].copy_from_slice(&(base_chunk_size as u16).to_le_bytes());
+    for (index, base) in bases.iter().enumerate() {
+        output.push(base[0] & !LAYERED_CHUNK);
+        output.extend_from_slice(&base[1..]);
+        if index + 1 < bases.len() {
+            output.resize(output.len() + base_chunk_size - base.len(), 0);
+        }
+    }
+    Ok(output)
+}
+
+// Changes the frames per chunk of a file without re-encoding, the new file decodes to exactly the
+// same samples. frames_per_chunk has to be a multiple of the scale factor frames. Chunks are only
+// decoded as far as needed for the LMS states of the new chunk headers. Joining chunks fails with
+// InvalidParameters where the encoder started a chunk with new LMS weights, as with optimize_lms.
+// So does a split where the LMS weights exceed the 16 bits a chunk header stores.
+#[cfg(all(feature = "encoder", feature = "decoder"))]
+pub fn sea_rechunk(encoded: &[u8], frames_per_chunk: u16) -> Result<Vec<u8>, SeaError> {
+    codec::repack::rechunk(encoded, frames_per_chunk)
+}
+
+// A file of the given channels of the input, in the given order, e.g. [0, 1] for the front pair of
+// a 5.1 file. Their LMS states, scale factors, residual sizes and residuals are repacked without
+// decoding, so the channels decode to exactly the same samples as before.
+#[cfg(all(feature = "encoder", feature = "decoder"))]
+pub fn sea_extract_channels(encoded: &[u8], channels: &[usize]) -> Result<Vec<u8>, SeaError> {
+    codec::repack::extract_channels(encoded, channels)
+}
+
+#[cfg(feature = "decoder")]
+pub fn sea_decode(encoded: &[u8]) -> SeaDecodeInfo {
+    let mut samples = vec![0i16; sea_decoded_len(encoded, encoded.len())];
+    let info = sea_decode_into(encoded, &mut samples).unwrap();
+    samples.truncate(info.samples);
 
     SeaDecodeInfo {
-        samples: decoded.to_vec(),
-        sample_rate: header.sample_rate,
-        channels: header.channels as u32,
+        samples,
+        sample_rate: info.sample_rate,
+        channels: info.channels,
     }
 }
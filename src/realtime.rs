@@ -0,0 +1,382 @@
+use alloc::{boxed::Box, sync::Arc, vec, vec::Vec};
+use core::{
+    cell::UnsafeCell,
+    mem, ptr,
+    sync::atomic::{AtomicBool, AtomicUsize, Ordering},
+};
+
+use crate::{
+    codec::{
+        bits::BitUnpacker,
+        chunk::SeaChunk,
+        common::SeaError,
+        decoder::Decoder,
+        file::SeaFileHeader,
+        lms::{SeaLMS, LMS_LEN},
+    },
+    sample::{SeaGain, SeaSample},
+};
+
+// frames of a Web Audio render quantum
+pub const QUANTUM_FRAMES: usize = 128;
+
+// Decoder for audio callbacks, carrying the LMS and chunk state from one call to the next.
+// Every buffer is sized in new(): afterwards feeding input and decoding never allocate, lock or
+// block, and each call does a bounded amount of work. On native hosts the input usually arrives
+// from an I/O thread through input_queue().
+pub struct SeaRealtimeDecoder {
+    header: SeaFileHeader,
+    header_len: usize,
+
+    decoder: Decoder,
+    unpacker: BitUnpacker,
+    chunk: SeaChunk,
+    lms: Vec<SeaLMS>,
+    chunk_frame: usize,
+    chunk_frames: usize,
+    frames_decoded: usize,
+
+    input: Vec<u8>,
+    input_start: usize,
+    input_end: usize,
+    end_of_input: bool,
+
+    quantum: Vec<f32>,
+    gain: Option<SeaGain>,
+    underruns: u32,
+}
+
+impl SeaRealtimeDecoder {
+    // Prefix has to hold the file header and the first two bytes of the first chunk, which tell the
+    // scale factor bits. Only the header is consumed, input starts at header_len().
+    // The input buffer holds input_chunks chunks, at least two.
+    pub fn new(prefix: &[u8], input_chunks: usize) -> Result<Self, SeaError> {
+        let header_len = SeaFileHeader::size_from_prefix(prefix).ok_or(SeaError::InvalidFile)?;
+        if prefix.len() < header_len + 2 {
+            return Err(SeaError::InvalidFile);
+        }
+        let header = SeaFileHeader::from_slice(&prefix[..header_len])?;
+        let scale_factor_bits = prefix[header_len + 1] >> 4;
+
+        let channels = header.channels as usize;
+        let chunk_size = header.chunk_size as usize;
+
+        let chunk = SeaChunk::with_capacity(&header);
+        let mut unpacker = BitUnpacker::new();
+        unpacker.reserve(chunk_size * 8);
+
+        Ok(Self {
+            decoder: Decoder::init(channels, scale_factor_bits as usize),
+            unpacker,
+            chunk,
+            lms: SeaLMS::init_vec(channels as u32),
+            chunk_frame: 0,
+            chunk_frames: 0,
+            frames_decoded: 0,
+
+            input: vec![0u8; chunk_size * input_chunks.max(2)],
+            input_start: 0,
+            input_end: 0,
+            end_of_input: false,
+
+            quantum: vec![0f32; QUANTUM_FRAMES * channels],
+            gain: None,
+            underruns: 0,
+
+            header,
+            header_len,
+        })
+    }
+
+    pub fn header(&self) -> &SeaFileHeader {
+        &self.header
+    }
+
+    pub fn header_len(&self) -> usize {
+        self.header_len
+    }
+
+    // free part of the input buffer, fill it and pass the written length to commit_input
+    pub fn input_buffer(&mut self) -> &mut [u8] {
+        if self.input_start > 0 {
+            self.input.copy_within(self.input_start..self.input_end, 0);
+            self.input_end -= self.input_start;
+            self.input_start = 0;
+        }
+        &mut self.input[self.input_end..]
+    }
+
+    pub fn commit_input(&mut self, length: usize) {
+        assert!(self.input_end + length <= self.input.len());
+        self.input_end += length;
+    }
+
+    // copies as much of data as fits into the input buffer, returns the number of bytes taken
+    pub fn push_input(&mut self, data: &[u8]) -> usize {
+        let buffer = self.input_buffer();
+        let length = data.len().min(buffer.len());
+        buffer[..length].copy_from_slice(&data[..length]);
+        self.commit_input(length);
+        length
+    }
+
+    // the remaining input is the end of the file, a shorter last chunk can be decoded now
+    pub fn end_input(&mut self) {
+        self.end_of_input = true;
+    }
+
+    // true once every frame of the file was returned
+    pub fn ended(&self) -> bool {
+        let total_frames = self.header.total_frames as usize;
+        let all_frames = total_frames > 0 && self.frames_decoded >= total_frames;
+        let no_input = self.end_of_input && self.input_start == self.input_end;
+
+        self.chunk_frame == self.chunk_frames && (all_frames || no_input)
+    }
+
+    // gain of every following decode call, a ramp continues across calls
+    pub fn set_gain(&mut self, gain: Option<SeaGain>) {
+        self.gain = gain;
+    }
+
+    // number of decode calls that could not be filled because the input ran dry
+    pub fn underruns(&self) -> u32 {
+        self.underruns
+    }
+
+    fn next_chunk(&mut self) -> Result<bool, SeaError> {
+        let total_frames = self.header.total_frames as usize;
+        let remaining_frames = if total_frames > 0 {
+            if self.frames_decoded >= total_frames {
+                return Ok(false);
+            }
+            Some(total_frames - self.frames_decoded)
+        } else {
+            None
+        };
+
+        // only the last chunk of the file can be shorter than chunk_size
+        let available = self.input_end - self.input_start;
+        let chunk_size = self.header.chunk_size as usize;
+        if available < chunk_size && (!self.end_of_input || available == 0) {
+            return Ok(false);
+        }
+        let chunk_length = available.min(chunk_size);
+
+        // a cut download ends in a piece of a chunk, shorter than its header and LMS states
+        if chunk_length < 4 + self.header.channels as usize * LMS_LEN * 4 {
+            return Err(SeaError::InvalidFrame);
+        }
+        let encoded = &self.input[self.input_start..self.input_start + chunk_length];
+        // the tables of other scale factor bits would have to be allocated, files of this encoder
+        // use the same ones in every chunk
+        if (encoded[1] >> 4) as usize != self.decoder.scale_factor_bits() {
+            return Err(SeaError::InvalidFrame);
+        }
+        self.chunk
+            .parse_into(encoded, &self.header, remaining_frames, &mut self.unpacker)?;
+        self.input_start += chunk_length;
+
+        self.lms.clone_from_slice(&self.chunk.lms);
+        self.chunk_frame = 0;
+        self.chunk_frames = self.chunk.residuals.len() / self.header.channels as usize;
+
+        Ok(true)
+    }
+
+    // moves whatever the I/O thread queued into the input buffer, ends the input once it closed
+    pub fn pull_input(&mut self, queue: &mut SeaInputReader) {
+        // read before taking the bytes, everything pushed before closing is visible then
+        let closed = queue.is_closed();
+        let buffer = self.input_buffer();
+        let length = queue.pop(buffer);
+        self.commit_input(length);
+
+        if closed && queue.is_empty() {
+            self.end_input();
+        }
+    }
+
+    // Decodes output.len() / channels frames into output as interleaved samples, a host block of
+    // any size. Returns the number of frames decoded, fewer only when the input ran dry or the
+    // file ended.
+    pub fn decode_interleaved<S: SeaSample>(
+        &mut self,
+        output: &mut [S],
+    ) -> Result<usize, SeaError> {
+        let channels = self.header.channels as usize;
+        let requested = output.len() / channels;
+
+        let mut frames = 0;
+        while frames < requested {
+            if self.chunk_frame == self.chunk_frames && !self.next_chunk()? {
+                break;
+            }
+
+            let length = (requested - frames).min(self.chunk_frames - self.chunk_frame);
+            self.decoder.decode_frames(
+                &self.chunk,
+                &mut self.lms,
+                self.chunk_frame,
+                &mut output[frames * channels..(frames + length) * channels],
+                self.gain.as_mut(),
+            );
+            self.chunk_frame += length;
+            // counted per chunk, next_chunk needs it for the length of the last one
+            self.frames_decoded += length;
+            frames += length;
+        }
+
+        if frames < requested && !self.ended() {
+            self.underruns += 1;
+        }
+
+        Ok(frames)
+    }
+
+    // Decodes the next quantum into output as planar floats, QUANTUM_FRAMES per channel.
+    // Returns the number of frames decoded, the rest of the quantum is silence.
+    pub fn decode_quantum(&mut self, output: &mut [f32]) -> Result<usize, SeaError> {
+        let channels = self.header.channels as usize;
+        assert!(output.len() >= QUANTUM_FRAMES * channels);
+
+        // taken out for the call, an empty Vec does not allocate
+        let mut quantum = mem::take(&mut self.quantum);
+        let frames = self.decode_interleaved(&mut quantum);
+        self.quantum = quantum;
+        let frames = frames?;
+
+        for (channel, channel_output) in output
+            .chunks_exact_mut(QUANTUM_FRAMES)
+            .take(channels)
+            .enumerate()
+        {
+            for (frame, sample) in channel_output[..frames].iter_mut().enumerate() {
+                *sample = self.quantum[frame * channels + channel];
+            }
+            channel_output[frames..].fill(0.0);
+        }
+
+        Ok(frames)
+    }
+}
+
+struct InputQueue {
+    buffer: Box<[UnsafeCell<u8>]>,
+    // total bytes pushed and popped, the difference is the queued length
+    written: AtomicUsize,
+    read: AtomicUsize,
+    closed: AtomicBool,
+}
+
+// the writer only touches the free part of the buffer and the reader the queued part
+unsafe impl Sync for InputQueue {}
+unsafe impl Send for InputQueue {}
+
+impl InputQueue {
+    fn queued(&self) -> usize {
+        self.written
+            .load(Ordering::Acquire)
+            .wrapping_sub(self.read.load(Ordering::Acquire))
+    }
+
+    // copies between bytes and the ring starting at position, wrapping around its end
+    unsafe fn copy(
+        &self,
+        position: usize,
+        length: usize,
+        mut copy: impl FnMut(*mut u8, usize, usize),
+    ) {
+        let capacity = self.buffer.len();
+        let start = position % capacity;
+        let first = length.min(capacity - start);
+        let ring = UnsafeCell::raw_get(self.buffer.as_ptr());
+        copy(ring.add(start), 0, first);
+        copy(ring, first, length - first);
+    }
+}
+
+// Lock-free single producer, single consumer byte queue between an I/O thread and the audio thread.
+// Neither side blocks: push and pop move as many bytes as fit and return that length.
+pub fn input_queue(capacity: usize) -> (SeaInputWriter, SeaInputReader) {
+    assert!(capacity > 0);
+    let queue = Arc::new(InputQueue {
+        buffer: (0..capacity).map(|_| UnsafeCell::new(0)).collect(),
+        written: AtomicUsize::new(0),
+        read: AtomicUsize::new(0),
+        closed: AtomicBool::new(false),
+    });
+
+    (
+        SeaInputWriter {
+            queue: queue.clone(),
+        },
+        SeaInputReader { queue },
+    )
+}
+
+// the I/O side, dropping it closes the queue
+pub struct SeaInputWriter {
+    queue: Arc<InputQueue>,
+}
+
+impl SeaInputWriter {
+    // returns the number of bytes taken, 0 while the queue is full
+    pub fn push(&mut self, data: &[u8]) -> usize {
+        let queue = &*self.queue;
+        let written = queue.written.load(Ordering::Relaxed);
+        let length = data.len().min(queue.buffer.len() - queue.queued());
+
+        unsafe {
+            queue.copy(written, length, |ring, offset, length| {
+                ptr::copy_nonoverlapping(data.as_ptr().add(offset), ring, length)
+            });
+        }
+        queue
+            .written
+            .store(written.wrapping_add(length), Ordering::Release);
+        length
+    }
+
+    // the bytes pushed so far are the end of the file
+    pub fn close(self) {}
+}
+
+impl Drop for SeaInputWriter {
+    fn drop(&mut self) {
+        self.queue.closed.store(true, Ordering::Release);
+    }
+}
+
+// the audio side, see SeaRealtimeDecoder::pull_input
+pub struct SeaInputReader {
+    queue: Arc<InputQueue>,
+}
+
+impl SeaInputReader {
+    // returns the number of bytes copied to output
+    pub fn pop(&mut self, output: &mut [u8]) -> usize {
+        let queue = &*self.queue;
+        let read = queue.read.load(Ordering::Relaxed);
+        let length = output.len().min(queue.queued());
+
+        unsafe {
+            queue.copy(read, length, |ring, offset, length| {
+                ptr::copy_nonoverlapping(ring, output.as_mut_ptr().add(offset), length)
+            });
+        }
+        queue
+            .read
+            .store(read.wrapping_add(length), Ordering::Release);
+        length
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.queue.queued() == 0
+    }
+
+    // true once the writer was closed or dropped
+    pub fn is_closed(&self) -> bool {
+        self.queue.closed.load(Ordering::Acquire)
+    }
+}
@@ -0,0 +1,130 @@
+use crate::codec::math;
+
+// Output sample types of the decoder. Every decode path is generic over it, so each type gets its
+// own monomorphized loop and i16 at unity gain writes the reconstructed samples unchanged.
+pub trait SeaSample: Copy + Default {
+    // reconstructed sample at unity gain
+    fn from_i16(sample: i16) -> Self;
+    // reconstructed sample scaled by gain, saturated to the range of the type
+    fn from_i16_gain(sample: i16, gain: f32) -> Self;
+}
+
+impl SeaSample for i16 {
+    #[inline(always)]
+    fn from_i16(sample: i16) -> Self {
+        sample
+    }
+
+    #[inline(always)]
+    fn from_i16_gain(sample: i16, gain: f32) -> Self {
+        math::roundf(sample as f32 * gain) as i16
+    }
+}
+
+// full scale 32 bit, the 16 bit sample in the upper half
+impl SeaSample for i32 {
+    #[inline(always)]
+    fn from_i16(sample: i16) -> Self {
+        (sample as i32) << 16
+    }
+
+    #[inline(always)]
+    fn from_i16_gain(sample: i16, gain: f32) -> Self {
+        math::roundf(sample as f32 * gain * 65536.0) as i32
+    }
+}
+
+// -1.0 to 1.0, like Web Audio
+impl SeaSample for f32 {
+    #[inline(always)]
+    fn from_i16(sample: i16) -> Self {
+        sample as f32 / 32768.0
+    }
+
+    #[inline(always)]
+    fn from_i16_gain(sample: i16, gain: f32) -> Self {
+        sample as f32 * gain / 32768.0
+    }
+}
+
+// Linear gain applied while samples are reconstructed, either constant or a ramp for fades.
+// It advances once per frame, so every channel of a frame gets the same gain.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct SeaGain {
+    value: f32,
+    step: f32,
+    target: f32,
+    frames: u32,
+}
+
+impl SeaGain {
+    pub const fn constant(gain: f32) -> Self {
+        Self {
+            value: gain,
+            step: 0.0,
+            target: gain,
+            frames: 0,
+        }
+    }
+
+    // moves linearly from `from` to `to` over `frames` frames and stays at `to` afterwards
+    pub fn ramp(from: f32, to: f32, frames: u32) -> Self {
+        if frames == 0 {
+            return Self::constant(to);
+        }
+        Self {
+            value: from,
+            step: (to - from) / frames as f32,
+            target: to,
+            frames,
+        }
+    }
+
+    // gain of the next frame
+    pub fn value(&self) -> f32 {
+        self.value
+    }
+
+    #[inline(always)]
+    pub(crate) fn next_frame(&mut self) {
+        if self.frames > 0 {
+            self.frames -= 1;
+            // exact at the end of the ramp, whatever the rounding of the steps
+            self.value = if self.frames == 0 {
+                self.target
+            } else {
+                self.value + self.step
+            };
+        }
+    }
+}
+
+// gain of the decode loops, Unity compiles to the plain conversion
+pub(crate) trait FrameGain {
+    fn apply<S: SeaSample>(&self, sample: i16) -> S;
+    fn next_frame(&mut self);
+}
+
+pub(crate) struct Unity;
+
+impl FrameGain for Unity {
+    #[inline(always)]
+    fn apply<S: SeaSample>(&self, sample: i16) -> S {
+        S::from_i16(sample)
+    }
+
+    #[inline(always)]
+    fn next_frame(&mut self) {}
+}
+
+impl FrameGain for SeaGain {
+    #[inline(always)]
+    fn apply<S: SeaSample>(&self, sample: i16) -> S {
+        S::from_i16_gain(sample, self.value)
+    }
+
+    #[inline(always)]
+    fn next_frame(&mut self) {
+        SeaGain::next_frame(self)
+    }
+}
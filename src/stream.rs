@@ -0,0 +1,417 @@
+use std::{
+    collections::VecDeque,
+    future::Future,
+    io,
+    pin::Pin,
+    sync::Arc,
+    task::{Context, Poll},
+};
+
+use futures_channel::oneshot;
+use futures_core::{ready, Stream};
+use futures_io::{AsyncRead, AsyncWrite};
+use futures_sink::Sink;
+
+use crate::{
+    codec::{
+        common::SeaError,
+        file::{SeaFile, SeaFileHeader},
+    },
+    encoder::EncoderSettings,
+};
+
+// Runs the chunk work of the adapters away from the polling task, e.g. on the blocking thread pool
+// of the async runtime. The job has to run exactly once, a dropped job fails the stream.
+pub trait SeaOffload: Send + Sync {
+    fn spawn(&self, job: Box<dyn FnOnce() + Send>);
+}
+
+// chunk work that either ran inline or runs on the offload
+enum Job<T> {
+    Done(Option<T>),
+    Offloaded(oneshot::Receiver<T>),
+}
+
+impl<T: Send + 'static> Job<T> {
+    fn start(
+        offload: Option<&Arc<dyn SeaOffload>>,
+        work: impl FnOnce() -> T + Send + 'static,
+    ) -> Self {
+        match offload {
+            None => Job::Done(Some(work())),
+            Some(offload) => {
+                let (sender, receiver) = oneshot::channel();
+                offload.spawn(Box::new(move || {
+                    let _ = sender.send(work());
+                }));
+                Job::Offloaded(receiver)
+            }
+        }
+    }
+
+    fn poll(&mut self, cx: &mut Context<'_>) -> Poll<Result<T, SeaError>> {
+        match self {
+            Job::Done(result) => {
+                Poll::Ready(Ok(result.take().expect("job polled after completion")))
+            }
+            Job::Offloaded(receiver) => Pin::new(receiver).poll(cx).map_err(|_| {
+                SeaError::IoError(io::Error::other("offloaded chunk job was dropped"))
+            }),
+        }
+    }
+}
+
+// the jobs hand the file back with their result
+type DecodeJob = Job<(SeaFile, Result<Vec<Vec<i16>>, SeaError>)>;
+type EncodeJob = Job<(SeaFile, Result<Vec<u8>, SeaError>)>;
+
+// Decodes a SEA file from an AsyncRead chunk by chunk, each item holds the interleaved samples of
+// one chunk. By default chunks are decoded inline while polling, see offload().
+pub struct SeaDecodeStream<R> {
+    reader: R,
+    offload: Option<Arc<dyn SeaOffload>>,
+    batch_chunks: usize,
+
+    // None until the header was read, and while a job decodes with it
+    file: Option<SeaFile>,
+    chunk_size: usize,
+    input: Vec<u8>,
+    end_of_input: bool,
+    frames_read: usize,
+
+    job: Option<DecodeJob>,
+    decoded: VecDeque<Vec<i16>>,
+    finished: bool,
+}
+
+impl<R: AsyncRead + Unpin> SeaDecodeStream<R> {
+    pub fn new(reader: R) -> Self {
+        Self {
+            reader,
+            offload: None,
+            batch_chunks: 1,
+
+            file: None,
+            chunk_size: 0,
+            input: Vec::new(),
+            end_of_input: false,
+            frames_read: 0,
+
+            job: None,
+            decoded: VecDeque::new(),
+            finished: false,
+        }
+    }
+
+    // decodes batch_chunks chunks per job on the offload, so a thread hop is paid per batch
+    pub fn offload(mut self, offload: Arc<dyn SeaOffload>, batch_chunks: usize) -> Self {
+        self.offload = Some(offload);
+        self.batch_chunks = batch_chunks.max(1);
+        self
+    }
+
+    // None until the header was read
+    pub fn header(&self) -> Option<&SeaFileHeader> {
+        self.file.as_ref().map(|file| &file.header)
+    }
+
+    // reads until the input holds length bytes or the reader ended
+    fn poll_fill(&mut self, cx: &mut Context<'_>, length: usize) -> Poll<io::Result<()>> {
+        while self.input.len() < length && !self.end_of_input {
+            let start = self.input.len();
+            self.input.resize(length, 0);
+            let read = Pin::new(&mut self.reader).poll_read(cx, &mut self.input[start..]);
+            let read = match read {
+                Poll::Ready(Ok(read)) => read,
+                Poll::Ready(Err(error)) => {
+                    self.input.truncate(start);
+                    return Poll::Ready(Err(error));
+                }
+                Poll::Pending => {
+                    self.input.truncate(start);
+                    return Poll::Pending;
+                }
+            };
+            self.input.truncate(start + read);
+            self.end_of_input = read == 0;
+        }
+        Poll::Ready(Ok(()))
+    }
+
+    fn poll_chunk(&mut self, cx: &mut Context<'_>) -> Poll<Result<Option<Vec<i16>>, SeaError>> {
+        loop {
+            if let Some(samples) = self.decoded.pop_front() {
+                return Poll::Ready(Ok(Some(samples)));
+            }
+
+            if let Some(job) = &mut self.job {
+                let (file, result) = ready!(job.poll(cx))?;
+                self.job = None;
+                let channels = file.header.channels as usize;
+                self.file = Some(file);
+                for samples in result? {
+                    self.frames_read += samples.len() / channels;
+                    self.decoded.push_back(samples);
+                }
+                continue;
+            }
+
+            let Some(file) = &self.file else {
+                ready!(self.poll_fill(cx, SeaFileHeader::FIXED_SIZE))?;
+                let header_len =
+                    SeaFileHeader::size_from_prefix(&self.input).ok_or(SeaError::InvalidFile)?;
+                ready!(self.poll_fill(cx, header_len))?;
+
+                let header = SeaFileHeader::from_slice(&self.input)?;
+                self.input.drain(..header_len);
+                self.chunk_size = header.chunk_size as usize;
+                self.file = Some(SeaFile::from_header(header));
+                continue;
+            };
+
+            let total_frames = file.header.total_frames as usize;
+            if total_frames > 0 && self.frames_read >= total_frames {
+                return Poll::Ready(Ok(None));
+            }
+
+            ready!(self.poll_fill(cx, self.chunk_size * self.batch_chunks))?;
+            if self.input.is_empty() {
+                return Poll::Ready(Ok(None));
+            }
+
+            // whole chunks, only the end of the input can hold a shorter one
+            let length = if self.end_of_input {
+                self.input.len()
+            } else {
+                self.input.len() / self.chunk_size * self.chunk_size
+            };
+            let encoded: Vec<u8> = self.input.drain(..length).collect();
+            let mut file = self.file.take().unwrap();
+            let frames_read = self.frames_read;
+            self.job = Some(Job::start(self.offload.as_ref(), move || {
+                let result = decode_chunks(&mut file, &encoded, frames_read);
+                (file, result)
+            }));
+        }
+    }
+}
+
+fn decode_chunks(
+    file: &mut SeaFile,
+    encoded: &[u8],
+    mut frames_read: usize,
+) -> Result<Vec<Vec<i16>>, SeaError> {
+    let channels = file.header.channels as usize;
+    let total_frames = file.header.total_frames as usize;
+    let mut chunks = Vec::new();
+
+    for chunk in encoded.chunks(file.header.chunk_size as usize) {
+        let remaining_frames = if total_frames > 0 {
+            if frames_read >= total_frames {
+                break;
+            }
+            Some(total_frames - frames_read)
+        } else {
+            None
+        };
+
+        let mut samples = vec![0i16; file.header.frames_per_chunk as usize * channels];
+        let written = file.samples_into(chunk, remaining_frames, &mut samples, None)?;
+        samples.truncate(written);
+        frames_read += written / channels;
+        chunks.push(samples);
+    }
+
+    Ok(chunks)
+}
+
+impl<R: AsyncRead + Unpin> Stream for SeaDecodeStream<R> {
+    type Item = Result<Vec<i16>, SeaError>;
+
+    fn poll_next(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Option<Self::Item>> {
+        let this = self.get_mut();
+        if this.finished {
+            return Poll::Ready(None);
+        }
+
+        let result = ready!(this.poll_chunk(cx));
+        if !matches!(result, Ok(Some(_))) {
+            this.finished = true;
+        }
+        Poll::Ready(result.transpose())
+    }
+}
+
+// Encodes interleaved samples sent in items of any length into an AsyncWrite. Full chunks are
+// encoded as they fill up, closing the sink encodes the last, shorter chunk and closes the writer.
+// By default chunks are encoded inline while polling, see offload().
+pub struct SeaEncodeSink<W> {
+    writer: W,
+    offload: Option<Arc<dyn SeaOffload>>,
+    batch_chunks: usize,
+
+    // None while a job encodes with it
+    file: Option<SeaFile>,
+    chunk_samples: usize,
+    remaining_samples: Option<usize>,
+    samples: Vec<i16>,
+    header_written: bool,
+
+    job: Option<EncodeJob>,
+    output: Vec<u8>,
+    output_written: usize,
+}
+
+impl<W: AsyncWrite + Unpin> SeaEncodeSink<W> {
+    // like SeaEncoder::new, sending more than total_frames frames fails with TooManyFrames
+    pub fn new(
+        writer: W,
+        channels: u8,
+        sample_rate: u32,
+        total_frames: Option<u32>,
+        settings: EncoderSettings,
+    ) -> Result<Self, SeaError> {
+        let header = SeaFileHeader {
+            version: 1,
+            channels,
+            chunk_size: 0, // will be set by the first chunk
+            frames_per_chunk: settings.frames_per_chunk,
+            sample_rate,
+            total_frames: total_frames.unwrap_or(0),
+            metadata: Arc::new(String::new()),
+        };
+
+        Ok(Self {
+            writer,
+            offload: None,
+            batch_chunks: 1,
+
+            file: Some(SeaFile::new(header, &settings)?),
+            chunk_samples: settings.frames_per_chunk as usize * channels as usize,
+            remaining_samples: total_frames.map(|frames| frames as usize * channels as usize),
+            samples: Vec::new(),
+            header_written: false,
+
+            job: None,
+            output: Vec::new(),
+            output_written: 0,
+        })
+    }
+
+    // encodes batch_chunks chunks per job on the offload, so a thread hop is paid per batch
+    pub fn offload(mut self, offload: Arc<dyn SeaOffload>, batch_chunks: usize) -> Self {
+        self.offload = Some(offload);
+        self.batch_chunks = batch_chunks.max(1);
+        self
+    }
+
+    // Writes out the encoded bytes and encodes once min_chunks full chunks are buffered.
+    // With last set, everything buffered is encoded, even a shorter chunk.
+    fn poll_encode(
+        &mut self,
+        cx: &mut Context<'_>,
+        min_chunks: usize,
+        last: bool,
+    ) -> Poll<Result<(), SeaError>> {
+        loop {
+            if let Some(job) = &mut self.job {
+                let (file, result) = ready!(job.poll(cx))?;
+                self.job = None;
+                self.file = Some(file);
+                self.output = result?;
+                self.output_written = 0;
+            }
+
+            while self.output_written < self.output.len() {
+                let pending = &self.output[self.output_written..];
+                let written = ready!(Pin::new(&mut self.writer).poll_write(cx, pending))?;
+                if written == 0 {
+                    return Poll::Ready(Err(io::Error::from(io::ErrorKind::WriteZero).into()));
+                }
+                self.output_written += written;
+            }
+
+            let full_chunks = self.samples.len() / self.chunk_samples;
+            let length = if last && (!self.samples.is_empty() || !self.header_written) {
+                self.samples.len()
+            } else if full_chunks > 0 && full_chunks >= min_chunks {
+                full_chunks * self.chunk_samples
+            } else {
+                return Poll::Ready(Ok(()));
+            };
+
+            let samples: Vec<i16> = self.samples.drain(..length).collect();
+            let mut file = self.file.take().unwrap();
+            let chunk_samples = self.chunk_samples;
+            let write_header = !self.header_written;
+            self.header_written = true;
+            self.job = Some(Job::start(self.offload.as_ref(), move || {
+                let result = encode_chunks(&mut file, &samples, chunk_samples, write_header);
+                (file, result)
+            }));
+        }
+    }
+}
+
+fn encode_chunks(
+    file: &mut SeaFile,
+    samples: &[i16],
+    chunk_samples: usize,
+    mut write_header: bool,
+) -> Result<Vec<u8>, SeaError> {
+    let mut output = Vec::new();
+    for chunk_samples in samples.chunks(chunk_samples) {
+        let chunk = file.make_chunk(chunk_samples)?;
+        // the header depends on the size of the first chunk
+        if write_header {
+            output.extend_from_slice(&file.header.serialize());
+            write_header = false;
+        }
+        output.extend_from_slice(&chunk);
+    }
+
+    // a file without samples is just the header
+    if write_header {
+        output.extend_from_slice(&file.header.serialize());
+    }
+    Ok(output)
+}
+
+impl<W: AsyncWrite + Unpin> Sink<&[i16]> for SeaEncodeSink<W> {
+    type Error = SeaError;
+
+    fn poll_ready(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Result<(), SeaError>> {
+        let this = self.get_mut();
+        let batch_chunks = this.batch_chunks;
+        this.poll_encode(cx, batch_chunks, false)
+    }
+
+    fn start_send(self: Pin<&mut Self>, samples: &[i16]) -> Result<(), SeaError> {
+        let this = self.get_mut();
+        if let Some(remaining) = &mut this.remaining_samples {
+            *remaining = remaining
+                .checked_sub(samples.len())
+                .ok_or(SeaError::TooManyFrames)?;
+        }
+        this.samples.extend_from_slice(samples);
+        Ok(())
+    }
+
+    // writes every full chunk, a shorter one would end the file
+    fn poll_flush(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Result<(), SeaError>> {
+        let this = self.get_mut();
+        ready!(this.poll_encode(cx, 1, false))?;
+        Poll::Ready(Ok(ready!(Pin::new(&mut this.writer).poll_flush(cx))?))
+    }
+
+    fn poll_close(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Result<(), SeaError>> {
+        let this = self.get_mut();
+        let channels = this.file.as_ref().map(|file| file.header.channels as usize);
+        if channels.is_some_and(|channels| !this.samples.len().is_multiple_of(channels)) {
+            return Poll::Ready(Err(SeaError::InvalidParameters));
+        }
+
+        ready!(this.poll_encode(cx, 1, true))?;
+        Poll::Ready(Ok(ready!(Pin::new(&mut this.writer).poll_close(cx))?))
+    }
+}
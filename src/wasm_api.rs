@@ -1,7 +1,25 @@
+#[cfg(feature = "decoder")]
+use alloc::vec;
+use alloc::{boxed::Box, vec::Vec};
+#[cfg(feature = "encoder")]
+use alloc::{string::String, sync::Arc};
+
+use crate::codec::file::{SeaFile, SeaFileHeader};
+
+#[cfg(feature = "encoder")]
+use crate::{encoder::EncoderSettings, sea_encode_into, sea_encoded_max_len};
+
+#[cfg(feature = "decoder")]
+use crate::{
+    realtime::{SeaRealtimeDecoder, QUANTUM_FRAMES},
+    sea_decode_into, sea_decoded_len,
+};
+
 extern "C" {
     fn js_error(ptr: *const std::os::raw::c_char);
 }
 
+#[cfg(feature = "std")]
 #[no_mangle]
 pub extern "C" fn setup() {
     use std::ffi::CString;
@@ -29,6 +47,34 @@ pub extern "C" fn setup() {
     }));
 }
 
+// without std the message is not formatted, which keeps the formatting code out of small builds
+#[cfg(not(feature = "std"))]
+#[no_mangle]
+pub extern "C" fn setup() {
+    std::panic::set_hook(Box::new(|_| unsafe {
+        js_error(c"Panicked".as_ptr());
+    }));
+}
+
+// size of the output buffer wasm_sea_encode needs at most
+#[cfg(feature = "encoder")]
+#[no_mangle]
+pub extern "C" fn wasm_sea_encoded_size(
+    input_length: usize,
+    channels: u32,
+    bitrate: f32,
+    vbr: bool,
+) -> usize {
+    let settings = EncoderSettings {
+        residual_bits: bitrate,
+        vbr,
+        ..Default::default()
+    };
+    sea_encoded_max_len(input_length / 2, channels, &settings)
+}
+
+// Encodes straight into output_buffer. Returns the number of bytes written, 0 if the buffer is too small.
+#[cfg(feature = "encoder")]
 #[no_mangle]
 pub extern "C" fn wasm_sea_encode(
     input_samples: *const i16,
@@ -40,11 +86,10 @@ pub extern "C" fn wasm_sea_encode(
     output_buffer: *mut u8,
     output_length: usize,
 ) -> usize {
-    use crate::encoder::EncoderSettings;
-    use crate::sea_encode;
-
     let input_samples = unsafe { std::slice::from_raw_parts(input_samples, input_length / 2) };
-    let encoded_data = sea_encode(
+    let output = unsafe { std::slice::from_raw_parts_mut(output_buffer, output_length) };
+
+    sea_encode_into(
         input_samples,
         sample_rate,
         channels,
@@ -53,17 +98,27 @@ pub extern "C" fn wasm_sea_encode(
             vbr,
             ..Default::default()
         },
-    );
-
-    assert!(encoded_data.len() <= output_length);
-
-    unsafe {
-        std::ptr::copy_nonoverlapping(encoded_data.as_ptr(), output_buffer, encoded_data.len());
-    }
+        output,
+    )
+    .unwrap_or(0)
+}
 
-    encoded_data.len()
+// Upper bound of the size in bytes of the decoded samples, exact for complete files. The header
+// has to be complete, encoded_length is the length of the whole file.
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn wasm_sea_decoded_size(
+    header: *const u8,
+    header_length: usize,
+    encoded_length: usize,
+) -> usize {
+    let header = unsafe { std::slice::from_raw_parts(header, header_length) };
+    sea_decoded_len(header, encoded_length) * 2
 }
 
+// Decodes straight into output_buffer, returns the number of bytes written or 0 if the file is
+// corrupt or the output buffer too small.
+#[cfg(feature = "decoder")]
 #[no_mangle]
 pub extern "C" fn wasm_sea_decode(
     encoded: *const u8,
@@ -73,25 +128,395 @@ pub extern "C" fn wasm_sea_decode(
     sample_rate: *mut u32,
     channels: *mut u32,
 ) -> usize {
-    use crate::sea_decode;
-
     let encoded_data = unsafe { std::slice::from_raw_parts(encoded, encoded_length) };
-    let decoded_data = sea_decode(encoded_data);
+    let output = unsafe { std::slice::from_raw_parts_mut(output_buffer, output_length / 2) };
 
-    assert!(decoded_data.samples.len() * 2 <= output_length);
+    let Ok(info) = sea_decode_into(encoded_data, output) else {
+        return 0;
+    };
 
     unsafe {
-        std::ptr::copy_nonoverlapping(
-            decoded_data.samples.as_ptr(),
-            output_buffer,
-            decoded_data.samples.len(),
-        );
-
-        *sample_rate = decoded_data.sample_rate;
-        *channels = decoded_data.channels;
+        *sample_rate = info.sample_rate;
+        *channels = info.channels;
+    }
+
+    info.samples * 2
+}
+
+// Handle based API: files are processed one chunk at a time, so only a single chunk
+// has to live in the WASM memory instead of the whole input and output.
+
+#[cfg(feature = "decoder")]
+pub struct WasmDecoder {
+    file: Option<SeaFile>,
+    pending: Vec<u8>,
+    frames_read: usize,
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn create_decoder() -> *mut WasmDecoder {
+    Box::into_raw(Box::new(WasmDecoder {
+        file: None,
+        pending: Vec::new(),
+        frames_read: 0,
+    }))
+}
+
+// Appends the input to the decoder and decodes at most one chunk into the output buffer.
+// Returns the number of bytes written, 0 means that more input is needed or the file has ended,
+// -1 that the file is corrupt or the output buffer too small.
+// Call it with an empty input until it returns 0 to drain all buffered chunks.
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn decode_chunk(
+    decoder: *mut WasmDecoder,
+    input: *const u8,
+    input_length: usize,
+    end_of_input: bool,
+    output_buffer: *mut i16,
+    output_length: usize,
+) -> isize {
+    let decoder = unsafe { &mut *decoder };
+
+    if input_length > 0 {
+        let input = unsafe { std::slice::from_raw_parts(input, input_length) };
+        decoder.pending.extend_from_slice(input);
     }
 
-    decoded_data.samples.len() * 2
+    if decoder.file.is_none() {
+        let header_size = match SeaFileHeader::size_from_prefix(&decoder.pending) {
+            Some(size) if size <= decoder.pending.len() => size,
+            _ => return 0,
+        };
+        let Ok(header) = SeaFileHeader::from_slice(&decoder.pending[..header_size]) else {
+            return -1;
+        };
+        decoder.pending.drain(..header_size);
+        decoder.file = Some(SeaFile::from_header(header));
+    }
+
+    let file = decoder.file.as_mut().unwrap();
+    let total_frames = file.header.total_frames as usize;
+    let remaining_frames = if total_frames > 0 {
+        if decoder.frames_read >= total_frames {
+            return 0;
+        }
+        Some(total_frames - decoder.frames_read)
+    } else {
+        None
+    };
+
+    // only the last chunk of the file can be shorter than chunk_size
+    let chunk_size = file.header.chunk_size as usize;
+    if decoder.pending.len() < chunk_size && (!end_of_input || decoder.pending.is_empty()) {
+        return 0;
+    }
+    let chunk_length = decoder.pending.len().min(chunk_size);
+
+    let output = unsafe { std::slice::from_raw_parts_mut(output_buffer, output_length / 2) };
+    let Ok(samples) = file.samples_into(
+        &decoder.pending[..chunk_length],
+        remaining_frames,
+        output,
+        None,
+    ) else {
+        return -1;
+    };
+    decoder.pending.drain(..chunk_length);
+    decoder.frames_read += samples / file.header.channels as usize;
+
+    (samples * 2) as isize
+}
+
+// header fields are 0 until the header was passed to decode_chunk
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn decoder_sample_rate(decoder: *const WasmDecoder) -> u32 {
+    let decoder = unsafe { &*decoder };
+    decoder
+        .file
+        .as_ref()
+        .map_or(0, |file| file.header.sample_rate)
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn decoder_channels(decoder: *const WasmDecoder) -> u32 {
+    let decoder = unsafe { &*decoder };
+    decoder
+        .file
+        .as_ref()
+        .map_or(0, |file| file.header.channels as u32)
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn decoder_frames_per_chunk(decoder: *const WasmDecoder) -> u32 {
+    let decoder = unsafe { &*decoder };
+    decoder
+        .file
+        .as_ref()
+        .map_or(0, |file| file.header.frames_per_chunk as u32)
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn decoder_total_frames(decoder: *const WasmDecoder) -> u32 {
+    let decoder = unsafe { &*decoder };
+    decoder
+        .file
+        .as_ref()
+        .map_or(0, |file| file.header.total_frames)
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub unsafe extern "C" fn free_decoder(decoder: *mut WasmDecoder) {
+    drop(Box::from_raw(decoder));
+}
+
+#[cfg(feature = "encoder")]
+pub struct WasmEncoder {
+    file: SeaFile,
+    header_written: bool,
+}
+
+// total_frames of 0 creates a stream, which only accepts full chunks. Returns null for invalid
+// settings.
+#[cfg(feature = "encoder")]
+#[no_mangle]
+pub extern "C" fn create_encoder(
+    sample_rate: u32,
+    channels: u32,
+    bitrate: f32,
+    vbr: bool,
+    total_frames: u32,
+) -> *mut WasmEncoder {
+    let settings = EncoderSettings {
+        residual_bits: bitrate,
+        vbr,
+        ..Default::default()
+    };
+    let header = SeaFileHeader {
+        version: 1,
+        channels: channels as u8,
+        chunk_size: 0, // will be set by the first chunk
+        frames_per_chunk: settings.frames_per_chunk,
+        sample_rate,
+        total_frames,
+        metadata: Arc::new(String::new()),
+    };
+
+    let Ok(file) = SeaFile::new(header, &settings) else {
+        return std::ptr::null_mut();
+    };
+
+    Box::into_raw(Box::new(WasmEncoder {
+        file,
+        header_written: false,
+    }))
+}
+
+#[cfg(feature = "encoder")]
+#[no_mangle]
+pub extern "C" fn encoder_frames_per_chunk(encoder: *const WasmEncoder) -> u32 {
+    let encoder = unsafe { &*encoder };
+    encoder.file.header.frames_per_chunk as u32
+}
+
+// Encodes one chunk of interleaved samples, only the last chunk can have less than frames_per_chunk frames.
+// Returns the number of bytes written, which includes the file header for the first chunk, or -1
+// if the input is not whole frames of at most one chunk or the output buffer is too small.
+#[cfg(feature = "encoder")]
+#[no_mangle]
+pub extern "C" fn encode_chunk(
+    encoder: *mut WasmEncoder,
+    input_samples: *const i16,
+    input_length: usize,
+    output_buffer: *mut u8,
+    output_length: usize,
+) -> isize {
+    let encoder = unsafe { &mut *encoder };
+    let input_samples = unsafe { std::slice::from_raw_parts(input_samples, input_length / 2) };
+
+    let full_chunk_samples =
+        encoder.file.header.frames_per_chunk as usize * encoder.file.header.channels as usize;
+    if input_samples.len() > full_chunk_samples
+        || input_samples.len() % encoder.file.header.channels as usize != 0
+    {
+        return -1;
+    }
+
+    let chunk = if input_samples.is_empty() {
+        Vec::new()
+    } else {
+        match encoder.file.make_chunk(input_samples) {
+            Ok(chunk) => chunk,
+            Err(_) => return -1,
+        }
+    };
+
+    // the header depends on the size of the first chunk
+    let header = if encoder.header_written {
+        Vec::new()
+    } else {
+        encoder.file.header.serialize()
+    };
+    if header.len() + chunk.len() > output_length {
+        return -1;
+    }
+    encoder.header_written = true;
+
+    unsafe {
+        std::ptr::copy_nonoverlapping(header.as_ptr(), output_buffer, header.len());
+        std::ptr::copy_nonoverlapping(chunk.as_ptr(), output_buffer.add(header.len()), chunk.len());
+    }
+
+    (header.len() + chunk.len()) as isize
+}
+
+#[cfg(feature = "encoder")]
+#[no_mangle]
+pub unsafe extern "C" fn free_encoder(encoder: *mut WasmEncoder) {
+    drop(Box::from_raw(encoder));
+}
+
+// Real-time decoder for an AudioWorklet. Quanta are decoded into a ring of planar float slots in
+// the WASM memory, JS reads them through Float32Array views that stay valid until the slot is reused.
+
+#[cfg(feature = "decoder")]
+pub const REALTIME_RING_SLOTS: usize = 4;
+
+#[cfg(feature = "decoder")]
+pub struct WasmRealtimeDecoder {
+    decoder: SeaRealtimeDecoder,
+    ring: Vec<f32>,
+    ring_slot: usize,
+}
+
+// Returns null if the prefix does not start with a valid header and the first bytes of a chunk.
+// The input after realtime_decoder_header_length is fed with realtime_decoder_input_buffer.
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn create_realtime_decoder(
+    prefix: *const u8,
+    prefix_length: usize,
+    input_chunks: usize,
+) -> *mut WasmRealtimeDecoder {
+    let prefix = unsafe { std::slice::from_raw_parts(prefix, prefix_length) };
+    let decoder = match SeaRealtimeDecoder::new(prefix, input_chunks) {
+        Ok(decoder) => decoder,
+        Err(_) => return std::ptr::null_mut(),
+    };
+    let channels = decoder.header().channels as usize;
+
+    Box::into_raw(Box::new(WasmRealtimeDecoder {
+        decoder,
+        ring: vec![0f32; REALTIME_RING_SLOTS * channels * QUANTUM_FRAMES],
+        ring_slot: 0,
+    }))
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_header_length(decoder: *const WasmRealtimeDecoder) -> usize {
+    let decoder = unsafe { &*decoder };
+    decoder.decoder.header_len()
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_sample_rate(decoder: *const WasmRealtimeDecoder) -> u32 {
+    let decoder = unsafe { &*decoder };
+    decoder.decoder.header().sample_rate
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_channels(decoder: *const WasmRealtimeDecoder) -> u32 {
+    let decoder = unsafe { &*decoder };
+    decoder.decoder.header().channels as u32
+}
+
+// Free part of the input buffer: write up to realtime_decoder_input_space bytes to it
+// and pass the length to realtime_decoder_commit_input.
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_input_buffer(decoder: *mut WasmRealtimeDecoder) -> *mut u8 {
+    let decoder = unsafe { &mut *decoder };
+    decoder.decoder.input_buffer().as_mut_ptr()
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_input_space(decoder: *mut WasmRealtimeDecoder) -> usize {
+    let decoder = unsafe { &mut *decoder };
+    decoder.decoder.input_buffer().len()
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_commit_input(
+    decoder: *mut WasmRealtimeDecoder,
+    length: usize,
+    end_of_input: bool,
+) {
+    let decoder = unsafe { &mut *decoder };
+    decoder.decoder.commit_input(length);
+    if end_of_input {
+        decoder.decoder.end_input();
+    }
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_ring(decoder: *const WasmRealtimeDecoder) -> *const f32 {
+    let decoder = unsafe { &*decoder };
+    decoder.ring.as_ptr()
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_ring_slots() -> usize {
+    REALTIME_RING_SLOTS
+}
+
+// Decodes the next 128 frames into a ring slot, laid out as QUANTUM_FRAMES floats per channel.
+// Returns the slot index, -1 once the whole file was played and -2 on a corrupt chunk.
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_decode_quantum(decoder: *mut WasmRealtimeDecoder) -> i32 {
+    let decoder = unsafe { &mut *decoder };
+    if decoder.decoder.ended() {
+        return -1;
+    }
+
+    let slot = decoder.ring_slot;
+    let slot_length = decoder.ring.len() / REALTIME_RING_SLOTS;
+    let output = &mut decoder.ring[slot * slot_length..(slot + 1) * slot_length];
+
+    match decoder.decoder.decode_quantum(output) {
+        Ok(_) => {
+            decoder.ring_slot = (slot + 1) % REALTIME_RING_SLOTS;
+            slot as i32
+        }
+        Err(_) => -2,
+    }
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub extern "C" fn realtime_decoder_underruns(decoder: *const WasmRealtimeDecoder) -> u32 {
+    let decoder = unsafe { &*decoder };
+    decoder.decoder.underruns()
+}
+
+#[cfg(feature = "decoder")]
+#[no_mangle]
+pub unsafe extern "C" fn free_realtime_decoder(decoder: *mut WasmRealtimeDecoder) {
+    drop(Box::from_raw(decoder));
 }
 
 #[no_mangle]
@@ -0,0 +1,268 @@
+use std::{
+    io,
+    pin::Pin,
+    sync::Arc,
+    task::{Context, Poll},
+    thread,
+};
+
+use futures::{
+    executor::{block_on, LocalPool},
+    io::{AsyncRead, AsyncWrite, Cursor},
+    task::LocalSpawnExt,
+    SinkExt, StreamExt, TryStreamExt,
+};
+use helpers::{encode_decode, gen_test_signal, TEST_SAMPLE_RATE};
+use sea_codec::{
+    encoder::EncoderSettings,
+    sea_decode, sea_decode_into, sea_encode,
+    stream::{SeaDecodeStream, SeaEncodeSink, SeaOffload},
+};
+
+extern crate sea_codec;
+
+mod helpers;
+
+// returns Pending before every read or write and then moves at most 1000 bytes
+struct Trickle<T> {
+    inner: T,
+    ready: bool,
+}
+
+impl<T> Trickle<T> {
+    fn new(inner: T) -> Self {
+        Self {
+            inner,
+            ready: false,
+        }
+    }
+
+    fn poll_turn(&mut self, cx: &mut Context<'_>) -> Poll<()> {
+        self.ready = !self.ready;
+        if self.ready {
+            cx.waker().wake_by_ref();
+            return Poll::Pending;
+        }
+        Poll::Ready(())
+    }
+}
+
+impl<T: AsyncRead + Unpin> AsyncRead for Trickle<T> {
+    fn poll_read(
+        self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+        buf: &mut [u8],
+    ) -> Poll<io::Result<usize>> {
+        let this = self.get_mut();
+        futures::ready!(this.poll_turn(cx));
+        let length = buf.len().min(1000);
+        Pin::new(&mut this.inner).poll_read(cx, &mut buf[..length])
+    }
+}
+
+impl<T: AsyncWrite + Unpin> AsyncWrite for Trickle<T> {
+    fn poll_write(
+        self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+        buf: &[u8],
+    ) -> Poll<io::Result<usize>> {
+        let this = self.get_mut();
+        futures::ready!(this.poll_turn(cx));
+        let length = buf.len().min(1000);
+        Pin::new(&mut this.inner).poll_write(cx, &buf[..length])
+    }
+
+    fn poll_flush(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        Pin::new(&mut self.get_mut().inner).poll_flush(cx)
+    }
+
+    fn poll_close(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        Pin::new(&mut self.get_mut().inner).poll_close(cx)
+    }
+}
+
+struct ThreadOffload;
+
+impl SeaOffload for ThreadOffload {
+    fn spawn(&self, job: Box<dyn FnOnce() + Send>) {
+        thread::spawn(job);
+    }
+}
+
+fn settings(vbr: bool) -> EncoderSettings {
+    EncoderSettings {
+        frames_per_chunk: 1000,
+        vbr,
+        ..Default::default()
+    }
+}
+
+async fn encode(
+    input_samples: &[i16],
+    channels: u8,
+    total_frames: Option<u32>,
+    settings: EncoderSettings,
+    offload: Option<Arc<dyn SeaOffload>>,
+) -> Vec<u8> {
+    let mut output = Trickle::new(Cursor::new(Vec::new()));
+    let sink = SeaEncodeSink::new(
+        &mut output,
+        channels,
+        TEST_SAMPLE_RATE,
+        total_frames,
+        settings,
+    );
+    let mut sink = sink.unwrap();
+    if let Some(offload) = offload {
+        sink = sink.offload(offload, 3);
+    }
+
+    // pieces that divide neither the chunk nor the frame
+    for piece in input_samples.chunks(777) {
+        sink.send(piece).await.unwrap();
+    }
+    sink.close().await.unwrap();
+    output.inner.into_inner()
+}
+
+async fn decode(encoded: &[u8], offload: Option<Arc<dyn SeaOffload>>) -> Vec<i16> {
+    let mut stream = SeaDecodeStream::new(Trickle::new(Cursor::new(encoded)));
+    if let Some(offload) = offload {
+        stream = stream.offload(offload, 3);
+    }
+
+    let chunks: Vec<Vec<i16>> = stream.try_collect().await.unwrap();
+    chunks.concat()
+}
+
+#[test]
+fn sink_and_stream_match_slice_api() {
+    let channels = 2;
+    let input_samples = gen_test_signal(channels, 10_500);
+    let total_frames = (input_samples.len() / channels as usize) as u32;
+
+    for vbr in [false, true] {
+        let reference = encode_decode(&input_samples, TEST_SAMPLE_RATE, channels, settings(vbr));
+
+        for offload in [None, Some(Arc::new(ThreadOffload) as Arc<dyn SeaOffload>)] {
+            let encoded = block_on(encode(
+                &input_samples,
+                channels as u8,
+                Some(total_frames),
+                settings(vbr),
+                offload.clone(),
+            ));
+            assert_eq!(encoded, reference.encoded);
+
+            let decoded = block_on(decode(&reference.encoded, offload.clone()));
+            assert_eq!(decoded, reference.decoded);
+
+            // without total frames the stream ends with the input, which needs full chunks
+            let full_chunks = &input_samples[..10_000 * channels as usize];
+            let encoded = block_on(encode(
+                full_chunks,
+                channels as u8,
+                None,
+                settings(vbr),
+                offload.clone(),
+            ));
+            let decoded = block_on(decode(&encoded, offload));
+            assert_eq!(decoded, sea_decode(&encoded).samples);
+            assert_eq!(decoded.len(), full_chunks.len());
+        }
+    }
+}
+
+#[test]
+fn sink_errors() {
+    let input_samples = gen_test_signal(1, 2000);
+
+    block_on(async {
+        // empty file is just the header
+        let encoded = encode(&[], 1, Some(0), settings(false), None).await;
+        assert_eq!(
+            encoded,
+            sea_encode(&[], TEST_SAMPLE_RATE, 1, settings(false))
+        );
+
+        let mut output = Cursor::new(Vec::new());
+        let mut sink = SeaEncodeSink::new(
+            &mut output,
+            1,
+            TEST_SAMPLE_RATE,
+            Some(1000),
+            settings(false),
+        )
+        .unwrap();
+        assert!(sink.send(&input_samples[..]).await.is_err());
+
+        // a partial frame at the end
+        let mut output = Cursor::new(Vec::new());
+        let mut sink =
+            SeaEncodeSink::new(&mut output, 2, TEST_SAMPLE_RATE, None, settings(false)).unwrap();
+        sink.feed(&input_samples[..3]).await.unwrap();
+        assert!(sink.close().await.is_err());
+
+        // a truncated chunk
+        let reference = encode_decode(&input_samples, TEST_SAMPLE_RATE, 1, settings(false));
+        let truncated = &reference.encoded[..reference.encoded.len() - 10];
+        let mut stream = SeaDecodeStream::new(Cursor::new(truncated));
+        assert!(stream.next().await.unwrap().is_ok());
+        assert!(stream.next().await.unwrap().is_err());
+        assert!(stream.next().await.is_none());
+    });
+}
+
+#[test]
+fn truncated_stream() {
+    let input_samples = gen_test_signal(2, 3000);
+
+    for vbr in [false, true] {
+        let settings = EncoderSettings {
+            enhancement_bits: 2,
+            ..settings(vbr)
+        };
+        let reference = encode_decode(&input_samples, TEST_SAMPLE_RATE, 2, settings);
+        let chunk_size = u16::from_le_bytes([reference.encoded[6], reference.encoded[7]]) as usize;
+
+        // cut inside the chunk header, the LMS states, the scale factors and the residuals
+        for cut in [1, 3, 10, 40, 100, chunk_size - 1] {
+            let truncated = &reference.encoded[..22 + chunk_size + cut];
+            block_on(async {
+                let mut stream = SeaDecodeStream::new(Cursor::new(truncated));
+                assert!(stream.next().await.unwrap().is_ok());
+                assert!(stream.next().await.unwrap().is_err());
+                assert!(stream.next().await.is_none());
+            });
+            assert!(sea_decode_into(truncated, &mut vec![0i16; input_samples.len()]).is_err());
+        }
+    }
+}
+
+#[test]
+fn concurrent_streams_on_one_thread() {
+    let streams = 16;
+    let mut pool = LocalPool::new();
+    let offload: Arc<dyn SeaOffload> = Arc::new(ThreadOffload);
+
+    for index in 0..streams {
+        let channels = 1 + index % 2;
+        let input_samples = gen_test_signal(channels, 3000 + index as usize * 100);
+        let reference = encode_decode(
+            &input_samples,
+            TEST_SAMPLE_RATE,
+            channels,
+            settings(index % 3 == 0),
+        );
+        let offload = (index % 2 == 0).then(|| offload.clone());
+
+        pool.spawner()
+            .spawn_local(async move {
+                let decoded = decode(&reference.encoded, offload).await;
+                assert_eq!(decoded, reference.decoded);
+            })
+            .unwrap();
+    }
+
+    pool.run();
+}
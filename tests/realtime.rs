@@ -0,0 +1,127 @@
+use std::{
+    alloc::{GlobalAlloc, Layout, System},
+    cell::Cell,
+    sync::atomic::{AtomicUsize, Ordering},
+    thread,
+};
+
+use helpers::{encode_decode, gen_test_signal, TEST_SAMPLE_RATE};
+use sea_codec::{
+    encoder::EncoderSettings,
+    realtime::{input_queue, SeaRealtimeDecoder, QUANTUM_FRAMES},
+};
+
+extern crate sea_codec;
+
+mod helpers;
+
+// counts the allocations of threads inside render_path(), every other thread allocates freely
+struct CountingAllocator;
+
+static RENDER_ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    static IN_RENDER_PATH: Cell<bool> = const { Cell::new(false) };
+}
+
+fn count_allocation() {
+    if IN_RENDER_PATH.try_with(|flag| flag.get()).unwrap_or(false) {
+        RENDER_ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        count_allocation();
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        count_allocation();
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        count_allocation();
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+fn render_path<T>(render: impl FnOnce() -> T) -> T {
+    IN_RENDER_PATH.with(|flag| flag.set(true));
+    let result = render();
+    IN_RENDER_PATH.with(|flag| flag.set(false));
+    result
+}
+
+#[test]
+fn render_path_does_not_allocate() {
+    let channels = 2;
+    // a host block size that divides neither the chunk nor the file
+    let block_frames = 441;
+    let input_samples = gen_test_signal(channels, TEST_SAMPLE_RATE as usize + 1000);
+
+    for vbr in [false, true] {
+        let reference = encode_decode(
+            &input_samples,
+            TEST_SAMPLE_RATE,
+            channels,
+            EncoderSettings {
+                vbr,
+                ..Default::default()
+            },
+        );
+
+        let mut decoder = SeaRealtimeDecoder::new(&reference.encoded, 2).unwrap();
+        let (mut writer, mut reader) = input_queue(4096);
+
+        // the I/O thread reads the file in pieces and waits while the queue is full
+        let encoded = reference.encoded[decoder.header_len()..].to_vec();
+        let io_thread = thread::spawn(move || {
+            for piece in encoded.chunks(1000) {
+                let mut piece = piece;
+                while !piece.is_empty() {
+                    piece = &piece[writer.push(piece)..];
+                    thread::yield_now();
+                }
+            }
+            writer.close();
+        });
+
+        let mut block = vec![0i16; block_frames * channels as usize];
+        let mut quantum = vec![0f32; QUANTUM_FRAMES * channels as usize];
+        let mut decoded: Vec<i16> = Vec::new();
+
+        let mut use_quantum = false;
+        while !decoder.ended() {
+            let frames = render_path(|| {
+                decoder.pull_input(&mut reader);
+                // both output layouts share the render path
+                if use_quantum {
+                    decoder.decode_quantum(&mut quantum).unwrap()
+                } else {
+                    decoder.decode_interleaved(&mut block).unwrap()
+                }
+            });
+
+            if use_quantum {
+                for frame in 0..frames {
+                    for channel in 0..channels as usize {
+                        let sample = quantum[channel * QUANTUM_FRAMES + frame];
+                        decoded.push((sample * 32768.0) as i16);
+                    }
+                }
+            } else {
+                decoded.extend_from_slice(&block[..frames * channels as usize]);
+            }
+            use_quantum = !use_quantum;
+        }
+        io_thread.join().unwrap();
+
+        assert_eq!(RENDER_ALLOCATIONS.load(Ordering::Relaxed), 0);
+        assert_eq!(decoded, reference.decoded);
+    }
+}
@@ -0,0 +1,62 @@
+#![cfg(feature = "stats")]
+
+use std::io::Cursor;
+
+use bytemuck::cast_slice;
+use helpers::{gen_test_signal, TEST_SAMPLE_RATE};
+use sea_codec::{
+    decoder::SeaDecoder,
+    encoder::{EncoderSettings, SeaEncoder},
+};
+
+extern crate sea_codec;
+
+mod helpers;
+
+#[test]
+fn stats() {
+    for vbr in [false, true] {
+        let channels = 2;
+        let input_samples = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+        let frames = input_samples.len() / channels as usize;
+        let settings = EncoderSettings {
+            vbr,
+            ..Default::default()
+        };
+        let chunks = frames.div_ceil(settings.frames_per_chunk as usize) as u64;
+
+        let u8_input_samples: &[u8] = cast_slice(&input_samples);
+        let mut encoded = Vec::new();
+        let mut encoder = SeaEncoder::new(
+            channels as u8,
+            TEST_SAMPLE_RATE,
+            Some(frames as u32),
+            settings,
+            Cursor::new(u8_input_samples),
+            &mut encoded,
+        )
+        .unwrap();
+        while encoder.encode_frame().unwrap() {}
+        encoder.finalize().unwrap();
+
+        let encoder_stats = encoder.stats();
+        assert_eq!(encoder_stats.chunks, chunks);
+        assert_eq!(encoder_stats.bytes_read, u8_input_samples.len() as u64);
+        assert_eq!(encoder_stats.bytes_written, encoded.len() as u64);
+        assert!(encoder_stats.scale_factor_candidates > 0);
+        assert!(encoder_stats.early_exits > 0);
+        assert!(!encoder_stats.residuals_time.is_zero());
+        assert_eq!(encoder_stats.analyze_time.is_zero(), !vbr);
+
+        let mut decoded = Vec::new();
+        let mut decoder = SeaDecoder::new(Cursor::new(&encoded), &mut decoded).unwrap();
+        while decoder.decode_frame().unwrap() {}
+        decoder.finalize().unwrap();
+
+        let decoder_stats = decoder.stats();
+        assert_eq!(decoder_stats.chunks, chunks);
+        assert_eq!(decoder_stats.bytes_written, decoded.len() as u64);
+        assert_eq!(decoded.len(), u8_input_samples.len());
+        assert_eq!(decoder_stats.scale_factor_candidates, 0);
+    }
+}
@@ -9,6 +9,9 @@ use helpers::{encode_decode, gen_test_signal, TEST_SAMPLE_RATE};
 use sea_codec::{
     decoder::SeaDecoder,
     encoder::{EncoderSettings, SeaEncoder},
+    fixed_decoder::SeaFixedDecoder,
+    realtime::{SeaRealtimeDecoder, QUANTUM_FRAMES},
+    sea_decode, sea_encode,
 };
 
 extern crate sea_codec;
@@ -95,3 +98,285 @@ fn streaming() {
         i16_sea_decoded[..]
     );
 }
+
+#[test]
+fn reset_between_files() {
+    // settings change between files, including the tables behind scale_factor_bits and vbr
+    let files = [
+        (1, 3000, EncoderSettings::default()),
+        (
+            2,
+            12_000,
+            EncoderSettings {
+                vbr: true,
+                residual_bits: 2.5,
+                ..Default::default()
+            },
+        ),
+        (
+            2,
+            7000,
+            EncoderSettings {
+                scale_factor_bits: 5,
+                frames_per_chunk: 2000,
+                ..Default::default()
+            },
+        ),
+        (1, 0, EncoderSettings::default()),
+        (1, 9000, EncoderSettings::default()),
+    ];
+
+    let mut encoder: Option<SeaEncoder<Cursor<Vec<u8>>, SharedBuffer>> = None;
+    let mut decoder: Option<SeaDecoder<Cursor<Vec<u8>>, SharedBuffer>> = None;
+    let decoded = SharedBuffer::new(0);
+
+    for (channels, frames, settings) in files {
+        let input_samples = gen_test_signal(channels, frames);
+        let reference = sea_encode(&input_samples, TEST_SAMPLE_RATE, channels, settings.clone());
+
+        let reader = Cursor::new(cast_slice(&input_samples).to_vec());
+        let encoded = SharedBuffer::new(0);
+        let total_frames = Some((input_samples.len() / channels as usize) as u32);
+        match &mut encoder {
+            Some(encoder) => encoder
+                .reset(
+                    channels as u8,
+                    TEST_SAMPLE_RATE,
+                    total_frames,
+                    settings,
+                    reader,
+                    encoded.clone(),
+                )
+                .unwrap(),
+            None => {
+                encoder = Some(
+                    SeaEncoder::new(
+                        channels as u8,
+                        TEST_SAMPLE_RATE,
+                        total_frames,
+                        settings,
+                        reader,
+                        encoded.clone(),
+                    )
+                    .unwrap(),
+                )
+            }
+        }
+        while encoder.as_mut().unwrap().encode_frame().unwrap() {}
+        let encoded = encoded.buffer.take();
+        assert_eq!(encoded, reference);
+
+        // an empty file is not decodable
+        if frames == 0 {
+            continue;
+        }
+        let reader = Cursor::new(encoded);
+        match &mut decoder {
+            Some(decoder) => decoder.reset(reader).unwrap(),
+            None => decoder = Some(SeaDecoder::new(reader, decoded.clone()).unwrap()),
+        }
+        while decoder.as_mut().unwrap().decode_frame().unwrap() {}
+        let samples: Vec<i16> = cast_slice(&decoded.buffer.take()).to_vec();
+        assert_eq!(samples, sea_decode(&reference).samples);
+    }
+}
+
+#[test]
+fn reset_after_error() {
+    let channels = 2;
+    let input_samples = gen_test_signal(channels, 12000);
+    let settings = EncoderSettings {
+        frames_per_chunk: 2000,
+        ..Default::default()
+    };
+    let reference = sea_encode(&input_samples, TEST_SAMPLE_RATE, channels, settings.clone());
+    let total_frames = Some((input_samples.len() / channels as usize) as u32);
+
+    let encoded = SharedBuffer::new(0);
+    let mut encoder = SeaEncoder::new(
+        channels as u8,
+        TEST_SAMPLE_RATE,
+        total_frames,
+        settings.clone(),
+        Cursor::new(cast_slice(&input_samples).to_vec()),
+        encoded.clone(),
+    )
+    .unwrap();
+    assert!(encoder.encode_frame().unwrap());
+
+    // a rejected reset leaves the current file as it was
+    let invalid = EncoderSettings {
+        enhancement_bits: 9,
+        ..settings.clone()
+    };
+    let ignored = SharedBuffer::new(0);
+    assert!(encoder
+        .reset(
+            channels as u8,
+            TEST_SAMPLE_RATE,
+            total_frames,
+            invalid,
+            Cursor::new(Vec::new()),
+            ignored.clone(),
+        )
+        .is_err());
+    while encoder.encode_frame().unwrap() {}
+    assert_eq!(encoded.buffer.take(), reference);
+
+    let encoded = SharedBuffer::new(0);
+    encoder
+        .reset(
+            channels as u8,
+            TEST_SAMPLE_RATE,
+            total_frames,
+            settings,
+            Cursor::new(cast_slice(&input_samples).to_vec()),
+            encoded.clone(),
+        )
+        .unwrap();
+    while encoder.encode_frame().unwrap() {}
+    assert_eq!(encoded.buffer.take(), reference);
+    assert!(ignored.buffer.take().is_empty());
+}
+
+#[test]
+fn realtime_quanta() {
+    let channels = 2;
+    // not a multiple of the chunk or quantum size, so the last chunk and quantum are partial
+    let input_samples = gen_test_signal(channels, TEST_SAMPLE_RATE as usize + 1000);
+
+    for vbr in [false, true] {
+        let reference = encode_decode(
+            &input_samples,
+            TEST_SAMPLE_RATE,
+            channels,
+            EncoderSettings {
+                vbr,
+                ..Default::default()
+            },
+        );
+
+        let mut decoder = SeaRealtimeDecoder::new(&reference.encoded, 2).unwrap();
+        let mut input = &reference.encoded[decoder.header_len()..];
+
+        let mut output = vec![0f32; QUANTUM_FRAMES * channels as usize];
+        let mut decoded: Vec<f32> = Vec::new();
+
+        while !decoder.ended() {
+            // feed the input in small pieces, as it would arrive from a network stream
+            let taken = decoder.push_input(&input[..input.len().min(1000)]);
+            input = &input[taken..];
+            if input.is_empty() {
+                decoder.end_input();
+            }
+
+            let frames = decoder.decode_quantum(&mut output).unwrap();
+            for frame in 0..frames {
+                for channel in 0..channels as usize {
+                    decoded.push(output[channel * QUANTUM_FRAMES + frame]);
+                }
+            }
+        }
+
+        assert_eq!(decoded.len(), reference.decoded.len());
+        for (sample, reference_sample) in decoded.iter().zip(reference.decoded.iter()) {
+            assert_eq!(*sample, *reference_sample as f32 / 32768.0);
+        }
+    }
+}
+
+#[test]
+fn realtime_corrupt_input() {
+    let channels = 2;
+    let input_samples = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+    let encoded = sea_encode(
+        &input_samples,
+        TEST_SAMPLE_RATE,
+        channels,
+        EncoderSettings::default(),
+    );
+    let chunk_size = u16::from_le_bytes([encoded[6], encoded[7]]) as usize;
+
+    // decodes the first chunk, then has to fail instead of panicking
+    let decode_until_error = |encoded: &[u8]| {
+        let mut decoder = SeaRealtimeDecoder::new(encoded, 2).unwrap();
+        decoder.push_input(&encoded[decoder.header_len()..]);
+        decoder.end_input();
+
+        let mut output = vec![0f32; QUANTUM_FRAMES * channels as usize];
+        while !decoder.ended() {
+            if decoder.decode_quantum(&mut output).is_err() {
+                return true;
+            }
+        }
+        false
+    };
+
+    // a download cut one byte into the second chunk
+    let header_len = 22;
+    assert!(decode_until_error(&encoded[..header_len + chunk_size + 1]));
+
+    // a second chunk with other scale factor bits
+    let mut changed = encoded[..header_len + chunk_size * 2].to_vec();
+    changed[header_len + chunk_size + 1] ^= 0x10;
+    assert!(decode_until_error(&changed));
+}
+
+#[test]
+fn fixed_decoder() {
+    // built at compile time, as it would be in a static
+    const DECODER: SeaFixedDecoder<2> = SeaFixedDecoder::new();
+
+    let channels = 2;
+    // the last chunk is partial
+    let input_samples = gen_test_signal(channels, TEST_SAMPLE_RATE as usize + 1000);
+
+    let fixed_decode = |encoded: &[u8]| {
+        let mut decoder = DECODER;
+        let header_len = decoder.init(encoded).unwrap();
+        assert_eq!(decoder.channels(), channels as usize);
+        assert_eq!(decoder.sample_rate(), TEST_SAMPLE_RATE);
+
+        let mut output = vec![0i16; decoder.frames_per_chunk() * decoder.channels()];
+        let mut decoded: Vec<i16> = Vec::new();
+        for chunk in encoded[header_len..].chunks(decoder.chunk_size()) {
+            let samples = decoder.decode_chunk(chunk, &mut output).unwrap();
+            decoded.extend_from_slice(&output[..samples]);
+        }
+        decoded
+    };
+
+    for (residual_bits, vbr) in [(3.0, false), (5.0, false), (2.5, true), (4.5, true)] {
+        let reference = encode_decode(
+            &input_samples,
+            TEST_SAMPLE_RATE,
+            channels,
+            EncoderSettings {
+                residual_bits,
+                vbr,
+                ..Default::default()
+            },
+        );
+
+        assert_eq!(fixed_decode(&reference.encoded), reference.decoded);
+    }
+
+    // only the base layer of layered chunks is decoded
+    let encode = |enhancement_bits| {
+        let settings = EncoderSettings {
+            enhancement_bits,
+            ..Default::default()
+        };
+        encode_decode(&input_samples, TEST_SAMPLE_RATE, channels, settings)
+    };
+    assert_eq!(fixed_decode(&encode(2).encoded), encode(0).decoded);
+
+    let encoded = encode_decode(
+        &input_samples,
+        TEST_SAMPLE_RATE,
+        channels,
+        EncoderSettings::default(),
+    )
+    .encoded;
+    assert!(SeaFixedDecoder::<1>::new().init(&encoded).is_err());
+}
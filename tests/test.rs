@@ -1,5 +1,12 @@
-use helpers::{encode_decode, gen_test_signal, TEST_SAMPLE_RATE};
-use sea_codec::encoder::EncoderSettings;
+use bytemuck::cast_slice;
+use helpers::{encode_decode, gen_test_signal, get_audio_quality, TEST_SAMPLE_RATE};
+use sea_codec::{
+    encoder::{ChannelQuality, EncoderSettings, QualityTarget, SeaEncoder},
+    sample::SeaGain,
+    sea_decode, sea_decode_into, sea_decode_into_gain, sea_decoded_len, sea_drop_enhancement,
+    sea_encode, sea_encode_into, sea_encode_quality, sea_encoded_max_len, sea_extract_channels,
+    sea_rechunk,
+};
 
 extern crate sea_codec;
 
@@ -62,3 +69,576 @@ fn test_parameters() {
         }
     }
 }
+
+#[test]
+fn test_chunk_stats() {
+    let channels = 2;
+    let frames = TEST_SAMPLE_RATE as usize;
+    let input = gen_test_signal(channels, frames);
+    let input = &input[..frames * channels as usize];
+
+    for vbr in [false, true] {
+        let settings = EncoderSettings {
+            residual_bits: if vbr { 3.5 } else { 3.0 },
+            vbr,
+            ..Default::default()
+        };
+        let frames_per_chunk = settings.frames_per_chunk as usize;
+
+        let mut reader: &[u8] = cast_slice(input);
+        let mut encoded = Vec::new();
+        let mut encoder = SeaEncoder::new(
+            channels as u8,
+            TEST_SAMPLE_RATE,
+            Some(frames as u32),
+            settings,
+            &mut reader,
+            &mut encoded,
+        )
+        .unwrap();
+
+        let mut chunk_stats = Vec::new();
+        loop {
+            let more = encoder.encode_frame().unwrap();
+            chunk_stats.push(encoder.chunk_stats().unwrap().clone());
+            if !more {
+                break;
+            }
+        }
+        drop(encoder);
+
+        let decoded = sea_decode(&encoded).samples;
+        assert_eq!(chunk_stats.len(), frames.div_ceil(frames_per_chunk));
+
+        for (chunk_index, stats) in chunk_stats.iter().enumerate() {
+            let start = chunk_index * frames_per_chunk * channels as usize;
+            let end = (start + frames_per_chunk * channels as usize).min(input.len());
+            assert_eq!(stats.frames, (end - start) / channels as usize);
+
+            for (channel, quality) in stats.channels.iter().enumerate() {
+                let sse: u64 = input[start + channel..end]
+                    .iter()
+                    .zip(decoded[start + channel..end].iter())
+                    .step_by(channels as usize)
+                    .map(|(a, b)| (*a as i64 - *b as i64).pow(2) as u64)
+                    .sum();
+                assert_eq!(quality.sse, sse);
+            }
+
+            let groups = stats.frames.div_ceil(20) * channels as usize;
+            assert_eq!(
+                stats.scale_factor_histogram.iter().sum::<u32>() as usize,
+                groups
+            );
+            assert_eq!(
+                stats.residual_size_histogram.iter().sum::<u32>() as usize,
+                groups
+            );
+            if !vbr {
+                assert_eq!(stats.residual_size_histogram[3] as usize, groups);
+            }
+        }
+    }
+}
+
+#[test]
+fn test_encode_quality() {
+    let channels = 2;
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+
+    // quality of the worst channel of the worst chunk, computed from the decoded samples
+    let worst_psnr = |settings: &EncoderSettings, encoded: &[u8]| {
+        let decoded = sea_decode(encoded).samples;
+        let chunk_samples = settings.frames_per_chunk as usize * channels as usize;
+        let mut worst = f64::NEG_INFINITY;
+        for (input, decoded) in input
+            .chunks(chunk_samples)
+            .zip(decoded.chunks(chunk_samples))
+        {
+            for channel in 0..channels as usize {
+                let sse: u64 = input[channel..]
+                    .iter()
+                    .zip(decoded[channel..].iter())
+                    .step_by(channels as usize)
+                    .map(|(a, b)| (*a as i64 - *b as i64).pow(2) as u64)
+                    .sum();
+                let frames = input.len() / channels as usize;
+                worst = worst.max(ChannelQuality::new(sse, frames).psnr);
+            }
+        }
+        worst
+    };
+
+    for vbr in [false, true] {
+        let settings = EncoderSettings {
+            vbr,
+            ..Default::default()
+        };
+
+        for target_psnr in [-15.0, -20.0, -30.0] {
+            let target = QualityTarget::Psnr(target_psnr);
+            let result =
+                sea_encode_quality(&input, TEST_SAMPLE_RATE, channels, settings.clone(), target)
+                    .unwrap();
+            assert!(result.target_reached);
+            assert!(worst_psnr(&result.settings, &result.encoded) <= target_psnr);
+            assert_eq!(
+                result.encoded,
+                sea_encode(&input, TEST_SAMPLE_RATE, channels, result.settings.clone())
+            );
+
+            // the next lower bitrate misses the target
+            let step = if vbr { 0.125 } else { 1.0 };
+            let lowest = if vbr { 1.5 } else { 1.0 };
+            if result.settings.residual_bits > lowest {
+                let lower = EncoderSettings {
+                    residual_bits: result.settings.residual_bits - step,
+                    ..result.settings.clone()
+                };
+                let encoded = sea_encode(&input, TEST_SAMPLE_RATE, channels, lower.clone());
+                assert!(worst_psnr(&lower, &encoded) > target_psnr);
+            }
+        }
+
+        // out of reach, encoded at the highest bitrate
+        let target = QualityTarget::Rms(0.0);
+        let result =
+            sea_encode_quality(&input, TEST_SAMPLE_RATE, channels, settings.clone(), target)
+                .unwrap();
+        assert!(!result.target_reached);
+        assert_eq!(result.settings.residual_bits, if vbr { 7.0 } else { 8.0 });
+    }
+
+    // short chunks and dense scale factors leave less than a bit for VBR residuals at the lowest rates
+    for (frames_per_chunk, scale_factor_frames, scale_factor_bits) in
+        [(1000, 10, 4), (1000, 5, 5), (500, 5, 5)]
+    {
+        let settings = EncoderSettings {
+            vbr: true,
+            residual_bits: 4.0,
+            frames_per_chunk,
+            scale_factor_frames,
+            scale_factor_bits,
+            ..Default::default()
+        };
+        let target = QualityTarget::Psnr(-15.0);
+        let result =
+            sea_encode_quality(&input, TEST_SAMPLE_RATE, channels, settings.clone(), target)
+                .unwrap();
+        assert!(result.target_reached);
+        assert!(worst_psnr(&result.settings, &result.encoded) <= -15.0);
+        assert_eq!(
+            result.encoded,
+            sea_encode(&input, TEST_SAMPLE_RATE, channels, result.settings.clone())
+        );
+    }
+}
+
+#[test]
+fn test_encode_decode_into() {
+    for channels in [1, 2, 5] {
+        let frames = TEST_SAMPLE_RATE as usize / 2 + 123;
+        let input = gen_test_signal(channels, frames);
+        let input = &input[..frames * channels as usize];
+
+        for (residual_bits, vbr) in [
+            (1.0, false),
+            (3.0, false),
+            (8.0, false),
+            (2.5, true),
+            (6.9, true),
+        ] {
+            let settings = EncoderSettings {
+                residual_bits,
+                vbr,
+                ..Default::default()
+            };
+
+            let reference = sea_encode(input, TEST_SAMPLE_RATE, channels, settings.clone());
+            let max_len = sea_encoded_max_len(input.len(), channels, &settings);
+            assert!(reference.len() <= max_len);
+
+            let mut encoded = vec![0u8; max_len];
+            let encoded_len = sea_encode_into(
+                input,
+                TEST_SAMPLE_RATE,
+                channels,
+                settings.clone(),
+                &mut encoded,
+            )
+            .unwrap();
+            assert_eq!(&encoded[..encoded_len], &reference[..]);
+
+            let mut too_small = vec![0u8; encoded_len - 1];
+            assert!(
+                sea_encode_into(input, TEST_SAMPLE_RATE, channels, settings, &mut too_small)
+                    .is_err()
+            );
+
+            let encoded = &encoded[..encoded_len];
+            let decoded_len = sea_decoded_len(encoded, encoded.len());
+            assert_eq!(decoded_len, input.len());
+
+            let mut decoded = vec![0i16; decoded_len];
+            let info = sea_decode_into(encoded, &mut decoded).unwrap();
+            assert_eq!(info.samples, decoded_len);
+            assert_eq!(info.channels, channels);
+            assert_eq!(info.sample_rate, TEST_SAMPLE_RATE);
+            assert_eq!(decoded, sea_decode(encoded).samples);
+
+            assert!(sea_decode_into(encoded, &mut decoded[..decoded_len - 1]).is_err());
+
+            // a file cut after its first chunk decodes into the bound
+            let chunk_size = u16::from_le_bytes([encoded[6], encoded[7]]) as usize;
+            let cut = &encoded[..22 + chunk_size];
+            let mut decoded = vec![0i16; sea_decoded_len(cut, cut.len())];
+            assert!(decoded.len() < input.len());
+            sea_decode_into(cut, &mut decoded).unwrap();
+        }
+    }
+}
+
+#[test]
+fn test_decode_header_only() {
+    // a header that claims far more frames than the file holds
+    let mut header = sea_encode(&[0; 200], TEST_SAMPLE_RATE, 2, EncoderSettings::default());
+    header.truncate(22);
+    header[5] = 255;
+    header[14..18].copy_from_slice(&u32::MAX.to_le_bytes());
+
+    assert_eq!(sea_decoded_len(&header, header.len()), 0);
+    assert!(sea_decode(&header).samples.is_empty());
+}
+
+#[test]
+fn test_decode_sample_types() {
+    let channels = 2;
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+    for vbr in [false, true] {
+        let settings = EncoderSettings {
+            vbr,
+            ..Default::default()
+        };
+        let encoded = sea_encode(&input, TEST_SAMPLE_RATE, channels, settings);
+        let reference = sea_decode(&encoded).samples;
+
+        let mut decoded_i32 = vec![0i32; reference.len()];
+        sea_decode_into(&encoded, &mut decoded_i32).unwrap();
+        let mut decoded_f32 = vec![0f32; reference.len()];
+        sea_decode_into(&encoded, &mut decoded_f32).unwrap();
+        for (i, sample) in reference.iter().enumerate() {
+            assert_eq!(decoded_i32[i], (*sample as i32) << 16);
+            assert_eq!(decoded_f32[i], *sample as f32 / 32768.0);
+        }
+
+        let mut halved = vec![0i16; reference.len()];
+        sea_decode_into_gain(&encoded, &mut halved, SeaGain::constant(0.5)).unwrap();
+        for (sample, reference_sample) in halved.iter().zip(reference.iter()) {
+            assert_eq!(*sample, (*reference_sample as f32 * 0.5).round() as i16);
+        }
+
+        // fade out over the first 1000 frames, both channels of a frame share the gain
+        let mut faded = vec![0f32; reference.len()];
+        sea_decode_into_gain(&encoded, &mut faded, SeaGain::ramp(1.0, 0.0, 1000)).unwrap();
+        assert_eq!(&faded[..2], &decoded_f32[..2]);
+        let frame_gain = |frame: usize| faded[frame * 2] / decoded_f32[frame * 2];
+        let louder = (1..1000).find(|&frame| decoded_f32[frame * 2].abs() > 0.01);
+        let louder = louder.unwrap();
+        assert!((frame_gain(louder) - (1.0 - louder as f32 / 1000.0)).abs() < 1e-3);
+        assert!(faded[2000..].iter().all(|sample| *sample == 0.0));
+    }
+}
+
+#[test]
+fn test_encode_effort() {
+    let channels = 2;
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+
+    for (residual_bits, vbr) in [(1.0, false), (3.0, false), (2.5, true)] {
+        let encode = |effort| {
+            let settings = EncoderSettings {
+                residual_bits,
+                vbr,
+                effort,
+                ..Default::default()
+            };
+            encode_decode(&input, TEST_SAMPLE_RATE, channels, settings)
+        };
+
+        let greedy = encode(0);
+        let greedy_psnr = get_audio_quality(&input, &greedy.decoded).psnr;
+        let mut previous_psnr = greedy_psnr;
+        for effort in 1..=3 {
+            // same bitstream size, every effort decodes with the same decoder
+            let optimized = encode(effort);
+            assert_eq!(optimized.encoded.len(), greedy.encoded.len());
+            assert_eq!(optimized.decoded.len(), input.len());
+
+            let psnr = get_audio_quality(&input, &optimized.decoded).psnr;
+            assert!(psnr < previous_psnr);
+            previous_psnr = psnr;
+        }
+        assert!(previous_psnr < greedy_psnr - 1.0);
+    }
+}
+
+#[test]
+fn test_optimize_lms() {
+    let channels = 2;
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+
+    for (residual_bits, vbr, frames_per_chunk) in
+        [(1.0, false, 240), (3.0, false, 5120), (4.0, true, 1000)]
+    {
+        let encode = |optimize_lms| {
+            let settings = EncoderSettings {
+                residual_bits,
+                vbr,
+                frames_per_chunk,
+                optimize_lms,
+                ..Default::default()
+            };
+            encode_decode(&input, TEST_SAMPLE_RATE, channels, settings)
+        };
+
+        let carried = encode(false);
+        let optimized = encode(true);
+        assert_eq!(optimized.encoded.len(), carried.encoded.len());
+        assert_eq!(optimized.decoded.len(), input.len());
+        assert!(
+            get_audio_quality(&input, &optimized.decoded).psnr
+                < get_audio_quality(&input, &carried.decoded).psnr
+        );
+    }
+}
+
+#[test]
+fn test_channel_bit_offsets() {
+    let channels = 6;
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+    let channel_sse = |decoded: &[i16], channel: usize| -> u64 {
+        input[channel..]
+            .iter()
+            .zip(decoded[channel..].iter())
+            .step_by(channels as usize)
+            .map(|(a, b)| (*a as i64 - *b as i64).pow(2) as u64)
+            .sum()
+    };
+
+    for (residual_bits, vbr) in [(4.0, false), (4.5, true)] {
+        let settings = EncoderSettings {
+            residual_bits,
+            vbr,
+            ..Default::default()
+        };
+        // 5.1 with fewer bits for the LFE and the surround channels
+        let weighted = EncoderSettings {
+            channel_bit_offsets: vec![0, 0, 0, -2, -1, -1],
+            ..settings.clone()
+        };
+
+        let uniform = encode_decode(&input, TEST_SAMPLE_RATE, channels, settings);
+        let offset = encode_decode(&input, TEST_SAMPLE_RATE, channels, weighted.clone());
+        assert!(offset.encoded.len() < uniform.encoded.len() * 9 / 10);
+        assert!(offset.encoded.len() <= sea_encoded_max_len(input.len(), channels, &weighted));
+        assert_eq!(offset.decoded.len(), input.len());
+
+        for channel in 0..3 {
+            if vbr {
+                // the front channels keep their bitrate
+                let uniform_sse = channel_sse(&uniform.decoded, channel);
+                assert!(channel_sse(&offset.decoded, channel) < uniform_sse * 11 / 10);
+            } else {
+                // channels are encoded independently, so CBR fronts are unchanged
+                assert_eq!(
+                    channel_sse(&offset.decoded, channel),
+                    channel_sse(&uniform.decoded, channel)
+                );
+            }
+        }
+        assert!(channel_sse(&offset.decoded, 3) > channel_sse(&offset.decoded, 0) * 4);
+    }
+
+    // one offset per channel, CBR sizes at most 3 bits apart
+    for (residual_bits, offsets) in [(4.0, vec![0, -1]), (3.0, vec![0, 0, 0, -3, 0, 1])] {
+        let settings = EncoderSettings {
+            residual_bits,
+            channel_bit_offsets: offsets,
+            ..Default::default()
+        };
+        let mut encoded = Vec::new();
+        let encoder = SeaEncoder::new(
+            channels as u8,
+            TEST_SAMPLE_RATE,
+            None,
+            settings,
+            &[0u8][..],
+            &mut encoded,
+        );
+        assert!(encoder.is_err());
+    }
+}
+
+#[test]
+fn test_enhancement_layer() {
+    let channels = 2;
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize);
+
+    for (residual_bits, vbr, enhancement_bits) in [(2.0, false, 2), (3.0, false, 1), (2.5, true, 3)]
+    {
+        let base_settings = EncoderSettings {
+            residual_bits,
+            vbr,
+            frames_per_chunk: 5000,
+            ..Default::default()
+        };
+        let layered_settings = EncoderSettings {
+            enhancement_bits,
+            ..base_settings.clone()
+        };
+        let base = encode_decode(&input, TEST_SAMPLE_RATE, channels, base_settings);
+        let layered = encode_decode(&input, TEST_SAMPLE_RATE, channels, layered_settings.clone());
+        assert!(
+            layered.encoded.len() <= sea_encoded_max_len(input.len(), channels, &layered_settings)
+        );
+        assert_eq!(layered.decoded.len(), input.len());
+
+        // both layers decode to a higher quality than the base layer
+        let base_psnr = get_audio_quality(&input, &base.decoded).psnr;
+        let layered_psnr = get_audio_quality(&input, &layered.decoded).psnr;
+        assert!(layered_psnr < base_psnr - 2.0);
+
+        // without the enhancement layer the file is the one of the base layer alone
+        assert_eq!(
+            sea_drop_enhancement(&layered.encoded).unwrap(),
+            base.encoded
+        );
+        assert_eq!(sea_drop_enhancement(&base.encoded).unwrap(), base.encoded);
+    }
+
+    // VBR chunks close to the 16 bit chunk size, well below the bound of sea_encoded_max_len
+    let settings = EncoderSettings {
+        residual_bits: 5.0,
+        vbr: true,
+        ..Default::default()
+    };
+    let input = gen_test_signal(16, 6000);
+    let encoded = sea_encode(&input, TEST_SAMPLE_RATE, 16, settings);
+    assert!(u16::from_le_bytes([encoded[6], encoded[7]]) > 50000);
+    assert_eq!(sea_decode(&encoded).samples.len(), input.len());
+
+    // 7.1 chunks of 8 + 8 bits do not fit the 16 bit chunk size
+    let settings = EncoderSettings {
+        residual_bits: 8.0,
+        enhancement_bits: 8,
+        ..Default::default()
+    };
+    let input = gen_test_signal(8, 100);
+    let mut encoded = vec![0u8; sea_encoded_max_len(input.len(), 8, &settings)];
+    assert!(sea_encode_into(&input, TEST_SAMPLE_RATE, 8, settings, &mut encoded).is_err());
+}
+
+#[test]
+fn test_rechunk() {
+    let channels = 2;
+    // the last chunk is partial
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize + 1000);
+
+    let cases = [
+        EncoderSettings::default(),
+        EncoderSettings {
+            residual_bits: 3.5,
+            vbr: true,
+            ..Default::default()
+        },
+        EncoderSettings {
+            residual_bits: 2.5,
+            vbr: true,
+            enhancement_bits: 2,
+            ..Default::default()
+        },
+        EncoderSettings {
+            frames_per_chunk: 1000,
+            optimize_lms: true,
+            ..Default::default()
+        },
+    ];
+    for settings in cases {
+        let original = encode_decode(&input, TEST_SAMPLE_RATE, channels, settings.clone());
+
+        for frames_per_chunk in [20, 200, 480, 3000, 5120, 20000] {
+            let rechunked = sea_rechunk(&original.encoded, frames_per_chunk);
+
+            // chunks that start with new LMS weights cannot be joined
+            let joins = !settings.frames_per_chunk.is_multiple_of(frames_per_chunk);
+            if settings.optimize_lms && joins {
+                assert!(rechunked.is_err());
+                continue;
+            }
+            let rechunked = rechunked.unwrap();
+            assert_eq!(sea_decode(&rechunked).samples, original.decoded);
+            let base = sea_drop_enhancement(&original.encoded).unwrap();
+            assert_eq!(
+                sea_decode(&sea_drop_enhancement(&rechunked).unwrap()).samples,
+                sea_decode(&base).samples
+            );
+
+            // back to the original chunks
+            let restored = sea_rechunk(&rechunked, settings.frames_per_chunk).unwrap();
+            assert_eq!(restored, original.encoded);
+        }
+
+        // chunks hold whole scale factor groups
+        assert!(sea_rechunk(&original.encoded, 510).is_err());
+    }
+}
+
+#[test]
+fn test_extract_channels() {
+    let channels = 6;
+    let input = gen_test_signal(channels, TEST_SAMPLE_RATE as usize + 1000);
+
+    let cases = [
+        EncoderSettings::default(),
+        EncoderSettings {
+            residual_bits: 3.5,
+            vbr: true,
+            ..Default::default()
+        },
+        EncoderSettings {
+            channel_bit_offsets: vec![0, 0, 0, -2, -1, -1],
+            ..Default::default()
+        },
+        EncoderSettings {
+            residual_bits: 2.5,
+            vbr: true,
+            enhancement_bits: 2,
+            optimize_lms: true,
+            ..Default::default()
+        },
+    ];
+    for settings in cases {
+        let original = encode_decode(&input, TEST_SAMPLE_RATE, channels, settings.clone());
+
+        for selection in [vec![0], vec![0, 1], vec![5, 2, 3], (0..6).collect()] {
+            let extracted = sea_extract_channels(&original.encoded, &selection).unwrap();
+            let decoded = sea_decode(&extracted);
+            assert_eq!(decoded.channels, selection.len() as u32);
+
+            let expected: Vec<i16> = original
+                .decoded
+                .chunks_exact(channels as usize)
+                .flat_map(|frame| selection.iter().map(|channel| frame[*channel]))
+                .collect();
+            assert_eq!(decoded.samples, expected);
+            assert!(extracted.len() <= original.encoded.len());
+        }
+
+        // all channels in their order give back the same file
+        let all = sea_extract_channels(&original.encoded, &[0, 1, 2, 3, 4, 5]).unwrap();
+        assert_eq!(all, original.encoded);
+
+        assert!(sea_extract_channels(&original.encoded, &[]).is_err());
+        assert!(sea_extract_channels(&original.encoded, &[0, 6]).is_err());
+    }
+}
@@ -1,6 +1,7 @@
+import { parallelDecode, parallelEncode } from "./parallel.mjs";
 import { downloadFile, formatNumber, readFile } from "./utils.mjs";
 
-const worker = (() => {
+function createWorker() {
   const w = new Worker("worker.mjs", {
     type: "module",
   });
@@ -19,16 +20,17 @@ const worker = (() => {
 
   const call = (fn, ...args) =>
     new Promise((resolve, reject) => {
-      callbacks[id] = resolve;
-      w.postMessage([id, fn, ...args]);
+      const callId = id++;
+      callbacks[callId] = resolve;
+      w.postMessage([callId, fn, ...args]);
     });
 
-  return {
-    decodeAudioFile: (...args) => call("decodeAudioFile", ...args),
-    encodeSEA: (...args) => call("encodeSEA", ...args),
-    decodeSEA: (...args) => call("decodeSEA", ...args),
-  };
-})();
+  return { call };
+}
+
+// every worker has its own wasm instance, chunk ranges are spread over all of them
+const workers = [...Array(navigator.hardwareConcurrency || 4).keys()].map(createWorker);
+const worker = workers[0];
 
 const DOM_ENCODE_DROP = document.getElementById("encode_drop");
 const DOM_ENCODE_FILE = document.getElementById("encode_input");
@@ -64,27 +66,33 @@ DOM_ENCODE_SUBMIT.addEventListener("click", async () => {
     samples: interleavedInput,
     sampleRate,
     channels,
-  } = await worker.decodeAudioFile(inputArrayBuffer);
+  } = await worker.call("decodeAudioFile", inputArrayBuffer);
 
   const vbr = DOM_RESIDUAL_SIZE.value === "vbr";
   const residual_size = vbr
     ? parseFloat(DOM_VBR_TARGET_BITRATE.value)
     : parseInt(DOM_RESIDUAL_SIZE.value);
 
-  const { encoded, duration: encodeDuration } = await worker.encodeSEA(
+  const encodeStart = performance.now();
+  const encoded = await parallelEncode(
+    workers,
     interleavedInput,
     sampleRate,
     channels,
     residual_size,
     vbr
   );
+  const encodeDuration = performance.now() - encodeStart;
+
+  const decodeStart = performance.now();
+  const { samples: decodedSamples } = await parallelDecode(workers, encoded);
+  const decodeDuration = performance.now() - decodeStart;
 
   const {
     differenceFromOriginal,
     wave: decodedWav,
-    duration: decodeDuration,
     psnr,
-  } = await worker.decodeSEA(encoded, interleavedInput);
+  } = await worker.call("analyzeDecoded", decodedSamples, sampleRate, channels, interleavedInput);
 
   const pcm16Size = interleavedInput.length * 2;
   const compressedSize = (encoded.length / pcm16Size) * 100;
@@ -131,7 +139,11 @@ DOM_DECODE_SUBMIT.addEventListener("click", async () => {
   const file = fileInput.files[0];
   const encodedArrayBuffer = new Uint8Array(await readFile(file));
 
-  const { wave: decodedWav, duration: decodeDuration } = await worker.decodeSEA(encodedArrayBuffer);
+  const decodeStart = performance.now();
+  const { samples, sampleRate, channels } = await parallelDecode(workers, encodedArrayBuffer);
+  const decodeDuration = performance.now() - decodeStart;
+
+  const { wave: decodedWav } = await worker.call("analyzeDecoded", samples, sampleRate, channels);
 
   const audioUrl = URL.createObjectURL(new Blob([decodedWav], { type: "audio/wav" }));
 
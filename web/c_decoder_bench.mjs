@@ -0,0 +1,128 @@
+// Node benchmark of the C decoder module against the Rust codec module: file size, instantiate time
+// and decode throughput. The decoded samples of both have to be identical.
+// Usage: node c_decoder_bench.mjs [path/to/codec.wasm] [path/to/sea_decoder.wasm] [seconds]
+
+import { readFileSync } from "node:fs";
+import { gzipSync } from "node:zlib";
+
+import { createCodec, instantiateCodec } from "./codec.mjs";
+import { createSeaDecoder, instantiateSeaDecoder } from "./sea_decoder.mjs";
+import { testSignal } from "./utils.mjs";
+
+const SAMPLE_RATE = 44100;
+const CHANNELS = 2;
+const INSTANTIATE_RUNS = 50;
+const DECODE_RUNS = 10;
+
+const codecPath = process.argv[2] ?? new URL("codec.wasm", import.meta.url);
+const cDecoderPath = process.argv[3] ?? new URL("sea_decoder.wasm", import.meta.url);
+const seconds = parseFloat(process.argv[4] ?? "30");
+
+function assert(condition, message) {
+  if (!condition) {
+    console.error(`FAILED: ${message}`);
+    process.exit(1);
+  }
+}
+
+function median(values) {
+  const sorted = [...values].sort((a, b) => a - b);
+  return sorted[Math.floor(sorted.length / 2)];
+}
+
+function elapsedMs(start) {
+  return Number(process.hrtime.bigint() - start) / 1e6;
+}
+
+// compile and instantiate from the bytes, like a page that has not cached the compiled module
+async function instantiateMs(instantiate, bytes) {
+  const times = [];
+  for (let i = 0; i < INSTANTIATE_RUNS; i++) {
+    const start = process.hrtime.bigint();
+    await instantiate(bytes);
+    times.push(elapsedMs(start));
+  }
+  return median(times);
+}
+
+// fastest run, the first one warms up the JIT
+function decodeMs(decoder, encoded) {
+  let best = Infinity;
+  let result;
+  for (let i = 0; i < DECODE_RUNS; i++) {
+    const start = process.hrtime.bigint();
+    result = decoder.decode(encoded);
+    best = Math.min(best, elapsedMs(start));
+  }
+  return { best, result };
+}
+
+// the streaming API with pieces that split headers and chunks at arbitrary points
+function streamDecode(decoder, encoded, pieceSize) {
+  const stream = decoder.createStream();
+  const parts = [];
+  for (let offset = 0; offset < encoded.length; offset += pieceSize) {
+    parts.push(stream.push(encoded.subarray(offset, offset + pieceSize)));
+  }
+  parts.push(stream.end());
+  stream.free();
+
+  const samples = new Int16Array(parts.reduce((sum, part) => sum + part.length, 0));
+  let offset = 0;
+  for (const part of parts) {
+    samples.set(part, offset);
+    offset += part.length;
+  }
+  return samples;
+}
+
+function assertSameSamples(actual, expected, message) {
+  assert(actual.length === expected.length, `${message}: length differs`);
+  const mismatch = actual.findIndex((sample, i) => sample !== expected[i]);
+  assert(mismatch === -1, `${message}: sample ${mismatch} differs`);
+}
+
+const codecBytes = readFileSync(codecPath);
+const cDecoderBytes = readFileSync(cDecoderPath);
+const codec = await createCodec(codecBytes);
+const cDecoder = await createSeaDecoder(cDecoderBytes);
+
+console.log("module       bytes  gzipped  instantiate ms");
+for (const [name, bytes, instantiate] of [
+  ["rust", codecBytes, instantiateCodec],
+  ["c", cDecoderBytes, instantiateSeaDecoder],
+]) {
+  const ms = await instantiateMs(instantiate, bytes);
+  const gzipped = gzipSync(bytes).length;
+  console.log(
+    `${name.padEnd(8)} ${String(bytes.length).padStart(9)} ${String(gzipped).padStart(8)} ` +
+      `${ms.toFixed(3).padStart(15)}`
+  );
+}
+
+// odd length, so the file ends with a partial chunk
+const input = testSignal(Math.floor(SAMPLE_RATE * seconds) + 77, SAMPLE_RATE, CHANNELS);
+
+console.log(`\ndecoding ${seconds} s of audio, x realtime`);
+console.log("profile     rust ms     c ms   rust x      c x  c/rust");
+
+for (const [name, quality, vbr] of [
+  ["cbr-3", 3, false],
+  ["cbr-5", 5, false],
+  ["vbr-3.5", 3.5, true],
+]) {
+  const encoded = codec.encode(input, SAMPLE_RATE, CHANNELS, quality, vbr);
+  const rust = decodeMs(codec, encoded);
+  const c = decodeMs(cDecoder, encoded);
+
+  assert(c.result.sampleRate === rust.result.sampleRate, `${name}: sample rate differs`);
+  assert(c.result.channels === rust.result.channels, `${name}: channels differ`);
+  assertSameSamples(c.result.samples, rust.result.samples, name);
+  assertSameSamples(streamDecode(cDecoder, encoded, 1000), rust.result.samples, `${name} stream`);
+
+  const realtime = (ms) => ((seconds * 1000) / ms).toFixed(0).padStart(8);
+  console.log(
+    `${name.padEnd(8)} ${rust.best.toFixed(2).padStart(10)} ${c.best.toFixed(2).padStart(8)} ` +
+      `${realtime(rust.best)} ${realtime(c.best)} ${(c.best / rust.best).toFixed(2).padStart(7)}`
+  );
+}
@@ -0,0 +1,197 @@
+// WASM codec wrapper without any browser or worker dependency, so it runs in workers and in Node as well
+
+// smallest module using a v128 instruction, it only validates if the runtime supports fixed-width SIMD
+const SIMD_TEST_MODULE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15,
+  253, 98, 11,
+]);
+
+// the decoder-only build is much smaller but does not export any of the encode functions
+export function codecFileName({ decoderOnly = false } = {}) {
+  const name = decoderOnly ? "codec.decoder" : "codec";
+  return WebAssembly.validate(SIMD_TEST_MODULE) ? `${name}.simd.wasm` : `${name}.wasm`;
+}
+
+// imports the codec module expects, getExports() returns the exports once the module is instantiated
+export function codecImports(getExports) {
+  return {
+    env: {
+      memory: new WebAssembly.Memory({ initial: 256 }), // 16 MB
+      js_error: (start) => {
+        const view = new Uint8Array(getExports().memory.buffer);
+        let end = view.indexOf(0, start);
+        if (end === -1) throw new Error("Got invalid string from wasm");
+        const str = new TextDecoder().decode(view.subarray(start, end));
+        throw new Error(str);
+      },
+    },
+  };
+}
+
+// source is either a fetch() response promise or the bytes of the wasm file, returns the raw exports
+export async function instantiateCodec(source) {
+  let wasmExports;
+  const imports = codecImports(() => wasmExports);
+
+  const wasmModule =
+    source instanceof Promise
+      ? await WebAssembly.instantiateStreaming(source, imports)
+      : await WebAssembly.instantiate(source, imports);
+
+  wasmExports = wasmModule.instance.exports;
+  wasmExports.setup();
+  return wasmExports;
+}
+
+// source as in instantiateCodec
+export async function createCodec(source) {
+  const wasmExports = await instantiateCodec(source);
+
+  const INPUT_PIECE_SIZE = 64 * 1024;
+
+  // both directions work one chunk at a time, only a single chunk has to fit into the wasm memory
+  return {
+    encode: (inputSamples, sampleRate, channels, quality, vbr) => {
+      if (!(inputSamples instanceof Int16Array))
+        throw new Error("inputSamples should be Int16Array");
+
+      let encoder;
+      let wasmInputBufferSize;
+      let wasmInputBuffer;
+      let wasmOutputBufferSize;
+      let wasmOutputBuffer;
+
+      try {
+        const totalFrames = inputSamples.length / channels;
+        encoder = wasmExports.create_encoder(sampleRate, channels, quality, vbr, totalFrames);
+        if (!encoder) throw new Error("Encoding failed: Invalid settings.");
+        const chunkSamples = wasmExports.encoder_frames_per_chunk(encoder) * channels;
+
+        wasmInputBufferSize = chunkSamples * 2;
+        wasmInputBuffer = wasmExports.allocate(wasmInputBufferSize);
+
+        // bound of a file with a single chunk, which covers the header and any chunk
+        wasmOutputBufferSize = wasmExports.wasm_sea_encoded_size(
+          wasmInputBufferSize,
+          channels,
+          quality,
+          vbr
+        );
+        wasmOutputBuffer = wasmExports.allocate(wasmOutputBufferSize);
+
+        // exact upper bound, chunks are written straight into the final array
+        const output = new Uint8Array(
+          wasmExports.wasm_sea_encoded_size(inputSamples.byteLength, channels, quality, vbr)
+        );
+        let outputPosition = 0;
+
+        for (let offset = 0; offset < inputSamples.length; offset += chunkSamples) {
+          const chunk = inputSamples.subarray(offset, offset + chunkSamples);
+          new Int16Array(wasmExports.memory.buffer, wasmInputBuffer, chunk.length).set(chunk);
+
+          const outputLength = wasmExports.encode_chunk(
+            encoder,
+            wasmInputBuffer,
+            chunk.byteLength,
+            wasmOutputBuffer,
+            wasmOutputBufferSize
+          );
+          if (outputLength < 0) throw new Error("Encoding failed: Invalid chunk.");
+
+          output.set(
+            new Uint8Array(wasmExports.memory.buffer, wasmOutputBuffer, outputLength),
+            outputPosition
+          );
+          outputPosition += outputLength;
+        }
+
+        if (outputPosition === 0) throw new Error("Encoding failed: Got zero output length.");
+
+        return output.subarray(0, outputPosition);
+      } finally {
+        wasmExports.deallocate(wasmInputBuffer, wasmInputBufferSize);
+        wasmExports.deallocate(wasmOutputBuffer, wasmOutputBufferSize);
+        if (encoder) wasmExports.free_encoder(encoder);
+      }
+    },
+    decode: (encodedData) => {
+      if (!(encodedData instanceof Uint8Array)) throw new Error("encodedData should be Uint8Array");
+      if (encodedData.length < 22) throw new Error("Decoding failed: File is too short.");
+
+      let decoder;
+      let wasmInputBufferSize;
+      let wasmInputBuffer;
+      let wasmOutputBufferSize;
+      let wasmOutputBuffer;
+
+      try {
+        decoder = wasmExports.create_decoder();
+
+        // a single chunk decodes to at most frames_per_chunk * channels samples
+        const header = new DataView(encodedData.buffer, encodedData.byteOffset, 22);
+        const chunkSamples = header.getUint16(8, true) * header.getUint8(5);
+
+        wasmInputBufferSize = INPUT_PIECE_SIZE;
+        wasmInputBuffer = wasmExports.allocate(wasmInputBufferSize);
+        wasmOutputBufferSize = chunkSamples * 2;
+        wasmOutputBuffer = wasmExports.allocate(wasmOutputBufferSize);
+
+        // the first piece always contains the header, which is enough to bound the output size
+        const firstPiece = encodedData.subarray(0, INPUT_PIECE_SIZE);
+        new Uint8Array(wasmExports.memory.buffer).set(firstPiece, wasmInputBuffer);
+        const decodedSize = wasmExports.wasm_sea_decoded_size(
+          wasmInputBuffer,
+          firstPiece.length,
+          encodedData.length
+        );
+        const output = new Int16Array(decodedSize / 2);
+        let outputPosition = 0;
+
+        for (let offset = 0; offset < encodedData.length; offset += INPUT_PIECE_SIZE) {
+          const piece = encodedData.subarray(offset, offset + INPUT_PIECE_SIZE);
+          const endOfInput = offset + INPUT_PIECE_SIZE >= encodedData.length;
+          new Uint8Array(wasmExports.memory.buffer).set(piece, wasmInputBuffer);
+
+          let inputLength = piece.length;
+          while (true) {
+            const outputLength = wasmExports.decode_chunk(
+              decoder,
+              wasmInputBuffer,
+              inputLength,
+              endOfInput,
+              wasmOutputBuffer,
+              wasmOutputBufferSize
+            );
+            inputLength = 0;
+            if (outputLength < 0) throw new Error("Decoding failed: Corrupt chunk.");
+            if (outputLength === 0) break;
+
+            const samples = new Int16Array(
+              wasmExports.memory.buffer,
+              wasmOutputBuffer,
+              outputLength / 2
+            );
+            output.set(samples, outputPosition);
+            outputPosition += samples.length;
+          }
+        }
+
+        const sampleRate = wasmExports.decoder_sample_rate(decoder);
+        const channels = wasmExports.decoder_channels(decoder);
+
+        if (outputPosition === 0 || sampleRate === 0 || channels === 0)
+          throw new Error("Decoding failed: Got invalid output.");
+
+        return {
+          samples: output.subarray(0, outputPosition),
+          sampleRate,
+          channels,
+        };
+      } finally {
+        wasmExports.deallocate(wasmInputBuffer, wasmInputBufferSize);
+        wasmExports.deallocate(wasmOutputBuffer, wasmOutputBufferSize);
+        if (decoder) wasmExports.free_decoder(decoder);
+      }
+    },
+  };
+}
@@ -0,0 +1,165 @@
+// Splits encode and decode work into chunk aligned shards, so it can be spread over several workers.
+// Every chunk carries its own LMS state, which makes a range of chunks a valid file on its own
+// once it gets a file header.
+
+const FILE_HEADER_SIZE = 22;
+
+export function readHeader(encoded) {
+  if (encoded.length < FILE_HEADER_SIZE) throw new Error("File is too short");
+
+  const view = new DataView(encoded.buffer, encoded.byteOffset, encoded.byteLength);
+  const metadataSize = view.getUint32(18, true);
+
+  return {
+    channels: view.getUint8(5),
+    chunkSize: view.getUint16(6, true),
+    framesPerChunk: view.getUint16(8, true),
+    sampleRate: view.getUint32(10, true),
+    totalFrames: view.getUint32(14, true),
+    size: FILE_HEADER_SIZE + metadataSize,
+  };
+}
+
+function withTotalFrames(header, totalFrames) {
+  const output = header.slice();
+  new DataView(output.buffer).setUint32(14, totalFrames, true);
+  return output;
+}
+
+// splits count items into at most shards contiguous ranges of nearly equal size
+function shardRanges(count, shards) {
+  const ranges = [];
+  const perShard = Math.ceil(count / Math.max(1, shards));
+  for (let start = 0; start < count; start += perShard) {
+    ranges.push([start, Math.min(count, start + perShard)]);
+  }
+  return ranges;
+}
+
+// each shard is a complete .sea file holding a range of the chunks
+export function splitEncoded(encoded, shards) {
+  const header = readHeader(encoded);
+  const headerBytes = encoded.subarray(0, header.size);
+  const chunks = Math.ceil((encoded.length - header.size) / header.chunkSize);
+
+  return shardRanges(chunks, shards).map(([start, end]) => {
+    let totalFrames = 0; // streaming files only contain full chunks
+    if (header.totalFrames > 0) {
+      totalFrames =
+        Math.min(header.totalFrames, end * header.framesPerChunk) - start * header.framesPerChunk;
+    }
+
+    const body = encoded.subarray(
+      header.size + start * header.chunkSize,
+      Math.min(encoded.length, header.size + end * header.chunkSize)
+    );
+    const shard = new Uint8Array(header.size + body.length);
+    shard.set(withTotalFrames(headerBytes, totalFrames));
+    shard.set(body, header.size);
+    return shard;
+  });
+}
+
+// Shards of interleaved samples, cut at chunk boundaries so only the last shard has a partial chunk.
+// Shards after the first start prerollChunks earlier, encoding them warms up the LMS filter and the
+// resulting chunks are dropped again by joinEncoded().
+export function splitSamples(samples, channels, framesPerChunk, shards, prerollChunks = 0) {
+  const chunkSamples = framesPerChunk * channels;
+  const chunks = Math.ceil(samples.length / chunkSamples);
+
+  return shardRanges(chunks, shards).map(([start, end]) => {
+    const preroll = Math.min(start, prerollChunks);
+    return {
+      samples: samples.subarray(
+        (start - preroll) * chunkSamples,
+        Math.min(samples.length, end * chunkSamples)
+      ),
+      preroll,
+    };
+  });
+}
+
+// joins the files encoded from splitSamples() shards, chunks keep their order
+export function joinEncoded(parts, prerolls = parts.map(() => 0)) {
+  const headers = parts.map(readHeader);
+  const { chunkSize, framesPerChunk } = headers[0];
+
+  const bodies = parts.map((part, index) =>
+    part.subarray(headers[index].size + prerolls[index] * chunkSize)
+  );
+  const totalFrames = headers.reduce(
+    (sum, header, index) => sum + header.totalFrames - prerolls[index] * framesPerChunk,
+    0
+  );
+
+  const bodySize = bodies.reduce((sum, body) => sum + body.length, 0);
+  const output = new Uint8Array(headers[0].size + bodySize);
+  output.set(withTotalFrames(parts[0].subarray(0, headers[0].size), totalFrames));
+
+  let position = headers[0].size;
+  for (const body of bodies) {
+    output.set(body, position);
+    position += body.length;
+  }
+  return output;
+}
+
+export function joinSamples(parts) {
+  const output = new Int16Array(parts.reduce((sum, part) => sum + part.length, 0));
+  let position = 0;
+  for (const part of parts) {
+    output.set(part, position);
+    position += part.length;
+  }
+  return output;
+}
+
+// Runs tasks on a fixed set of workers, every worker takes the next task as soon as it is idle.
+// A worker is anything with a call(fn, ...args) method returning a promise.
+export async function runOnWorkers(workers, tasks) {
+  const results = new Array(tasks.length);
+  let next = 0;
+
+  await Promise.all(
+    workers.map(async (worker) => {
+      while (next < tasks.length) {
+        const index = next++;
+        results[index] = await worker.call(...tasks[index]);
+      }
+    })
+  );
+
+  return results;
+}
+
+// Every shard is encoded by an independent encoder, so the file is valid but not identical to a
+// single threaded encode. A pre-roll chunk adapts the LMS filter before the first kept chunk.
+export async function parallelEncode(
+  workers,
+  samples,
+  sampleRate,
+  channels,
+  quality,
+  vbr,
+  framesPerChunk = 5120
+) {
+  const shards = splitSamples(samples, channels, framesPerChunk, workers.length, 1);
+  const parts = await runOnWorkers(
+    workers,
+    shards.map((shard) => ["encodeShard", shard.samples, sampleRate, channels, quality, vbr])
+  );
+  return joinEncoded(parts, shards.map((shard) => shard.preroll));
+}
+
+// output is identical to a single threaded decode
+export async function parallelDecode(workers, encoded) {
+  const header = readHeader(encoded);
+  const shards = splitEncoded(encoded, workers.length);
+  const parts = await runOnWorkers(workers, shards.map((shard) => ["decodeShard", shard]));
+
+  return {
+    samples: joinSamples(parts),
+    sampleRate: header.sampleRate,
+    channels: header.channels,
+  };
+}
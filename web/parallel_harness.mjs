@@ -0,0 +1,123 @@
+// Node harness for parallel.mjs: runs the sharded encode and decode on worker threads,
+// each with its own wasm instance, and checks the results against a single instance.
+// Usage: node parallel_harness.mjs [path/to/codec.wasm] [seconds] [max workers]
+
+import { readFileSync } from "node:fs";
+import { availableParallelism } from "node:os";
+import { isMainThread, parentPort, Worker, workerData } from "node:worker_threads";
+
+import { createCodec } from "./codec.mjs";
+import { getPSNR, testSignal } from "./utils.mjs";
+import { parallelDecode, parallelEncode } from "./parallel.mjs";
+
+const SAMPLE_RATE = 44100;
+const CHANNELS = 2;
+
+if (!isMainThread) {
+  const codec = await createCodec(readFileSync(workerData.wasmPath));
+  const exports = {
+    encodeShard: (...args) => codec.encode(...args),
+    decodeShard: (encoded) => codec.decode(encoded).samples,
+  };
+
+  parentPort.on("message", ([id, fn, ...args]) => {
+    parentPort.postMessage([id, exports[fn](...args)]);
+  });
+} else {
+  const wasmPath = process.argv[2] ?? new URL("codec.wasm", import.meta.url);
+  const seconds = parseFloat(process.argv[3] ?? "60");
+  const maxWorkers = parseInt(process.argv[4] ?? availableParallelism());
+  await main(wasmPath, seconds, maxWorkers);
+}
+
+function createNodeWorker(wasmPath) {
+  const worker = new Worker(new URL(import.meta.url), { workerData: { wasmPath } });
+  const callbacks = new Map();
+  let id = 1;
+
+  worker.on("message", ([callId, result]) => {
+    callbacks.get(callId)(result);
+    callbacks.delete(callId);
+  });
+
+  return {
+    call: (fn, ...args) =>
+      new Promise((resolve) => {
+        const callId = id++;
+        callbacks.set(callId, resolve);
+        worker.postMessage([callId, fn, ...args]);
+      }),
+    terminate: () => worker.terminate(),
+  };
+}
+
+function assert(condition, message) {
+  if (!condition) {
+    console.error(`FAILED: ${message}`);
+    process.exit(1);
+  }
+}
+
+function sameSamples(a, b) {
+  return a.length === b.length && a.every((value, index) => value === b[index]);
+}
+
+async function timed(fn) {
+  const start = performance.now();
+  const result = await fn();
+  return [result, performance.now() - start];
+}
+
+async function main(wasmPath, seconds, maxWorkers) {
+  // odd length, so the last shard ends with a partial chunk
+  const input = testSignal(Math.floor(SAMPLE_RATE * seconds) + 123, SAMPLE_RATE, CHANNELS);
+
+  const workers = [...Array(maxWorkers).keys()].map(() => createNodeWorker(wasmPath));
+
+  console.log(`${seconds} s of audio, up to ${maxWorkers} workers`);
+  console.log("profile  workers  encode ms  decode ms  psnr dB");
+
+  for (const [name, quality, vbr] of [
+    ["cbr-3", 3, false],
+    ["vbr-3.5", 3.5, true],
+  ]) {
+    const reference = await workers[0].call(
+      "encodeShard",
+      input,
+      SAMPLE_RATE,
+      CHANNELS,
+      quality,
+      vbr
+    );
+    const referenceDecoded = await workers[0].call("decodeShard", reference);
+    const referencePsnr = getPSNR(input, referenceDecoded);
+
+    for (let count = 1; count <= maxWorkers; count *= 2) {
+      const pool = workers.slice(0, count);
+
+      const [encoded, encodeTime] = await timed(() =>
+        parallelEncode(pool, input, SAMPLE_RATE, CHANNELS, quality, vbr)
+      );
+      const [decoded, decodeTime] = await timed(() => parallelDecode(pool, encoded));
+
+      // chunks decode independently, so sharded decoding has to be exact
+      const { samples: shardedReference } = await parallelDecode(pool, reference);
+      assert(sameSamples(shardedReference, referenceDecoded), `${name}: sharded decode differs`);
+
+      assert(decoded.samples.length === input.length, `${name}: decoded length differs`);
+      assert(decoded.sampleRate === SAMPLE_RATE && decoded.channels === CHANNELS, "header");
+      if (count === 1) assert(sameSamples(encoded, reference), `${name}: single shard differs`);
+
+      // every shard restarts the LMS filter, which may only cost a little quality
+      const psnr = getPSNR(input, decoded.samples);
+      assert(psnr < referencePsnr + 0.5, `${name}: psnr ${psnr} vs ${referencePsnr}`);
+
+      console.log(
+        `${name.padEnd(8)} ${String(count).padStart(7)} ${encodeTime.toFixed(1).padStart(10)} ` +
+          `${decodeTime.toFixed(1).padStart(10)} ${psnr.toFixed(2).padStart(8)}`
+      );
+    }
+  }
+
+  workers.forEach((worker) => worker.terminate());
+}
@@ -0,0 +1,103 @@
+// Real-time playback: the codec decodes one 128 frame render quantum per call on the audio thread.
+// createRealtimeDecoder runs anywhere, createSeaPlayerNode on the main thread only.
+
+export const QUANTUM_FRAMES = 128;
+
+// file header plus the first two bytes of the first chunk, which the decoder needs for its setup
+export function realtimePrefix(encoded) {
+  const header = new DataView(encoded.buffer, encoded.byteOffset, 22);
+  return encoded.subarray(0, 22 + header.getUint32(18, true) + 2);
+}
+
+// Wraps the real-time decoder of an instantiated codec module, encoded is the file or at least its
+// realtimePrefix. Every WASM buffer is allocated here, so the views over the ring stay valid while playing.
+export function createRealtimeDecoder(wasmExports, encoded, inputChunks = 8) {
+  const prefix = realtimePrefix(encoded);
+  const prefixBuffer = wasmExports.allocate(prefix.length);
+  new Uint8Array(wasmExports.memory.buffer).set(prefix, prefixBuffer);
+  const decoder = wasmExports.create_realtime_decoder(prefixBuffer, prefix.length, inputChunks);
+  wasmExports.deallocate(prefixBuffer, prefix.length);
+  if (decoder === 0) throw new Error("Decoding failed: Invalid file header.");
+
+  const channels = wasmExports.realtime_decoder_channels(decoder);
+  const ring = wasmExports.realtime_decoder_ring(decoder);
+  const slotCount = wasmExports.realtime_decoder_ring_slots();
+
+  let heap;
+  let slots;
+  const refreshViews = () => {
+    heap = new Uint8Array(wasmExports.memory.buffer);
+    slots = [...Array(slotCount).keys()].map((slot) =>
+      [...Array(channels).keys()].map(
+        (channel) =>
+          new Float32Array(
+            wasmExports.memory.buffer,
+            ring + (slot * channels + channel) * QUANTUM_FRAMES * 4,
+            QUANTUM_FRAMES
+          )
+      )
+    );
+  };
+  refreshViews();
+
+  return {
+    channels,
+    sampleRate: wasmExports.realtime_decoder_sample_rate(decoder),
+    // the input starts after the file header
+    headerLength: wasmExports.realtime_decoder_header_length(decoder),
+
+    // copies as much of bytes into the decoder as fits, returns the number of bytes taken
+    push(bytes, endOfInput) {
+      if (heap.buffer !== wasmExports.memory.buffer) refreshViews();
+
+      const length = Math.min(bytes.length, wasmExports.realtime_decoder_input_space(decoder));
+      const buffer = wasmExports.realtime_decoder_input_buffer(decoder);
+      heap.set(length === bytes.length ? bytes : bytes.subarray(0, length), buffer);
+      wasmExports.realtime_decoder_commit_input(
+        decoder,
+        length,
+        endOfInput && length === bytes.length
+      );
+      return length;
+    },
+
+    // Decodes the next quantum and returns one Float32Array per channel, null once the file ended.
+    // Frames missing because of an input underrun are silence.
+    decodeQuantum() {
+      const slot = wasmExports.realtime_decoder_decode_quantum(decoder);
+      if (slot === -2) throw new Error("Decoding failed: Invalid chunk.");
+      if (slot === -1) return null;
+      if (heap.buffer !== wasmExports.memory.buffer) refreshViews();
+      return slots[slot];
+    },
+
+    underruns: () => wasmExports.realtime_decoder_underruns(decoder),
+
+    free: () => wasmExports.free_realtime_decoder(decoder),
+  };
+}
+
+// Plays an encoded file through realtime_worklet.mjs. The context should run at the sample rate of
+// the file, wasmModule is the compiled codec module, the decoder-only build is enough, see
+// codecFileName in codec.mjs.
+export async function createSeaPlayerNode(context, wasmModule, encoded) {
+  await context.audioWorklet.addModule(new URL("./realtime_worklet.mjs", import.meta.url));
+
+  const node = new AudioWorkletNode(context, "sea-player", {
+    numberOfInputs: 0,
+    outputChannelCount: [encoded[5]],
+    processorOptions: { module: wasmModule, prefix: realtimePrefix(encoded) },
+  });
+
+  // the worklet buffers the pieces and moves them into the decoder as it plays
+  const PIECE_SIZE = 64 * 1024;
+  const headerLength = realtimePrefix(encoded).length - 2;
+  for (let offset = headerLength; offset < encoded.length; offset += PIECE_SIZE) {
+    const piece = encoded.slice(offset, offset + PIECE_SIZE);
+    node.port.postMessage({ data: piece, end: offset + PIECE_SIZE >= encoded.length }, [
+      piece.buffer,
+    ]);
+  }
+
+  return node;
+}
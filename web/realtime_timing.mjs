@@ -0,0 +1,114 @@
+// Node timing test for the real-time decoder: plays encoded files one render quantum at a time,
+// checks the output against the regular decoder and reports the per-quantum cost.
+// Usage: node realtime_timing.mjs [path/to/codec.wasm] [seconds]
+
+import { readFileSync } from "node:fs";
+
+import { createCodec, instantiateCodec } from "./codec.mjs";
+import { createRealtimeDecoder, QUANTUM_FRAMES } from "./realtime.mjs";
+import { testSignal } from "./utils.mjs";
+
+const SAMPLE_RATE = 48000;
+const CHANNELS = 2;
+
+// bytes moved into the decoder before each quantum, like port messages arriving on the audio thread
+const FEED_SIZE = 4096;
+const RUNS = 5;
+
+const wasmPath = process.argv[2] ?? new URL("codec.wasm", import.meta.url);
+const seconds = parseFloat(process.argv[3] ?? "60");
+
+function assert(condition, message) {
+  if (!condition) {
+    console.error(`FAILED: ${message}`);
+    process.exit(1);
+  }
+}
+
+function play(wasmExports, encoded, reference) {
+  const decoder = createRealtimeDecoder(wasmExports, encoded);
+  const quanta = Math.ceil(reference.length / CHANNELS / QUANTUM_FRAMES);
+  const times = new Float64Array(quanta);
+
+  // a player buffers input before it starts, later the feed keeps up with playback
+  let inputOffset = decoder.headerLength;
+  let taken;
+  do {
+    taken = decoder.push(encoded.subarray(inputOffset), true);
+    inputOffset += taken;
+  } while (taken > 0);
+
+  let frame = 0;
+  let quantumIndex = 0;
+
+  while (true) {
+    if (inputOffset < encoded.length) {
+      const piece = encoded.subarray(inputOffset, inputOffset + FEED_SIZE);
+      inputOffset += decoder.push(piece, inputOffset + piece.length === encoded.length);
+    }
+
+    const start = process.hrtime.bigint();
+    const quantum = decoder.decodeQuantum();
+    const time = Number(process.hrtime.bigint() - start) / 1000;
+    if (quantum === null) break;
+
+    assert(quantumIndex < quanta, "more quanta than frames");
+    times[quantumIndex++] = time;
+
+    for (let i = 0; i < QUANTUM_FRAMES; i++, frame++) {
+      for (let channel = 0; channel < CHANNELS; channel++) {
+        const index = frame * CHANNELS + channel;
+        const expected = index < reference.length ? reference[index] / 32768 : 0;
+        // no message string per sample, the garbage would trigger GC pauses inside the timed calls
+        if (quantum[channel][i] !== expected) assert(false, `sample ${index} differs`);
+      }
+    }
+  }
+
+  assert(quantumIndex === quanta, `${quantumIndex} quanta instead of ${quanta}`);
+  assert(decoder.underruns() === 0, `${decoder.underruns()} underruns`);
+  decoder.free();
+
+  return times;
+}
+
+const wasmBytes = readFileSync(wasmPath);
+const codec = await createCodec(wasmBytes);
+const wasmExports = await instantiateCodec(wasmBytes);
+
+// odd length, so the file ends with a partial chunk and a partial quantum
+const input = testSignal(Math.floor(SAMPLE_RATE * seconds) + 77, SAMPLE_RATE, CHANNELS);
+const budget = (QUANTUM_FRAMES / SAMPLE_RATE) * 1e6;
+
+console.log(`${seconds} s of audio, ${budget.toFixed(0)} us per quantum at ${SAMPLE_RATE} Hz`);
+console.log("profile  quanta  mean us  p99 us  max us  max/budget  raw max us");
+
+for (const [name, quality, vbr] of [
+  ["cbr-3", 3, false],
+  ["vbr-3.5", 3.5, true],
+]) {
+  const encoded = codec.encode(input, SAMPLE_RATE, CHANNELS, quality, vbr);
+  const reference = codec.decode(encoded).samples;
+
+  // warm up JIT, a player has been running for a while when a quantum counts
+  play(wasmExports, encoded, reference);
+
+  // Preemption and GC make single measurements noisy. The cost of a quantum is its fastest run,
+  // which keeps the quanta that are always expensive, like the ones parsing a chunk.
+  const runs = [...Array(RUNS).keys()].map(() => play(wasmExports, encoded, reference));
+  const times = runs[0].map((_, index) => Math.min(...runs.map((run) => run[index]))).sort();
+  const rawMax = runs.reduce((max, run) => run.reduce((a, b) => Math.max(a, b), max), 0);
+
+  const mean = times.reduce((sum, time) => sum + time, 0) / times.length;
+  const p99 = times[Math.floor(times.length * 0.99)];
+  const max = times[times.length - 1];
+
+  console.log(
+    `${name.padEnd(8)} ${String(times.length).padStart(6)} ${mean.toFixed(2).padStart(8)} ` +
+      `${p99.toFixed(2).padStart(7)} ${max.toFixed(2).padStart(7)} ` +
+      `${((max / budget) * 100).toFixed(1).padStart(9)}% ${rawMax.toFixed(2).padStart(10)}`
+  );
+
+  // the worst quantum, which also parses a chunk, has to fit into the render budget
+  assert(max < budget, `${name}: worst quantum takes ${max.toFixed(0)} us`);
+}
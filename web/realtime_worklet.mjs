@@ -0,0 +1,69 @@
+// AudioWorkletProcessor playing a SEA file, registered as "sea-player", see createSeaPlayerNode.
+// Decoding happens in process(), one render quantum at a time, so nothing is decoded ahead.
+// processorOptions: { module: compiled codec module, prefix: realtimePrefix() of the file }
+// port messages: { data: Uint8Array with the next bytes after the header, end: true for the last one }
+// posts { ended: true, underruns } once the file was played
+
+import { codecImports } from "./codec.mjs";
+import { createRealtimeDecoder } from "./realtime.mjs";
+
+class SeaPlayerProcessor extends AudioWorkletProcessor {
+  constructor(options) {
+    super();
+
+    const { module, prefix } = options.processorOptions;
+    let wasmExports;
+    const instance = new WebAssembly.Instance(module, codecImports(() => wasmExports));
+    wasmExports = instance.exports;
+    wasmExports.setup();
+
+    this.decoder = createRealtimeDecoder(wasmExports, prefix);
+
+    // pieces that did not fit into the decoder input yet
+    this.pending = [];
+    this.pendingOffset = 0;
+    this.endOfInput = false;
+
+    this.port.onmessage = ({ data }) => {
+      this.pending.push(data.data);
+      if (data.end) this.endOfInput = true;
+    };
+  }
+
+  feed() {
+    while (this.pending.length > 0) {
+      const piece = this.pending[0];
+      const last = this.pending.length === 1 && this.endOfInput;
+      this.pendingOffset += this.decoder.push(piece.subarray(this.pendingOffset), last);
+      if (this.pendingOffset < piece.length) return;
+
+      this.pending.shift();
+      this.pendingOffset = 0;
+    }
+  }
+
+  process(inputs, outputs) {
+    // process() can still be called after returning false
+    if (this.decoder === null) return false;
+
+    this.feed();
+
+    const quantum = this.decoder.decodeQuantum();
+    if (quantum === null) {
+      this.port.postMessage({ ended: true, underruns: this.decoder.underruns() });
+      this.decoder.free();
+      this.decoder = null;
+      return false;
+    }
+
+    // a mono file plays on every output channel
+    const output = outputs[0];
+    for (let channel = 0; channel < output.length; channel++) {
+      output[channel].set(quantum[Math.min(channel, quantum.length - 1)]);
+    }
+
+    return true;
+  }
+}
+
+registerProcessor("sea-player", SeaPlayerProcessor);
@@ -0,0 +1,185 @@
+// Wrapper of sea_decoder.wasm, the freestanding C decoder built from c/sea_decoder.c.
+// It only decodes, but the module is a fraction of the size of codec.wasm and instantiates faster.
+
+const HEADER_SIZE = 22;
+const ALIGNMENT = 16;
+const PAGE_SIZE = 65536;
+
+const ERRORS = {
+  [-1]: "Invalid file",
+  [-2]: "Invalid chunk",
+  [-3]: "Unsupported file",
+  [-4]: "Output buffer too small",
+};
+
+function check(result) {
+  if (result < 0) throw new Error(`Decoding failed: ${ERRORS[result] ?? result}`);
+  return result;
+}
+
+// source is either a fetch() response promise or the bytes of the wasm file, returns the raw exports
+export async function instantiateSeaDecoder(source) {
+  const imports = { env: { powf: Math.pow } };
+
+  const wasmModule =
+    source instanceof Promise
+      ? await WebAssembly.instantiateStreaming(source, imports)
+      : await WebAssembly.instantiate(source, imports);
+
+  return wasmModule.instance.exports;
+}
+
+// the module does not allocate, blocks above __heap_base are handed out here and reused once freed
+function createHeap(wasmExports) {
+  const align = (value) => Math.ceil(value / ALIGNMENT) * ALIGNMENT;
+  const sizes = new Map();
+  const freeBlocks = [];
+  let top = align(wasmExports.__heap_base.value);
+
+  return {
+    allocate: (size) => {
+      const index = freeBlocks.findIndex((ptr) => sizes.get(ptr) >= size);
+      if (index !== -1) return freeBlocks.splice(index, 1)[0];
+
+      const ptr = top;
+      top = align(top + size);
+      const missing = top - wasmExports.memory.buffer.byteLength;
+      if (missing > 0) wasmExports.memory.grow(Math.ceil(missing / PAGE_SIZE));
+      sizes.set(ptr, size);
+      return ptr;
+    },
+    free: (ptr) => freeBlocks.push(ptr),
+  };
+}
+
+// source as in instantiateSeaDecoder
+export async function createSeaDecoder(source) {
+  const wasmExports = await instantiateSeaDecoder(source);
+  const heap = createHeap(wasmExports);
+  const stateSize = wasmExports.sea_decoder_size();
+
+  // Streaming decoder, bytes can be pushed in pieces of any size. push() returns the samples of
+  // every chunk completed by the piece, end() decodes the last chunk, which may be shorter.
+  const createStream = () => {
+    const state = heap.allocate(stateSize + HEADER_SIZE);
+    let buffers;
+    let header;
+    let skip = 0;
+    let pending = new Uint8Array(0);
+
+    const decodeChunk = (chunk, output, outputPosition) => {
+      new Uint8Array(wasmExports.memory.buffer).set(chunk, buffers.input);
+      const written = check(
+        wasmExports.sea_decoder_decode_chunk(
+          state,
+          buffers.input,
+          chunk.length,
+          buffers.output,
+          header.chunkSamples
+        )
+      );
+      const samples = new Int16Array(wasmExports.memory.buffer, buffers.output, written);
+      output.set(samples, outputPosition);
+      return written;
+    };
+
+    const init = () => {
+      new Uint8Array(wasmExports.memory.buffer).set(
+        pending.subarray(0, HEADER_SIZE),
+        state + stateSize
+      );
+      skip = check(wasmExports.sea_decoder_init(state, state + stateSize, HEADER_SIZE));
+
+      const channels = wasmExports.sea_decoder_channels(state);
+      header = {
+        sampleRate: wasmExports.sea_decoder_sample_rate(state),
+        channels,
+        chunkSize: wasmExports.sea_decoder_chunk_size(state),
+        chunkSamples: wasmExports.sea_decoder_frames_per_chunk(state) * channels,
+      };
+      buffers = { input: heap.allocate(header.chunkSize) };
+      buffers.output = heap.allocate(header.chunkSamples * 2);
+    };
+
+    return {
+      // null until the header was pushed
+      header: () => header ?? null,
+      push: (bytes) => {
+        if (pending.length === 0) {
+          pending = bytes;
+        } else {
+          const joined = new Uint8Array(pending.length + bytes.length);
+          joined.set(pending);
+          joined.set(bytes, pending.length);
+          pending = joined;
+        }
+
+        if (!header) {
+          if (pending.length < HEADER_SIZE) {
+            pending = pending.slice();
+            return new Int16Array(0);
+          }
+          init();
+        }
+
+        // metadata is skipped, it can be longer than a single piece
+        const skipped = Math.min(skip, pending.length);
+        pending = pending.subarray(skipped);
+        skip -= skipped;
+
+        const chunks = Math.floor(pending.length / header.chunkSize);
+        const output = new Int16Array(chunks * header.chunkSamples);
+        let outputPosition = 0;
+        for (let i = 0; i < chunks; i++) {
+          const chunk = pending.subarray(i * header.chunkSize, (i + 1) * header.chunkSize);
+          outputPosition += decodeChunk(chunk, output, outputPosition);
+        }
+
+        // copied, the caller may reuse its buffer
+        pending = pending.slice(chunks * header.chunkSize);
+        return output.subarray(0, outputPosition);
+      },
+      end: () => {
+        if (!header) throw new Error("Decoding failed: File is too short.");
+        if (pending.length === 0) return new Int16Array(0);
+
+        const output = new Int16Array(header.chunkSamples);
+        const written = decodeChunk(pending, output, 0);
+        pending = new Uint8Array(0);
+        return output.subarray(0, written);
+      },
+      free: () => {
+        heap.free(state);
+        if (buffers) {
+          heap.free(buffers.input);
+          heap.free(buffers.output);
+        }
+      },
+    };
+  };
+
+  return {
+    createStream,
+    // same result as decode() of createCodec
+    decode: (encodedData) => {
+      if (!(encodedData instanceof Uint8Array)) throw new Error("encodedData should be Uint8Array");
+
+      const stream = createStream();
+      try {
+        const body = stream.push(encodedData);
+        const tail = stream.end();
+        let samples = body;
+        if (tail.length > 0) {
+          samples = new Int16Array(body.length + tail.length);
+          samples.set(body);
+          samples.set(tail, body.length);
+        }
+
+        const { sampleRate, channels } = stream.header();
+        return { samples, sampleRate, channels };
+      } finally {
+        stream.free();
+      }
+    },
+  };
+}
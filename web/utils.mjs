@@ -87,3 +87,19 @@ export function calculateDifference(originalData, decodedData) {
   }
   return diff;
 }
+
+// deterministic interleaved signal for the Node harnesses, a sweeping tone per channel plus noise
+export function testSignal(frames, sampleRate, channels) {
+  const samples = new Int16Array(frames * channels);
+  let rng = 0x12345678;
+  for (let i = 0; i < frames; i++) {
+    const t = i / sampleRate;
+    for (let channel = 0; channel < channels; channel++) {
+      rng = (rng * 1103515245 + 12345) >>> 0;
+      const noise = (rng / 0xffffffff - 0.5) * 0.05;
+      const tone = Math.sin(2 * Math.PI * (220 + 110 * channel) * t * (1 + 0.1 * Math.sin(t)));
+      samples[i * channels + channel] = Math.round((tone * 0.6 + noise) * 32767);
+    }
+  }
+  return samples;
+}
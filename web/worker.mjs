@@ -1,4 +1,5 @@
 import { decodeAudioFile } from "./dist/deps.modern.js";
+import { codecFileName, createCodec } from "./codec.mjs";
 import {
   encodeWAV,
   getPSNR,
@@ -8,139 +9,12 @@ import {
 
 let wasm;
 
-(async () => {
-  const wasmModule = await WebAssembly.instantiateStreaming(fetch("codec.wasm"), {
-    env: {
-      memory: new WebAssembly.Memory({ initial: 256 }), // 16 MB
-      js_error: (start) => {
-        const view = new Uint8Array(wasmModule.instance.exports.memory.buffer);
-        let end = view.indexOf(0, start);
-        if (end === -1) throw new Error("Got invalid string from wasm");
-        const str = new TextDecoder().decode(view.subarray(start, end));
-        throw new Error(str);
-      },
-    },
-  });
-
-  const wasmExports = wasmModule.instance.exports;
-  wasmExports.setup();
-
-  wasm = {
-    wasm_sea_encode: (inputSamples, sampleRate, channels, quality, vbr) => {
-      if (!(inputSamples instanceof Int16Array))
-        throw new Error("inputSamples should be Int16Array");
-
-      let wasmInputBufferSize;
-      let wasmInputBuffer;
-      let wasmOutputBufferSize;
-      let wasmOutputBuffer;
-
-      try {
-        wasmInputBufferSize = inputSamples.byteLength;
-        wasmInputBuffer = wasmExports.allocate(wasmInputBufferSize);
-        const inputSamplesU8 = new Uint8Array(
-          inputSamples.buffer,
-          inputSamples.byteOffset,
-          inputSamples.byteLength
-        ).slice();
-
-        new Uint8Array(wasmExports.memory.buffer).set(inputSamplesU8, wasmInputBuffer);
-
-        wasmOutputBufferSize = Math.floor(inputSamples.byteLength);
-        wasmOutputBuffer = wasmExports.allocate(wasmOutputBufferSize);
-
-        const outputLength = wasmExports.wasm_sea_encode(
-          wasmInputBuffer,
-          wasmInputBufferSize,
-          sampleRate,
-          channels,
-          quality,
-          vbr,
-          wasmOutputBuffer,
-          wasmOutputBufferSize
-        );
-
-        if (outputLength === 0) throw new Error("Encoding failed: Output buffer too small.");
-
-        const output = new Uint8Array(
-          wasmExports.memory.buffer,
-          wasmOutputBuffer,
-          outputLength
-        ).slice();
-
-        return output;
-      } catch (e) {
-        postMessage(["error", e.message]);
-        throw e;
-      } finally {
-        wasmExports.deallocate(wasmInputBuffer, wasmInputBufferSize);
-        wasmExports.deallocate(wasmOutputBuffer, wasmOutputBufferSize);
-      }
-    },
-    wasm_sea_decode: (encodedData) => {
-      if (!(encodedData instanceof Uint8Array)) throw new Error("encodedData should be Uint8Array");
-
-      let wasmInputBufferSize;
-      let wasmInputBuffer;
-      let wasmOutputBufferSize;
-      let wasmOutputBuffer;
-      let wasmSampleRateBuffer;
-      let wasmChannelsBuffer;
-
-      try {
-        wasmInputBufferSize = encodedData.byteLength;
-        wasmInputBuffer = wasmExports.allocate(wasmInputBufferSize);
-        new Uint8Array(wasmExports.memory.buffer).set(encodedData, wasmInputBuffer);
-
-        wasmOutputBufferSize = wasmInputBufferSize * 15;
-        wasmOutputBuffer = wasmExports.allocate(wasmOutputBufferSize);
-
-        wasmSampleRateBuffer = wasmExports.allocate(4);
-        wasmChannelsBuffer = wasmExports.allocate(4);
-
-        const outputLength = wasmExports.wasm_sea_decode(
-          wasmInputBuffer,
-          wasmInputBufferSize,
-          wasmOutputBuffer,
-          wasmOutputBufferSize,
-          wasmSampleRateBuffer,
-          wasmChannelsBuffer
-        );
-
-        if (outputLength === 0) throw new Error("Decoding failed: Got zero output length.");
-
-        const output = new Int16Array(
-          wasmExports.memory.buffer,
-          wasmOutputBuffer,
-          outputLength / 2
-        ).slice();
-
-        const sampleRate = new Uint32Array(wasmExports.memory.buffer, wasmSampleRateBuffer, 1)[0];
-        const channels = new Uint32Array(wasmExports.memory.buffer, wasmChannelsBuffer, 1)[0];
-
-        if (sampleRate === 0 || channels === 0)
-          throw new Error("Decoding failed: Got invalid output.");
-
-        return {
-          samples: output,
-          sampleRate,
-          channels,
-        };
-      } catch (e) {
-        postMessage(["error", e.message]);
-        throw e;
-      } finally {
-        wasmExports.deallocate(wasmInputBuffer, wasmInputBufferSize);
-        wasmExports.deallocate(wasmOutputBuffer, wasmOutputBufferSize);
-        wasmExports.deallocate(wasmSampleRateBuffer, 4);
-        wasmExports.deallocate(wasmChannelsBuffer, 4);
-      }
-    },
-  };
+const ready = (async () => {
+  wasm = await createCodec(fetch(codecFileName()));
 
   // warm up JIT
-  const encodedData = wasm.wasm_sea_encode(new Int16Array(1024 * 1024), 44100, 1, 3, false);
-  wasm.wasm_sea_decode(encodedData);
+  const encodedData = wasm.encode(new Int16Array(1024 * 1024), 44100, 1, 3, false);
+  wasm.decode(encodedData);
 })();
 
 let exports = {
@@ -162,21 +36,16 @@ let exports = {
     };
   },
 
-  encodeSEA(interleavedSamples, sampleRate, channels, quality, vbr) {
-    const start = performance.now();
-    const encoded = wasm.wasm_sea_encode(interleavedSamples, sampleRate, channels, quality, vbr);
-    const end = performance.now();
+  // a range of chunks, see parallel.mjs
+  encodeShard(interleavedSamples, sampleRate, channels, quality, vbr) {
+    return wasm.encode(interleavedSamples, sampleRate, channels, quality, vbr);
+  },
 
-    return {
-      encoded,
-      duration: end - start,
-    };
+  decodeShard(encodedData) {
+    return wasm.decode(encodedData).samples;
   },
 
-  decodeSEA(encodedData, originalData) {
-    const start = performance.now();
-    const { samples, sampleRate, channels } = wasm.wasm_sea_decode(encodedData);
-    const end = performance.now();
+  analyzeDecoded(samples, sampleRate, channels, originalData) {
     const wave = encodeWAV(samples, sampleRate, channels);
     let psnr = 0;
     let differenceFromOriginal = null;
@@ -193,9 +62,6 @@ let exports = {
     return {
       wave,
       differenceFromOriginal,
-      sampleRate,
-      channels,
-      duration: end - start,
       psnr,
     };
   },
@@ -204,6 +70,7 @@ let exports = {
 addEventListener("message", async (e) => {
   const { data } = e;
   const [id, fn, ...rest] = data;
+  await ready;
 
   if (fn in exports) {
     try {